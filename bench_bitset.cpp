@@ -11,6 +11,7 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <chrono>
 #include <functional>
@@ -18,6 +19,7 @@
 #include <iomanip>
 #include <random>
 #include <cmath>
+#include <thread>
 #include "boost_ext/dynamic_bitset_ext.hpp"
 #include "bitset/Types.h"
 #include "Timer.h"
@@ -68,6 +70,9 @@ double test_boost_dynamic_bitset_and(int round);
 double test_boost_dynamic_bitset_flip(int round);
 double test_boost_dynamic_bitset_or_assign(int round);
 double test_boost_dynamic_bitset_and_assign(int round);
+double test_boost_dynamic_bitset_count(int round);
+double test_boost_dynamic_bitset_xor_assign(int round);
+double test_boost_dynamic_bitset_andnot_assign(int round);
 
 
 double test_concurrent_bitset_test(int round);
@@ -78,6 +83,9 @@ double test_concurrent_bitset_or_assign(int round);
 double test_concurrent_bitset_and(int round);
 double test_concurrent_bitset_and_assign(int round);
 double test_concurrent_bitset_flip(int round);
+double test_concurrent_bitset_count(int round);
+double test_concurrent_bitset_xor_assign(int round);
+double test_concurrent_bitset_andnot_assign(int round);
 
 void gen_random_data() {
     RandomData.resize(N);
@@ -199,6 +207,44 @@ double test_concurrent_bitset_flip(int round){
 	return timer.get_overall_seconds();
 }
 
+double test_concurrent_bitset_count(int round){
+	auto l = ConcurrentBitset(N_BITS, DatasetL.data());
+	l.enable_count_tracking();
+	size_t total = 0;
+    	Timer timer;
+
+	for (int i =0; i < round; i++){
+		l.set(RandomPos[i % N]);
+		total += l.count();
+	}	
+
+	auto secs = timer.get_overall_seconds();
+	std::cout << "count checksum: " << total << std::endl;
+	return secs;
+}
+
+double test_concurrent_bitset_xor_assign(int round){
+	auto l = ConcurrentBitset(N_BITS, DatasetL.data());
+	auto r = ConcurrentBitset(N_BITS, DatasetR.data());
+    	Timer timer;
+
+	for (int i =0; i < round; i++){
+		l ^= r;
+	}	
+	return timer.get_overall_seconds();
+}
+
+double test_concurrent_bitset_andnot_assign(int round){
+	auto l = ConcurrentBitset(N_BITS, DatasetL.data());
+	auto r = ConcurrentBitset(N_BITS, DatasetR.data());
+    	Timer timer;
+
+	for (int i =0; i < round; i++){
+		l -= r;
+	}	
+	return timer.get_overall_seconds();
+}
+
 double test_concurrent_bitset_or_assign(int round) {
 
   	auto l = ConcurrentBitset(N_BITS, DatasetL.data());
@@ -296,6 +342,57 @@ double test_boost_dynamic_bitset_and_assign(int round){
 }
 
 
+double test_boost_dynamic_bitset_xor_assign(int round){
+	auto viewL = BitsetView(DatasetL.data(), N_BITS);
+ 	auto x = view_to_string(viewL);
+  	auto l = BitsetType(x);
+
+	auto viewR = BitsetView(DatasetR.data(), N_BITS);
+ 	auto y = view_to_string(viewR);
+  	auto r = BitsetType(y);
+
+	Timer timer;
+	for (int i =0; i < round; i++){
+		l^= r;
+	}	
+
+	return timer.get_overall_seconds();
+}
+
+double test_boost_dynamic_bitset_andnot_assign(int round){
+	auto viewL = BitsetView(DatasetL.data(), N_BITS);
+ 	auto x = view_to_string(viewL);
+  	auto l = BitsetType(x);
+
+	auto viewR = BitsetView(DatasetR.data(), N_BITS);
+ 	auto y = view_to_string(viewR);
+  	auto r = BitsetType(y);
+
+	Timer timer;
+	for (int i =0; i < round; i++){
+		l-= r;
+	}	
+
+	return timer.get_overall_seconds();
+}
+
+double test_boost_dynamic_bitset_count(int round){
+	auto viewL = BitsetView(DatasetL.data(), N_BITS);
+  	auto x = view_to_string(viewL);
+  	auto l = BitsetType(x);
+	size_t total = 0;
+
+    	Timer timer;
+	for (int i =0; i < round; i++){
+		l.set(RandomPos[i % N]);
+		total += l.count();
+	}	
+
+	auto secs = timer.get_overall_seconds();
+	std::cout << "count checksum: " << total << std::endl;
+	return secs;
+}
+
 double test_boost_dynamic_bitset_test(int round){
 	auto viewL = BitsetView(DatasetR.data(), N_BITS);
  	auto x = view_to_string(viewL);
@@ -405,6 +502,9 @@ MapType BoostFuncMap = {
 	{ "&=", test_boost_dynamic_bitset_and_assign},
 	{ "flip", test_boost_dynamic_bitset_flip},
 	{ "test", test_boost_dynamic_bitset_test},
+	{ "count", test_boost_dynamic_bitset_count},
+	{ "^=", test_boost_dynamic_bitset_xor_assign},
+	{ "-=", test_boost_dynamic_bitset_andnot_assign},
 };
 
 MapType ConcurrentFuncMap = {
@@ -416,6 +516,9 @@ MapType ConcurrentFuncMap = {
 	{ "&=", test_concurrent_bitset_and_assign},
 	{ "flip",test_concurrent_bitset_flip},
 	{ "test", test_concurrent_bitset_test},
+	{ "count", test_concurrent_bitset_count},
+	{ "^=", test_concurrent_bitset_xor_assign},
+	{ "-=", test_concurrent_bitset_andnot_assign},
 };
 
 void boost_test(std::string func_name, int round){
@@ -455,6 +558,749 @@ double test_boost_resize(bool value, int round){
 	return timer.get_overall_seconds();
 }
 
+// candidates of a search result, filtered against a bitset with the given
+// fraction of bits set
+struct FilterCase {
+	std::vector<uint8_t> blocks;
+	std::vector<int64_t> ids;
+	std::vector<float> distances;
+};
+
+FilterCase make_filter_case(size_t n_candidates, double density) {
+	FilterCase c;
+	std::mt19937 gen(42);
+	std::bernoulli_distribution bit_dist(density);
+	std::uniform_int_distribution<int64_t> id_dist(0, N_BITS - 1);
+	c.blocks.assign(N, 0);
+	for (int i = 0; i < N_BITS; i++) {
+		if (bit_dist(gen)) {
+			c.blocks[i >> 3] |= uint8_t(1) << (i & 0x7);
+		}
+	}
+	for (size_t i = 0; i < n_candidates; i++) {
+		c.ids.push_back(id_dist(gen));
+		c.distances.push_back(float(i));
+	}
+	return c;
+}
+
+double test_filter_branchy(const FilterCase& c, int round) {
+	auto view = BitsetView(c.blocks.data(), N_BITS);
+	std::vector<int64_t> ids;
+	std::vector<float> distances;
+	size_t total = 0;
+	Timer timer;
+	for (int i = 0; i < round; i++) {
+		ids = c.ids;
+		distances = c.distances;
+		size_t out = 0;
+		for (size_t j = 0; j < ids.size(); j++) {
+			if (!view.test(ids[j])) {
+				ids[out] = ids[j];
+				distances[out] = distances[j];
+				out++;
+			}
+		}
+		total += out;
+	}
+	auto secs = timer.get_overall_seconds();
+	return total ? secs : 0;
+}
+
+double test_filter_kernel(const FilterCase& c, int round, bitsets::SimdLevel level) {
+	auto view = BitsetView(c.blocks.data(), N_BITS);
+	std::vector<int64_t> ids;
+	std::vector<float> distances;
+	size_t total = 0;
+	Timer timer;
+	for (int i = 0; i < round; i++) {
+		ids = c.ids;
+		distances = c.distances;
+		total += bitsets::filter_candidates(view, ids.data(), distances.data(), ids.size(), level);
+	}
+	auto secs = timer.get_overall_seconds();
+	return total ? secs : 0;
+}
+
+void filter_test(int round) {
+	auto best = bitsets::simd_level();
+	for (size_t n_candidates : {1000, 10000, 100000}) {
+		for (double density : {0.01, 0.5, 0.99}) {
+			auto c = make_filter_case(n_candidates, density);
+			int rounds = int(round * 1000 / n_candidates);
+			std::cout << "filter n=" << n_candidates << " density=" << density << ":\t"
+				<< "branchy " << test_filter_branchy(c, rounds) << " s, "
+				<< "scalar " << test_filter_kernel(c, rounds, bitsets::SimdLevel::NONE) << " s";
+			if (best >= bitsets::SimdLevel::AVX2) {
+				std::cout << ", avx2 " << test_filter_kernel(c, rounds, bitsets::SimdLevel::AVX2) << " s";
+			}
+			if (best >= bitsets::SimdLevel::AVX512) {
+				std::cout << ", avx512 " << test_filter_kernel(c, rounds, bitsets::SimdLevel::AVX512) << " s";
+			}
+			std::cout << std::endl;
+		}
+	}
+}
+
+// a predicate over a column of N_BITS values, evaluated row by row into a
+// bitset with set() and with the scan kernels
+template <typename T>
+std::vector<T> make_scan_column() {
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<int> dist(0, 99);
+	std::vector<T> column(N_BITS);
+	for (auto& v : column) {
+		v = T(dist(gen));
+	}
+	return column;
+}
+
+template <typename T>
+double test_scan_rowwise(const std::vector<T>& column, int round) {
+	auto bitset = bitsets::ConcurrentBitset2(N_BITS);
+	Timer timer;
+	for (int i = 0; i < round; i++) {
+		for (int j = 0; j < N_BITS; j++) {
+			if (column[j] < T(10)) {
+				bitset.set(j);
+			} else {
+				bitset.clear(j);
+			}
+		}
+	}
+	return timer.get_overall_seconds();
+}
+
+template <typename T>
+double test_scan_kernel(const std::vector<T>& column, int round, bitsets::SimdLevel level) {
+	auto bitset = bitsets::ConcurrentBitset2(N_BITS);
+	Timer timer;
+	for (int i = 0; i < round; i++) {
+		bitsets::scan_compare(column.data(), N_BITS, bitsets::CompareOp::LT, T(10), bitset.mutable_data(),
+			bitsets::ScanMerge::ASSIGN, level);
+	}
+	return timer.get_overall_seconds();
+}
+
+template <typename T>
+void scan_test(const char* name, int round) {
+	auto best = bitsets::simd_level();
+	auto column = make_scan_column<T>();
+	std::cout << "scan " << name << " < 10:\t"
+		<< "rowwise " << test_scan_rowwise(column, round) << " s, "
+		<< "scalar " << test_scan_kernel(column, round, bitsets::SimdLevel::NONE) << " s";
+	if (best >= bitsets::SimdLevel::AVX2) {
+		std::cout << ", avx2 " << test_scan_kernel(column, round, bitsets::SimdLevel::AVX2) << " s";
+	}
+	if (best >= bitsets::SimdLevel::AVX512) {
+		std::cout << ", avx512 " << test_scan_kernel(column, round, bitsets::SimdLevel::AVX512) << " s";
+	}
+	std::cout << std::endl;
+}
+
+// range predicates over a high-cardinality column, by column scan and by a
+// bit-sliced index over the same values
+void bsi_test(int round) {
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<int64_t> dist(0, (1 << 20) - 1);
+	std::vector<int64_t> column(N_BITS);
+	for (auto& v : column) {
+		v = dist(gen);
+	}
+	Timer build_timer;
+	auto index = bitsets::BitSlicedIndex();
+	index.append(column.data(), column.size());
+	auto build_secs = build_timer.get_overall_seconds();
+
+	auto bitset = bitsets::ConcurrentBitset2(N_BITS);
+	Timer scan_timer;
+	for (int i = 0; i < round; i++) {
+		bitsets::scan_between(column.data(), N_BITS, int64_t(i), int64_t(i + 100000), bitset.mutable_data());
+	}
+	auto scan_secs = scan_timer.get_overall_seconds();
+
+	Timer bsi_timer;
+	for (int i = 0; i < round; i++) {
+		index.between(i, i + 100000);
+	}
+	auto bsi_secs = bsi_timer.get_overall_seconds();
+
+	std::cout << "between 20-bit values:\t" << "scan " << scan_secs << " s, "
+		<< "bsi " << bsi_secs << " s (build " << build_secs << " s, "
+		<< index.memory_size() << " bytes vs column " << column.size() * sizeof(int64_t) << " bytes)" << std::endl;
+}
+
+// IN over a tag column with a deletion bitset: column scan, one OR pass per
+// value, and the bitmap index's fused pass
+void bitmap_index_test(int round) {
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<int64_t> dist(0, 11);
+	std::vector<int64_t> column(N_BITS);
+	for (auto& v : column) {
+		v = dist(gen);
+	}
+	auto index = bitsets::BitmapIndex();
+	index.append(column.data(), column.size());
+	auto deleted = bitsets::ConcurrentBitset2(N_BITS);
+	for (int i = 0; i < N_BITS; i += 10) {
+		deleted.set(i);
+	}
+	const int64_t in_list[] = {1, 3, 5, 7, 9, 11};
+	std::vector<bitsets::ConcurrentBitset2> bitmaps;
+	for (auto v : in_list) {
+		bitmaps.emplace_back(N_BITS);
+		bitsets::scan_compare(column.data(), N_BITS, bitsets::CompareOp::EQ, v, bitmaps.back().mutable_data());
+	}
+
+	auto dst = bitsets::ConcurrentBitset2(N_BITS);
+	Timer scan_timer;
+	for (int i = 0; i < round; i++) {
+		bitsets::scan_in(column.data(), N_BITS, in_list, 6, dst.mutable_data());
+		dst -= deleted;
+	}
+	auto scan_secs = scan_timer.get_overall_seconds();
+
+	Timer or_timer;
+	for (int i = 0; i < round; i++) {
+		dst = bitmaps[0];
+		for (size_t j = 1; j < bitmaps.size(); j++) {
+			dst |= bitmaps[j];
+		}
+		dst -= deleted;
+	}
+	auto or_secs = or_timer.get_overall_seconds();
+
+	Timer fused_timer;
+	for (int i = 0; i < round; i++) {
+		index.in(in_list, 6, BitsetView(deleted), dst);
+	}
+	auto fused_secs = fused_timer.get_overall_seconds();
+
+	std::cout << "in 6 of 12 values:\t" << "scan " << scan_secs << " s, "
+		<< "or per value " << or_secs << " s, " << "fused " << fused_secs << " s" << std::endl;
+}
+
+// OR of many deletion bitsets and AND of many partition masks, chained
+// two operands at a time and reduced tile by tile
+void reduce_test(int round) {
+	std::mt19937 gen(42);
+	std::vector<bitsets::ConcurrentBitset2> bitsets;
+	std::vector<BitsetView> views;
+	for (int k = 0; k < 200; k++) {
+		bitsets.emplace_back(N_BITS);
+		auto data = reinterpret_cast<uint32_t*>(bitsets.back().mutable_data());
+		for (int i = 0; i < N / 4; i++) {
+			// sparse for the unions, dense in the first 24 for the intersections
+			data[i] = k < 24 ? ~(gen() & gen() & gen()) : (gen() & gen() & gen() & gen() & gen());
+		}
+	}
+	for (auto& bitset : bitsets) {
+		views.emplace_back(bitset);
+	}
+
+	for (size_t n : {24, 200}) {
+		auto dst = bitsets::ConcurrentBitset2(N_BITS);
+		Timer or_chain_timer;
+		for (int i = 0; i < round; i++) {
+			dst = bitsets[0];
+			for (size_t k = 1; k < n; k++) {
+				dst |= bitsets[k];
+			}
+		}
+		auto or_chain_secs = or_chain_timer.get_overall_seconds();
+		Timer or_tiled_timer;
+		for (int i = 0; i < round; i++) {
+			bitsets::union_many(views.data(), n, dst.mutable_data(), N_BITS);
+		}
+		auto or_tiled_secs = or_tiled_timer.get_overall_seconds();
+		Timer or_parallel_timer;
+		for (int i = 0; i < round; i++) {
+			bitsets::union_many(views.data(), n, dst.mutable_data(), N_BITS, true);
+		}
+		auto or_parallel_secs = or_parallel_timer.get_overall_seconds();
+		std::cout << "union of " << n << ":\t" << "chained " << or_chain_secs << " s, " << "tiled "
+			<< or_tiled_secs << " s, " << "parallel " << or_parallel_secs << " s" << std::endl;
+	}
+
+	auto dst = bitsets::ConcurrentBitset2(N_BITS);
+	Timer and_chain_timer;
+	for (int i = 0; i < round; i++) {
+		dst = bitsets[0];
+		for (size_t k = 1; k < 24; k++) {
+			dst &= bitsets[k];
+		}
+	}
+	auto and_chain_secs = and_chain_timer.get_overall_seconds();
+	Timer and_tiled_timer;
+	for (int i = 0; i < round; i++) {
+		bitsets::intersect_many(views.data(), 24, dst.mutable_data(), N_BITS);
+	}
+	auto and_tiled_secs = and_tiled_timer.get_overall_seconds();
+	std::cout << "intersection of 24:\t" << "chained " << and_chain_secs << " s, " << "tiled " << and_tiled_secs
+		<< " s" << std::endl;
+}
+
+// "at least 3 of 8": per-bit counting against the carry-save threshold
+void threshold_test(int round) {
+	std::mt19937 gen(42);
+	std::vector<bitsets::ConcurrentBitset2> bitsets;
+	std::vector<BitsetView> views;
+	for (int k = 0; k < 8; k++) {
+		bitsets.emplace_back(N_BITS);
+		auto data = reinterpret_cast<uint32_t*>(bitsets.back().mutable_data());
+		for (int i = 0; i < N / 4; i++) {
+			data[i] = gen() & gen();
+		}
+	}
+	for (auto& bitset : bitsets) {
+		views.emplace_back(bitset);
+	}
+
+	auto dst = bitsets::ConcurrentBitset2(N_BITS);
+	Timer count_timer;
+	for (int r = 0; r < round; r++) {
+		for (int i = 0; i < N_BITS; i++) {
+			int hits = 0;
+			for (auto& bitset : bitsets) {
+				hits += bitset.test(i);
+			}
+			if (hits >= 3) {
+				dst.set(i);
+			} else {
+				dst.clear(i);
+			}
+		}
+	}
+	auto count_secs = count_timer.get_overall_seconds();
+
+	Timer csa_timer;
+	for (int r = 0; r < round; r++) {
+		bitsets::threshold(views.data(), views.size(), 3, dst.mutable_data(), N_BITS);
+	}
+	auto csa_secs = csa_timer.get_overall_seconds();
+	std::cout << "3 of 8:\t" << "per-bit count " << count_secs << " s, " << "carry-save " << csa_secs << " s"
+		<< std::endl;
+}
+
+// posting list & filter: expanding the list into a bitset first, against
+// probing the filter per id
+void sorted_ids_test(int round) {
+	std::mt19937 gen(42);
+	auto filter = bitsets::ConcurrentBitset2(N_BITS);
+	auto data = reinterpret_cast<uint32_t*>(filter.mutable_data());
+	for (int i = 0; i < N / 4; i++) {
+		data[i] = gen();
+	}
+	auto view = BitsetView(filter);
+
+	for (size_t n : {1000, 100000}) {
+		std::vector<int64_t> ids;
+		std::bernoulli_distribution dist(double(n) / N_BITS);
+		for (int i = 0; i < N_BITS; i++) {
+			if (dist(gen)) {
+				ids.push_back(i);
+			}
+		}
+
+		size_t total = 0;
+		Timer expand_timer;
+		for (int r = 0; r < round; r++) {
+			auto list = bitsets::ConcurrentBitset2(N_BITS);
+			for (auto id : ids) {
+				list.set(id);
+			}
+			list &= filter;
+			total += list.count();
+		}
+		auto expand_secs = expand_timer.get_overall_seconds();
+
+		bitsets::IdSet out;
+		Timer probe_timer;
+		for (int r = 0; r < round; r++) {
+			total += bitsets::intersect_sorted(view, ids.data(), ids.size(), out);
+		}
+		auto probe_secs = probe_timer.get_overall_seconds();
+		std::cout << "intersect " << ids.size() << " ids:\t" << "expand " << expand_secs << " s, "
+			<< "probe " << probe_secs << " s" << (out.dense() ? " (bitset out)" : " (ids out)")
+			<< (total ? "" : " ") << std::endl;
+	}
+}
+
+// segment compaction: a bit-by-bit walk of the deletion bitset, against
+// the word-level remap kernel
+void compaction_test(int round) {
+	std::mt19937 gen(42);
+	std::bernoulli_distribution dist(0.1);
+	auto deleted = bitsets::ConcurrentBitset2(N_BITS);
+	auto filter = bitsets::ConcurrentBitset2(N_BITS);
+	for (int i = 0; i < N_BITS; i++) {
+		if (dist(gen)) {
+			deleted.set(i);
+		}
+		if (!dist(gen)) {
+			filter.set(i);
+		}
+	}
+
+	size_t total = 0;
+	Timer naive_timer;
+	for (int r = 0; r < round; r++) {
+		std::vector<int64_t> remap(N_BITS), survivors;
+		for (int i = 0; i < N_BITS; i++) {
+			if (deleted.test(i)) {
+				remap[i] = -1;
+			} else {
+				remap[i] = survivors.size();
+				survivors.push_back(i);
+			}
+		}
+		total += survivors.size();
+	}
+	auto naive_secs = naive_timer.get_overall_seconds();
+
+	bitsets::CompactionRemap out;
+	Timer kernel_timer;
+	for (int r = 0; r < round; r++) {
+		total += bitsets::compaction_remap(BitsetView(deleted), out);
+	}
+	auto kernel_secs = kernel_timer.get_overall_seconds();
+
+	Timer filter_timer;
+	for (int r = 0; r < round; r++) {
+		total += bitsets::compaction_remap(BitsetView(deleted), out, BitsetView(filter));
+	}
+	auto filter_secs = filter_timer.get_overall_seconds();
+	std::cout << "remap:\t" << "bit walk " << naive_secs << " s, " << "kernel " << kernel_secs << " s, "
+		<< "kernel + filter " << filter_secs << " s" << (total ? "" : " ") << std::endl;
+}
+
+// shifts and slices: a per-bit loop against the funnel-shift kernels
+void shift_test(int round) {
+	std::mt19937 gen(42);
+	auto bitset = bitsets::ConcurrentBitset2(N_BITS);
+	auto data = reinterpret_cast<uint32_t*>(bitset.mutable_data());
+	for (int i = 0; i < N / 4; i++) {
+		data[i] = gen();
+	}
+	auto dst = bitsets::ConcurrentBitset2(N_BITS);
+
+	size_t n = 4099;  // not word aligned
+	Timer loop_timer;
+	for (int r = 0; r < round; r++) {
+		for (size_t i = 0; i + n < N_BITS; i++) {
+			if (bitset.test(i + n)) {
+				dst.set(i);
+			} else {
+				dst.clear(i);
+			}
+		}
+	}
+	auto loop_secs = loop_timer.get_overall_seconds();
+
+	Timer extract_timer;
+	for (int r = 0; r < round; r++) {
+		bitset.extract_into(n, dst);
+	}
+	auto extract_secs = extract_timer.get_overall_seconds();
+
+	Timer shift_timer;
+	for (int r = 0; r < round; r++) {
+		bitset <<= 13;
+		bitset >>= 13;
+	}
+	auto shift_secs = shift_timer.get_overall_seconds();
+	std::cout << "shift:\t" << "bit loop " << loop_secs << " s, " << "extract " << extract_secs << " s, "
+		<< "<<= & >>= " << shift_secs << " s" << std::endl;
+}
+
+// large bitsets built from one thread vs first-touched in parallel, then
+// reduced in parallel
+void numa_test(int round) {
+	constexpr size_t n_bits = size_t(64) * 1024 * 1024;
+	constexpr size_t n = 16;
+	std::cout << "nodes:\t" << bitsets::numa_node_count() << std::endl;
+
+	Timer default_timer;
+	for (int r = 0; r < round; r++) {
+		std::vector<bitsets::ConcurrentBitset> bitsets;
+		for (size_t k = 0; k < n; k++) {
+			bitsets.emplace_back(n_bits);
+		}
+	}
+	auto default_secs = default_timer.get_overall_seconds();
+
+	double numa_secs[2];
+	std::vector<bitsets::NumaConcurrentBitset> numa_bitsets;
+	for (auto placement : {bitsets::NumaPlacement::FIRST_TOUCH, bitsets::NumaPlacement::INTERLEAVE}) {
+		Timer numa_timer;
+		for (int r = 0; r < round; r++) {
+			numa_bitsets.clear();
+			for (size_t k = 0; k < n; k++) {
+				numa_bitsets.emplace_back(n_bits, bitsets::NumaAllocator<uint8_t>(placement));
+			}
+		}
+		numa_secs[placement == bitsets::NumaPlacement::INTERLEAVE] = numa_timer.get_overall_seconds();
+	}
+	std::cout << "construct " << n << " x 8MB:\t" << "default " << default_secs << " s, " << "first-touch " << numa_secs[0]
+		<< " s, " << "interleave " << numa_secs[1] << " s" << std::endl;
+
+	std::vector<BitsetView> views;
+	for (auto& bitset : numa_bitsets) {
+		views.emplace_back(bitset);
+	}
+	auto dst = bitsets::NumaConcurrentBitset(n_bits, bitsets::NumaAllocator<uint8_t>());
+	Timer union_timer;
+	for (int r = 0; r < round; r++) {
+		bitsets::union_many(views.data(), n, dst.mutable_data(), n_bits, true);
+	}
+	std::cout << "parallel union of " << n << ":\t" << union_timer.get_overall_seconds() << " s" << std::endl;
+}
+
+// a 256 MB bitset on regular vs huge pages: sequential count() and random
+// test(), where TLB misses show most
+void huge_pages_test(int round) {
+	constexpr size_t n_bits = size_t(2) * 1024 * 1024 * 1024;
+	std::mt19937_64 gen(42);
+	std::vector<size_t> probes(1 << 22);
+	for (auto& probe : probes) {
+		probe = gen() % n_bits;
+	}
+
+	for (auto huge_pages : {bitsets::HugePages::NONE, bitsets::HugePages::TRANSPARENT,
+							bitsets::HugePages::EXPLICIT}) {
+		auto bitset = ConcurrentBitset(n_bits, bitsets::AlignedAllocator<uint8_t>(huge_pages), 0x5a);
+		size_t sink = 0;
+		Timer count_timer;
+		for (int r = 0; r < round; r++) {
+			sink += bitset.count();
+		}
+		auto count_secs = count_timer.get_overall_seconds();
+		Timer test_timer;
+		for (int r = 0; r < round; r++) {
+			for (auto probe : probes) {
+				sink += bitset.test(probe);
+			}
+		}
+		auto test_secs = test_timer.get_overall_seconds();
+		const char* name = huge_pages == bitsets::HugePages::NONE
+							   ? "default"
+							   : huge_pages == bitsets::HugePages::TRANSPARENT ? "THP" : "hugetlb";
+		std::cout << name << ":\t" << "count " << count_secs << " s, " << "random test " << test_secs << " s"
+			<< (sink ? "" : " ") << std::endl;
+	}
+}
+
+// out-of-place a & ~b with regular vs streaming stores, from in-cache to
+// far past the LLC; the same number of bytes is processed at every size
+void stream_test(int round) {
+	auto threshold = faiss::kernels::stream_threshold();
+	std::cout << "threshold:\t" << threshold << " bytes" << std::endl;
+	for (size_t mb : {1, 4, 16, 64, 256}) {
+		size_t n_bits = mb * 8 * 1024 * 1024;
+		auto a = ConcurrentBitset(n_bits, uint8_t(0x5a));
+		auto b = ConcurrentBitset(n_bits, uint8_t(0x33));
+		auto dst = ConcurrentBitset(n_bits);
+		int n = std::max(1, int(round / mb));
+		double secs[2];
+		for (int streamed = 0; streamed < 2; streamed++) {
+			faiss::kernels::set_stream_threshold(streamed ? 0 : SIZE_MAX);
+			a.andnot_into(BitsetView(b), dst);
+			Timer timer;
+			for (int r = 0; r < n; r++) {
+				a.andnot_into(BitsetView(b), dst);
+			}
+			secs[streamed] = timer.get_overall_seconds();
+		}
+		std::cout << mb << " MB:\t" << "regular " << secs[0] << " s, " << "streaming " << secs[1] << " s"
+			<< std::endl;
+	}
+	faiss::kernels::set_stream_threshold(threshold);
+}
+
+// n threads deleting interleaved rows, so they all write the same few
+// cache lines: direct atomic set() vs a write combiner per bitset
+template <typename Func>
+double run_threads(size_t n_threads, Func func) {
+	std::vector<std::thread> threads;
+	Timer timer;
+	for (size_t t = 0; t < n_threads; t++) {
+		threads.emplace_back(func, t);
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	return timer.get_overall_seconds();
+}
+
+void write_combiner_test(int round) {
+	constexpr size_t n_bits = 1 << 24;
+	size_t n_sets = n_bits * size_t(round);
+	for (size_t n_threads : {1, 2, 4, 8, 16}) {
+		auto direct = ConcurrentBitset(n_bits);
+		auto direct_secs = run_threads(n_threads, [&](size_t t) {
+			for (size_t r = 0; r < size_t(round); r++) {
+				for (size_t i = t; i < n_bits; i += n_threads) {
+					direct.set(i);
+				}
+			}
+		});
+
+		auto bitset = bitsets::ConcurrentBitset64(n_bits);
+		double combined_secs;
+		{
+			bitsets::WriteCombiner<bitsets::ConcurrentBitset64> combiner(bitset);
+			combined_secs = run_threads(n_threads, [&](size_t t) {
+				for (size_t r = 0; r < size_t(round); r++) {
+					for (size_t i = t; i < n_bits; i += n_threads) {
+						combiner.set(i);
+					}
+				}
+				combiner.flush();
+			});
+		}
+		std::cout << n_threads << " threads:\t" << "atomic set " << n_sets / direct_secs / 1e6 << " M/s, "
+			<< "combined " << n_sets / combined_secs / 1e6 << " M/s" << std::endl;
+	}
+}
+
+// "NOT IN" filter: negate b around an AND vs AND with a complemented view
+void complement_test(int round) {
+	auto a = ConcurrentBitset(N_BITS, uint8_t(0x5a));
+	auto b = ConcurrentBitset(N_BITS, uint8_t(0x33));
+	size_t sink = 0;
+	Timer negate_timer;
+	for (int r = 0; r < round; r++) {
+		b.negate();
+		sink += (a & b)->byte_size();
+		b.negate();
+	}
+	auto negate_secs = negate_timer.get_overall_seconds();
+	Timer view_timer;
+	for (int r = 0; r < round; r++) {
+		sink += (a & ~BitsetView(b))->byte_size();
+	}
+	auto view_secs = view_timer.get_overall_seconds();
+	std::cout << "a & ~b:\t" << "negate + and " << negate_secs << " s, " << "complemented view " << view_secs
+		<< " s" << (sink ? "" : " ") << std::endl;
+}
+
+void relation_test(int round) {
+	// a common bit near the front, and none at all
+	auto a = ConcurrentBitset(N_BITS, uint8_t(0x5a));
+	auto early = ConcurrentBitset(N_BITS);
+	early.set(100);
+	auto none = ConcurrentBitset(N_BITS, uint8_t(0xa5));
+	for (auto* b : {&early, &none}) {
+		size_t sink = 0;
+		Timer and_timer;
+		for (int r = 0; r < round; r++) {
+			sink += (a & *b)->count() != 0;
+		}
+		auto and_secs = and_timer.get_overall_seconds();
+		Timer intersects_timer;
+		for (int r = 0; r < round; r++) {
+			sink += a.intersects(*b);
+		}
+		auto intersects_secs = intersects_timer.get_overall_seconds();
+		std::cout << (b == &early ? "early hit:\t" : "no hit:\t") << "(a & b)->count() " << and_secs << " s, "
+			<< "intersects " << intersects_secs << " s" << (sink ? "" : " ") << std::endl;
+	}
+}
+
+void estimate_test(int round) {
+	// 128 MB, well past the caches
+	constexpr size_t bits = size_t(1) << 30;
+	auto a = ConcurrentBitset(bits, uint8_t(0x5a));
+	auto b = ConcurrentBitset(bits, uint8_t(0x33));
+	size_t sink = 0;
+	Timer count_timer;
+	for (int r = 0; r < round; r++) {
+		sink += a.count();
+	}
+	auto count_secs = count_timer.get_overall_seconds();
+	Timer estimate_timer;
+	for (int r = 0; r < round; r++) {
+		sink += a.estimate_count().count;
+	}
+	auto estimate_secs = estimate_timer.get_overall_seconds();
+	Timer and_timer;
+	for (int r = 0; r < round; r++) {
+		sink += bitsets::estimate_count_and(a, b).count;
+	}
+	auto and_secs = and_timer.get_overall_seconds();
+	auto estimate = a.estimate_count();
+	std::cout << "count " << count_secs << " s, estimate_count " << estimate_secs << " s, estimate_count_and "
+		<< and_secs << " s; " << a.count() << " in [" << estimate.lower << ", " << estimate.upper << "]"
+		<< (sink ? "" : " ") << std::endl;
+}
+
+void delta_test(int round) {
+	constexpr size_t bits = size_t(1) << 26;
+	auto old_bits = ConcurrentBitset(bits, uint8_t(0x5a));
+	std::mt19937_64 gen(46);
+	for (double rate : {0.00001, 0.0001, 0.001, 0.01, 0.1}) {
+		auto new_bits = ConcurrentBitset(bits, old_bits.data());
+		for (size_t n = 0; n < size_t(rate * bits); n++) {
+			auto i = gen() % bits;
+			new_bits.test(i) ? new_bits.clear(i) : new_bits.set(i);
+		}
+		bitsets::BitsetDelta delta;
+		Timer diff_timer;
+		for (int r = 0; r < round; r++) {
+			delta = bitsets::diff(BitsetView(old_bits), BitsetView(new_bits));
+		}
+		auto diff_secs = diff_timer.get_overall_seconds();
+		auto replica = ConcurrentBitset(bits, old_bits.data());
+		Timer apply_timer;
+		for (int r = 0; r < round; r++) {
+			// applied twice, so that every round starts from the old bits
+			replica.apply_delta(delta);
+			replica.apply_delta(delta);
+		}
+		auto apply_secs = apply_timer.get_overall_seconds() / 2;
+		std::cout << "change rate " << rate << ":\t" << delta.byte_size() << " of " << old_bits.byte_size()
+			<< " bytes, diff " << diff_secs << " s, apply " << apply_secs << " s" << std::endl;
+	}
+}
+
+void hash_test(int round) {
+	constexpr size_t bits = size_t(1) << 26;
+	auto a = ConcurrentBitset(bits, uint8_t(0x5a));
+	size_t sink = 0;
+	Timer byte_timer;
+	for (int r = 0; r < round; r++) {
+		sink += std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(a.data()), a.byte_size()));
+	}
+	auto byte_secs = byte_timer.get_overall_seconds();
+	Timer hash_timer;
+	for (int r = 0; r < round; r++) {
+		sink += a.hash64();
+	}
+	auto hash_secs = hash_timer.get_overall_seconds();
+	Timer fingerprint_timer;
+	for (int r = 0; r < round; r++) {
+		sink += a.fingerprint();
+	}
+	auto fingerprint_secs = fingerprint_timer.get_overall_seconds();
+	std::cout << "8 MB:\t" << "std::hash " << byte_secs << " s, hash64 " << hash_secs << " s, fingerprint "
+		<< fingerprint_secs << " s" << std::endl;
+
+	// set / clear with the fingerprint kept up to date
+	auto tracked = ConcurrentBitset(bits);
+	tracked.enable_fingerprint();
+	Timer set_timer;
+	for (int r = 0; r < round; r++) {
+		for (size_t i = r; i < bits; i += 997) {
+			tracked.set(i);
+			tracked.clear(i + 1);
+		}
+	}
+	auto set_secs = set_timer.get_overall_seconds();
+	auto consistent = tracked.fingerprint() == BitsetView(tracked).fingerprint();
+	std::cout << "tracked:\t" << "set/clear " << set_secs << " s, fingerprint " << (consistent ? "consistent" : "stale")
+		<< (sink ? "" : " ") << std::endl;
+}
+
 int main() {
   int round = 10000;
   gen_random_data();
@@ -470,6 +1316,9 @@ int main() {
 	"&=",
 	"&",
 	"test",
+	"count",
+	"^=",
+	"-=",
   };
 
   std::cout<<"Boost dynamic bitset:"<<std::endl;
@@ -482,5 +1331,64 @@ int main() {
   	concurrent_test(func_name, round);
   }
 
+  std::cout<<"Candidate filter    :"<<std::endl;
+  filter_test(round);
+
+  std::cout<<"Predicate scan      :"<<std::endl;
+  scan_test<int8_t>("int8", round / 100);
+  scan_test<int16_t>("int16", round / 100);
+  scan_test<int32_t>("int32", round / 100);
+  scan_test<int64_t>("int64", round / 100);
+  scan_test<float>("float", round / 100);
+  scan_test<double>("double", round / 100);
+
+  std::cout<<"Bit-sliced index    :"<<std::endl;
+  bsi_test(round / 100);
+
+  std::cout<<"Bitmap index        :"<<std::endl;
+  bitmap_index_test(round / 100);
+
+  std::cout<<"N-ary reduction     :"<<std::endl;
+  reduce_test(round / 100);
+
+  std::cout<<"Threshold           :"<<std::endl;
+  threshold_test(round / 1000);
+
+  std::cout<<"Sorted id lists     :"<<std::endl;
+  sorted_ids_test(round / 10);
+
+  std::cout<<"Segment compaction  :"<<std::endl;
+  compaction_test(round / 100);
+
+  std::cout<<"Shift and extract   :"<<std::endl;
+  shift_test(round / 100);
+
+  std::cout<<"NUMA placement      :"<<std::endl;
+  numa_test(round / 1000);
+
+  std::cout<<"Huge pages          :"<<std::endl;
+  huge_pages_test(round / 1000);
+
+  std::cout<<"Streaming stores    :"<<std::endl;
+  stream_test(round / 10);
+
+  std::cout<<"Write combining     :"<<std::endl;
+  write_combiner_test(round / 5000);
+
+  std::cout<<"Complemented views  :"<<std::endl;
+  complement_test(round);
+
+  std::cout<<"Relations           :"<<std::endl;
+  relation_test(round);
+
+  std::cout<<"Count estimation    :"<<std::endl;
+  estimate_test(round / 1000);
+
+  std::cout<<"Delta encoding      :"<<std::endl;
+  delta_test(round / 1000);
+
+  std::cout<<"Hashing             :"<<std::endl;
+  hash_test(round / 100);
+
   return 0;
 }
@@ -0,0 +1,96 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#include <sys/mman.h>
+
+#include <cstring>
+#include <new>
+
+#include "AlignedAllocator.h"
+
+namespace faiss {
+
+namespace {
+
+inline size_t
+round_up(size_t n, size_t unit) {
+    return (n + unit - 1) / unit * unit;
+}
+
+// anonymous mapping of len bytes (a multiple of HUGE_PAGE_BYTES) starting
+// on a 2 MB boundary, so that the kernel can back all of it with huge pages
+void*
+map_huge_aligned(size_t len) {
+    size_t over = len + HUGE_PAGE_BYTES;
+    void* raw = mmap(nullptr, over, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    auto begin = reinterpret_cast<uintptr_t>(raw);
+    auto aligned = round_up(begin, HUGE_PAGE_BYTES);
+    if (aligned > begin) {
+        munmap(raw, aligned - begin);
+    }
+    if (aligned + len < begin + over) {
+        munmap(reinterpret_cast<void*>(aligned + len), begin + over - aligned - len);
+    }
+    return reinterpret_cast<void*>(aligned);
+}
+
+}  // namespace
+
+void*
+storage_alloc(size_t bytes, HugePages huge_pages) {
+    if (bytes == 0) {
+        return nullptr;
+    }
+    if (bytes < HUGE_PAGE_BYTES) {
+        size_t padded = round_up(bytes, STORAGE_ALIGNMENT);
+        void* data = ::operator new(padded, std::align_val_t(STORAGE_ALIGNMENT));
+        memset(data, 0, padded);
+        return data;
+    }
+
+    // mappings come zeroed
+    size_t len = round_up(bytes, HUGE_PAGE_BYTES);
+#if defined(MAP_HUGETLB)
+    if (huge_pages == HugePages::EXPLICIT) {
+        void* data = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data != MAP_FAILED) {
+            return data;
+        }
+    }
+#endif
+    void* data = map_huge_aligned(len);
+#if defined(MADV_HUGEPAGE)
+    // NONE leaves the mapping to the system's THP policy
+    if (huge_pages != HugePages::NONE) {
+        madvise(data, len, MADV_HUGEPAGE);
+    }
+#else
+    (void)huge_pages;
+#endif
+    return data;
+}
+
+void
+storage_free(void* data, size_t bytes) {
+    if (!data) {
+        return;
+    }
+    if (bytes < HUGE_PAGE_BYTES) {
+        ::operator delete(data, std::align_val_t(STORAGE_ALIGNMENT));
+    } else {
+        munmap(data, round_up(bytes, HUGE_PAGE_BYTES));
+    }
+}
+
+}  // namespace faiss
@@ -0,0 +1,110 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace faiss {
+
+// Bitset storage starts on a cache line and is padded with zero bytes to a
+// whole number of cache lines, so 64-bit (and vector) accesses never split
+// a line and a word-wide kernel may read past byte_size() up to the padding.
+constexpr size_t STORAGE_ALIGNMENT = 64;
+
+// Buffers of at least this size are mapped directly, 2 MB aligned, and may
+// be backed by huge pages.
+constexpr size_t HUGE_PAGE_BYTES = size_t(2) << 20;
+
+enum class HugePages {
+    NONE,         // no advice, the system default (THP if enabled = always)
+    TRANSPARENT,  // madvise(MADV_HUGEPAGE), left to the kernel's THP
+    EXPLICIT,     // MAP_HUGETLB from the reserved pool, TRANSPARENT if empty
+};
+
+// Allocate bytes of zeroed, 64-byte aligned storage, padded to a multiple
+// of STORAGE_ALIGNMENT. Large buffers come as fresh zero pages, so they
+// are not written here. huge_pages only applies from HUGE_PAGE_BYTES on;
+// throws std::bad_alloc.
+void*
+storage_alloc(size_t bytes, HugePages huge_pages = HugePages::NONE);
+
+// bytes as passed to storage_alloc; how the buffer was obtained only
+// depends on its size, so any HugePages setting frees it
+void
+storage_free(void* data, size_t bytes);
+
+// Default allocator of BasicBitset. The storage comes zeroed, so elements
+// are default-initialized: a large bitset is not written before its first
+// real use, which may be a streaming store. All instances are
+// interchangeable; the huge-page choice only affects the allocations an
+// instance makes itself.
+template <typename T>
+class AlignedAllocator {
+ public:
+    using value_type = T;
+
+    AlignedAllocator() = default;
+
+    explicit AlignedAllocator(HugePages huge_pages) : huge_pages_(huge_pages) {
+    }
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>& other) : huge_pages_(other.huge_pages()) {
+    }
+
+    T*
+    allocate(size_t n) {
+        return static_cast<T*>(storage_alloc(n * sizeof(T), huge_pages_));
+    }
+
+    void
+    deallocate(T* p, size_t n) {
+        storage_free(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    void
+    construct(U* p) {
+        ::new (static_cast<void*>(p)) U;
+    }
+
+    template <typename U, typename... Args>
+    void
+    construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+
+    inline HugePages
+    huge_pages() const {
+        return huge_pages_;
+    }
+
+ private:
+    HugePages huge_pages_ = HugePages::NONE;
+};
+
+template <typename T, typename U>
+bool
+operator==(const AlignedAllocator<T>&, const AlignedAllocator<U>&) {
+    return true;
+}
+
+template <typename T, typename U>
+bool
+operator!=(const AlignedAllocator<T>&, const AlignedAllocator<U>&) {
+    return false;
+}
+
+}  // namespace faiss
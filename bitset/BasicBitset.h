@@ -0,0 +1,998 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "BitsetDelta.h"
+#include "BitsetKernels.h"
+#include "BitsetView.h"
+#include "HashKernels.h"
+#include "Numa.h"
+#include "ShiftKernels.h"
+#include "StreamKernels.h"
+
+namespace faiss {
+
+// Words are std::atomic, so set/clear from concurrent writers never lose
+// updates. Used for shared state such as deletion masks.
+struct AtomicPolicy {
+    static constexpr bool concurrent = true;
+
+    template <typename WordT>
+    using storage_type = std::atomic<WordT>;
+
+    template <typename WordT>
+    static inline WordT
+    load(const std::atomic<WordT>& word) {
+        return word.load();
+    }
+
+    // return the value held before the update
+    template <typename WordT>
+    static inline WordT
+    fetch_or(std::atomic<WordT>& word, WordT mask) {
+        return word.fetch_or(mask);
+    }
+
+    template <typename WordT>
+    static inline WordT
+    fetch_and(std::atomic<WordT>& word, WordT mask) {
+        return word.fetch_and(mask);
+    }
+
+    template <typename WordT>
+    static inline WordT
+    fetch_add(std::atomic<WordT>& word, WordT delta) {
+        return word.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    template <typename WordT>
+    static inline WordT
+    fetch_xor(std::atomic<WordT>& word, WordT delta) {
+        return word.fetch_xor(delta, std::memory_order_relaxed);
+    }
+};
+
+// Plain words, no locked instructions. Used for single-threaded scratch.
+struct NonAtomicPolicy {
+    static constexpr bool concurrent = false;
+
+    template <typename WordT>
+    using storage_type = WordT;
+
+    template <typename WordT>
+    static inline WordT
+    load(const WordT& word) {
+        return word;
+    }
+
+    template <typename WordT>
+    static inline WordT
+    fetch_or(WordT& word, WordT mask) {
+        WordT old = word;
+        word = old | mask;
+        return old;
+    }
+
+    template <typename WordT>
+    static inline WordT
+    fetch_and(WordT& word, WordT mask) {
+        WordT old = word;
+        word = old & mask;
+        return old;
+    }
+
+    template <typename WordT>
+    static inline WordT
+    fetch_add(WordT& word, WordT delta) {
+        WordT old = word;
+        word = old + delta;
+        return old;
+    }
+
+    template <typename WordT>
+    static inline WordT
+    fetch_xor(WordT& word, WordT delta) {
+        WordT old = word;
+        word = old ^ delta;
+        return old;
+    }
+};
+
+// The shard of a sharded tracker the calling thread updates, fixed per
+// thread.
+template <size_t ShardCount>
+inline size_t
+tracker_shard() {
+    if constexpr (ShardCount == 1) {
+        return 0;
+    } else {
+        static std::atomic<size_t> next_shard{0};
+        thread_local size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % ShardCount;
+        return shard;
+    }
+}
+
+// Count of 1-bits maintained next to a bitset. Disabled (and free) until
+// reset() is called. Under a concurrent policy the counter is split into
+// cache-line sized shards picked per thread, so writers on different
+// threads do not bounce one line; load() sums the shards.
+template <typename ConcurrencyPolicy>
+class CardinalityCounter {
+ public:
+    CardinalityCounter() = default;
+
+    CardinalityCounter(const CardinalityCounter& other) {
+        *this = other;
+    }
+
+    CardinalityCounter&
+    operator=(const CardinalityCounter& other) {
+        if (other.enabled()) {
+            reset(other.load());
+        } else {
+            shards_.reset();
+        }
+        return *this;
+    }
+
+    CardinalityCounter(CardinalityCounter&&) = default;
+
+    CardinalityCounter&
+    operator=(CardinalityCounter&&) = default;
+
+    inline bool
+    enabled() const {
+        return shards_ != nullptr;
+    }
+
+    void
+    reset(size_t value) {
+        if (!shards_) {
+            shards_.reset(new Shard[shard_count]);
+        }
+        for (size_t i = 0; i < shard_count; i++) {
+            shards_[i].value = 0;
+        }
+        shards_[0].value = static_cast<int64_t>(value);
+    }
+
+    inline void
+    add(int64_t delta) {
+        ConcurrencyPolicy::fetch_add(shards_[shard_index()].value, delta);
+    }
+
+    size_t
+    load() const {
+        int64_t ret = 0;
+        for (size_t i = 0; i < shard_count; i++) {
+            ret += ConcurrencyPolicy::load(shards_[i].value);
+        }
+        return static_cast<size_t>(ret);
+    }
+
+ private:
+    static constexpr size_t shard_count = ConcurrencyPolicy::concurrent ? 16 : 1;
+
+    struct alignas(64) Shard {
+        typename ConcurrencyPolicy::template storage_type<int64_t> value{0};
+    };
+
+    static inline size_t
+    shard_index() {
+        return tracker_shard<shard_count>();
+    }
+
+ private:
+    std::unique_ptr<Shard[]> shards_;
+};
+
+// kernels::fingerprint_bits of a bitset maintained next to it, sharded
+// like CardinalityCounter; updates XOR into a shard and load() XORs the
+// shards together.
+template <typename ConcurrencyPolicy>
+class FingerprintTracker {
+ public:
+    FingerprintTracker() = default;
+
+    FingerprintTracker(const FingerprintTracker& other) {
+        *this = other;
+    }
+
+    FingerprintTracker&
+    operator=(const FingerprintTracker& other) {
+        if (other.enabled()) {
+            reset(other.load());
+        } else {
+            shards_.reset();
+        }
+        return *this;
+    }
+
+    FingerprintTracker(FingerprintTracker&&) = default;
+
+    FingerprintTracker&
+    operator=(FingerprintTracker&&) = default;
+
+    inline bool
+    enabled() const {
+        return shards_ != nullptr;
+    }
+
+    void
+    reset(uint64_t value) {
+        if (!shards_) {
+            shards_.reset(new Shard[shard_count]);
+        }
+        for (size_t i = 0; i < shard_count; i++) {
+            shards_[i].value = 0;
+        }
+        shards_[0].value = value;
+    }
+
+    inline void
+    toggle(uint64_t delta) {
+        ConcurrencyPolicy::fetch_xor(shards_[tracker_shard<shard_count>()].value, delta);
+    }
+
+    uint64_t
+    load() const {
+        uint64_t ret = 0;
+        for (size_t i = 0; i < shard_count; i++) {
+            ret ^= ConcurrencyPolicy::load(shards_[i].value);
+        }
+        return ret;
+    }
+
+ private:
+    static constexpr size_t shard_count = ConcurrencyPolicy::concurrent ? 16 : 1;
+
+    struct alignas(64) Shard {
+        typename ConcurrencyPolicy::template storage_type<uint64_t> value{0};
+    };
+
+ private:
+    std::unique_ptr<Shard[]> shards_;
+};
+
+// Bit i lives in bit (i % 8) of byte (i / 8) whatever WordT is (words are
+// little-endian), so data() can always be handed to a BitsetView.
+// Bulk operations work on the raw bytes and are not atomic, as before.
+// Out-of-place results from kernels::stream_threshold() bytes on are
+// written with non-temporal stores.
+// With the default AlignedAllocator, data() is 64-byte aligned and zero
+// padded to a whole cache line; pass AlignedAllocator<WordT>(HugePages::...)
+// to put a large bitset on huge pages.
+//
+// With enable_count_tracking() the bitset keeps its count of 1-bits up to
+// date: set/clear adjust it only when the bit actually flips, and bulk
+// operations recount as part of their own pass, so count() is O(1).
+// Writes made through mutable_data() are not seen; call
+// enable_count_tracking() again afterwards to resynchronize.
+// enable_fingerprint() does the same for fingerprint(): set/clear XOR in
+// the change of their bit, bulk operations take it from one more pass.
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator = AlignedAllocator<WordT>>
+class BasicBitset {
+    static_assert(std::is_unsigned<WordT>::value, "bitset word must be an unsigned integer");
+
+ public:
+    using id_type_t = int64_t;
+    using word_type = WordT;
+    using policy_type = ConcurrencyPolicy;
+    using storage_type = typename ConcurrencyPolicy::template storage_type<WordT>;
+    using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<storage_type>;
+
+    static_assert(sizeof(storage_type) == sizeof(WordT), "bitset storage must have the layout of its word");
+
+    static constexpr size_t word_bits = sizeof(WordT) * 8;
+
+    explicit BasicBitset(size_t size, uint8_t init_value = 0)
+    : size_(size), bitset_(word_count(size)) {
+        if (init_value) {
+            memset(mutable_data(), init_value, byte_size());
+        }
+    }
+
+    // With an allocator that leaves its memory untouched (NumaAllocator),
+    // the words are first written here, by first_touch's OpenMP threads,
+    // so that pages are placed by the threads that will work on them. Only
+    // byte_size() bytes take init_value; the rest of the last word is 0.
+    BasicBitset(size_t size, const Allocator& alloc, uint8_t init_value = 0)
+    : size_(size), bitset_(word_count(size), allocator_type(alloc)) {
+        if (size) {
+            first_touch(mutable_data(), byte_size(), init_value);
+            memset(mutable_data() + byte_size(), 0, bitset_.size() * sizeof(WordT) - byte_size());
+        }
+    }
+
+    explicit BasicBitset(size_t size, const uint8_t* data) : size_(size), bitset_(word_count(size)) {
+        if (size) {
+            memcpy(mutable_data(), data, byte_size());
+        }
+    }
+
+    BasicBitset&
+    operator&=(const BasicBitset& bitset);
+
+    BasicBitset&
+    operator&=(const BitsetView& view);
+
+    std::shared_ptr<BasicBitset>
+    operator&(const BasicBitset& bitset) const;
+
+    std::shared_ptr<BasicBitset>
+    operator&(const BitsetView& view) const;
+
+    BasicBitset&
+    operator|=(const BasicBitset& bitset);
+
+    BasicBitset&
+    operator|=(const BitsetView& view);
+
+    std::shared_ptr<BasicBitset>
+    operator|(const BasicBitset& bitset) const;
+
+    std::shared_ptr<BasicBitset>
+    operator|(const BitsetView& view) const;
+
+    BasicBitset&
+    operator^=(const BasicBitset& bitset);
+
+    BasicBitset&
+    operator^=(const BitsetView& view);
+
+    std::shared_ptr<BasicBitset>
+    operator^(const BasicBitset& bitset) const;
+
+    std::shared_ptr<BasicBitset>
+    operator^(const BitsetView& view) const;
+
+    // andnot: clear the bits that are set in the operand, in one pass
+    BasicBitset&
+    operator-=(const BasicBitset& bitset);
+
+    BasicBitset&
+    operator-=(const BitsetView& view);
+
+    std::shared_ptr<BasicBitset>
+    operator-(const BasicBitset& bitset) const;
+
+    std::shared_ptr<BasicBitset>
+    operator-(const BitsetView& view) const;
+
+    inline BasicBitset&
+    andnot(const BasicBitset& bitset) {
+        return *this -= bitset;
+    }
+
+    inline BasicBitset&
+    andnot(const BitsetView& view) {
+        return *this -= view;
+    }
+
+    // dst = *this & ~operand, without touching *this; dst must have the
+    // same size and may be *this
+    void
+    andnot_into(const BasicBitset& bitset, BasicBitset& dst) const;
+
+    void
+    andnot_into(const BitsetView& view, BasicBitset& dst) const;
+
+    BasicBitset&
+    negate();
+
+    // shift toward higher ids: bit i moves to i + n, bits moved past size()
+    // are dropped and the n lowest bits are cleared
+    BasicBitset&
+    operator<<=(size_t n);
+
+    // shift toward lower ids: bit i + n moves to i, the n highest bits are
+    // cleared
+    BasicBitset&
+    operator>>=(size_t n);
+
+    std::shared_ptr<BasicBitset>
+    operator<<(size_t n) const;
+
+    std::shared_ptr<BasicBitset>
+    operator>>(size_t n) const;
+
+    // bits [offset, offset + length) as a bitset of length bits; bits past
+    // size() read as 0
+    std::shared_ptr<BasicBitset>
+    extract(size_t offset, size_t length) const;
+
+    // dst = bits [offset, offset + dst.size()); dst may not be *this
+    void
+    extract_into(size_t offset, BasicBitset& dst) const;
+
+    inline bool
+    test(id_type_t id) const {
+        return ConcurrencyPolicy::load(bitset_[word_index(id)]) & bit_mask(id);
+    }
+
+    inline void
+    set(id_type_t id) {
+        auto mask = bit_mask(id);
+        auto old = ConcurrencyPolicy::fetch_or(bitset_[word_index(id)], mask);
+        if (cardinality_.enabled() && !(old & mask)) {
+            cardinality_.add(1);
+        }
+        if (fingerprint_.enabled() && !(old & mask)) {
+            fingerprint_.toggle(kernels::bit_fingerprint(size_t(id)));
+        }
+    }
+
+    // OR mask into word index with one update of that word, as when
+    // flushing a batch of set() calls that fall into it
+    inline void
+    set_mask(size_t index, WordT mask) {
+        auto old = ConcurrencyPolicy::fetch_or(bitset_[index], mask);
+        if (cardinality_.enabled()) {
+            cardinality_.add(__builtin_popcountll(uint64_t(mask & ~old)));
+        }
+        if (fingerprint_.enabled()) {
+            size_t first = index * word_bits;
+            fingerprint_.toggle(kernels::word_fingerprint(first >> 6, uint64_t(mask & ~old) << (first & 63)));
+        }
+    }
+
+    // todo rename to reset
+    inline void
+    clear(id_type_t id) {
+        auto mask = bit_mask(id);
+        auto old = ConcurrencyPolicy::fetch_and(bitset_[word_index(id)], static_cast<WordT>(~mask));
+        if (cardinality_.enabled() && (old & mask)) {
+            cardinality_.add(-1);
+        }
+        if (fingerprint_.enabled() && (old & mask)) {
+            fingerprint_.toggle(kernels::bit_fingerprint(size_t(id)));
+        }
+    }
+
+    // set relations without materializing anything, as on BitsetView
+    inline bool
+    intersects(const BasicBitset& bitset) const {
+        return BitsetView(*this).intersects(BitsetView(bitset));
+    }
+
+    inline bool
+    intersects(const BitsetView& view) const {
+        return BitsetView(*this).intersects(view);
+    }
+
+    inline bool
+    is_disjoint(const BasicBitset& bitset) const {
+        return BitsetView(*this).is_disjoint(BitsetView(bitset));
+    }
+
+    inline bool
+    is_disjoint(const BitsetView& view) const {
+        return BitsetView(*this).is_disjoint(view);
+    }
+
+    inline bool
+    is_subset_of(const BasicBitset& bitset) const {
+        return BitsetView(*this).is_subset_of(BitsetView(bitset));
+    }
+
+    inline bool
+    is_subset_of(const BitsetView& view) const {
+        return BitsetView(*this).is_subset_of(view);
+    }
+
+    inline BitsetRelation
+    compare(const BasicBitset& bitset) const {
+        return BitsetView(*this).compare(BitsetView(bitset));
+    }
+
+    inline BitsetRelation
+    compare(const BitsetView& view) const {
+        return BitsetView(*this).compare(view);
+    }
+
+    // BitsetView::estimate_count, or the exact count if it is tracked
+    CountEstimate
+    estimate_count(double error = 0.02, double confidence = 0.95) const {
+        if (tracks_count()) {
+            size_t n = count();
+            return CountEstimate{n, n, n, true};
+        }
+        return BitsetView(*this).estimate_count(error, confidence);
+    }
+
+    // XOR in the changes of a diff() from this bitset's version to a newer
+    // one, in place; a tracked count and fingerprint follow them. Return
+    // false, changing nothing, if the delta is of a bitset of another size.
+    bool
+    apply_delta(const BitsetDelta& delta) {
+        if (delta.size() != size_) {
+            return false;
+        }
+        uint64_t fingerprint_change = 0;
+        auto change = faiss::apply_delta(mutable_data(), delta, fingerprint_.enabled() ? &fingerprint_change : nullptr);
+        if (cardinality_.enabled()) {
+            cardinality_.add(change);
+        }
+        if (fingerprint_.enabled()) {
+            fingerprint_.toggle(fingerprint_change);
+        }
+        return true;
+    }
+
+    // start (or resynchronize) count tracking with one full scan
+    void
+    enable_count_tracking() {
+        cardinality_.reset(kernels::popcount(data(), size_));
+    }
+
+    inline bool
+    tracks_count() const {
+        return cardinality_.enabled();
+    }
+
+    // start (or resynchronize) fingerprint tracking with one full scan
+    void
+    enable_fingerprint() {
+        fingerprint_.reset(kernels::fingerprint_bits(data(), size_));
+    }
+
+    inline bool
+    tracks_fingerprint() const {
+        return fingerprint_.enabled();
+    }
+
+    // BitsetView::fingerprint, O(1) if tracked
+    uint64_t
+    fingerprint() const {
+        if (fingerprint_.enabled()) {
+            return fingerprint_.load();
+        }
+        return kernels::fingerprint_bits(data(), size_);
+    }
+
+    inline Hash128
+    hash128() const {
+        return kernels::hash_bits(data(), size_);
+    }
+
+    inline uint64_t
+    hash64() const {
+        return hash128().low;
+    }
+
+    inline bool
+    empty() const {
+        return size_ == 0;
+    }
+
+    size_t
+    count() const;
+
+    inline size_t
+    size() const {
+        return size_;
+    }
+
+    inline size_t
+    byte_size() const {
+        return ((size_ + 8 - 1) >> 3);
+    }
+
+    inline const uint8_t*
+    data() const {
+        return reinterpret_cast<const uint8_t*>(bitset_.data());
+    }
+
+    inline uint8_t*
+    mutable_data() {
+        return reinterpret_cast<uint8_t*>(bitset_.data());
+    }
+
+    // out-of-place results (operators, shifts, extract) are allocated with
+    // this, so they keep its NUMA placement and huge pages
+    inline Allocator
+    get_allocator() const {
+        return Allocator(bitset_.get_allocator());
+    }
+
+    operator std::string() const;
+
+ private:
+    static inline size_t
+    word_count(size_t size) {
+        return (size + word_bits - 1) / word_bits;
+    }
+
+    static inline size_t
+    word_index(id_type_t id) {
+        return static_cast<size_t>(id) / word_bits;
+    }
+
+    static inline WordT
+    bit_mask(id_type_t id) {
+        return static_cast<WordT>(WordT(1) << (static_cast<size_t>(id) % word_bits));
+    }
+
+    // 1-bits in the last byte that lie past size()
+    inline size_t
+    tail_count() const {
+        size_t remain = size_ & 0x7;
+        return remain ? __builtin_popcount(data()[byte_size() - 1] >> remain) : 0;
+    }
+
+    // dst = op(*this, rhs); if either this bitset or dst tracks its count,
+    // dst does afterwards, with the count taken from the same pass
+    template <typename Op>
+    void
+    binary_into(BasicBitset& dst, const uint8_t* rhs) const {
+        if (cardinality_.enabled() || dst.cardinality_.enabled()) {
+            auto n = kernels::binary_op_into<Op, true>(dst.mutable_data(), data(), rhs, byte_size());
+            dst.cardinality_.reset(n - dst.tail_count());
+        } else {
+            kernels::binary_op_into<Op>(dst.mutable_data(), data(), rhs, byte_size());
+        }
+        refingerprint_into(dst);
+    }
+
+    // an out-of-place result of size bits, placed and first touched like
+    // this bitset (see get_allocator)
+    std::shared_ptr<BasicBitset>
+    make_result(size_t size) const {
+        return std::make_shared<BasicBitset>(size, get_allocator());
+    }
+
+    // after a bulk write to dst that did not count: if either this bitset or
+    // dst tracks its count, dst does afterwards
+    void
+    recount_into(BasicBitset& dst) const {
+        if (cardinality_.enabled() || dst.cardinality_.enabled()) {
+            dst.cardinality_.reset(kernels::popcount(dst.data(), dst.size_));
+        }
+        refingerprint_into(dst);
+    }
+
+    // the same for the fingerprint, which bulk writes never keep on the way
+    void
+    refingerprint_into(BasicBitset& dst) const {
+        if (fingerprint_.enabled() || dst.fingerprint_.enabled()) {
+            dst.fingerprint_.reset(kernels::fingerprint_bits(dst.data(), dst.size_));
+        }
+    }
+
+    // same with a view operand, which may start inside a byte or be
+    // complemented; a complemented operand runs as the operator with its
+    // negation folded in, and leaves dst's tail bits clear
+    template <typename Op>
+    void
+    binary_into(BasicBitset& dst, const BitsetView& view) const {
+        if (!view.complemented()) {
+            binary_into<Op>(dst, view.blocks(), view.offset());
+            return;
+        }
+        kernels::with_complement<Op>(false, true, false,
+                                     [&](auto op) { binary_into<decltype(op)>(dst, view.blocks(), view.offset()); });
+        if (size_ & 0x7) {
+            dst.mutable_data()[byte_size() - 1] &= uint8_t((1u << (size_ & 0x7)) - 1);
+        }
+    }
+
+    // rhs holds the operand's bits from bit offset of its first byte on
+    template <typename Op>
+    void
+    binary_into(BasicBitset& dst, const uint8_t* rhs, size_t offset) const {
+        if (offset == 0) {
+            binary_into<Op>(dst, rhs);
+            return;
+        }
+        if (cardinality_.enabled() || dst.cardinality_.enabled()) {
+            auto n = kernels::binary_op_shifted<Op, true>(dst.mutable_data(), data(), 0, rhs, offset, size_);
+            dst.cardinality_.reset(n);
+        } else {
+            kernels::binary_op_shifted<Op>(dst.mutable_data(), data(), 0, rhs, offset, size_);
+        }
+        refingerprint_into(dst);
+    }
+
+    template <typename Op>
+    void
+    unary_into(BasicBitset& dst) const {
+        if (cardinality_.enabled() || dst.cardinality_.enabled()) {
+            auto n = kernels::unary_op<Op, true>(dst.mutable_data(), data(), byte_size());
+            dst.cardinality_.reset(n - dst.tail_count());
+        } else {
+            kernels::unary_op<Op>(dst.mutable_data(), data(), byte_size());
+        }
+        refingerprint_into(dst);
+    }
+
+ private:
+    size_t size_;  // number of bits
+    std::vector<storage_type, allocator_type> bitset_;
+    CardinalityCounter<ConcurrencyPolicy> cardinality_;
+    FingerprintTracker<ConcurrencyPolicy> fingerprint_;
+};
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>&
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator&=(const BasicBitset& bitset) {
+    binary_into<kernels::AndOp>(*this, bitset.data());
+    return *this;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>&
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator&=(const BitsetView& view) {
+    binary_into<kernels::AndOp>(*this, view);
+    return *this;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+std::shared_ptr<BasicBitset<WordT, ConcurrencyPolicy, Allocator>>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator&(const BasicBitset& bitset) const {
+    auto result_bitset = make_result(bitset.size());
+    binary_into<kernels::AndOp>(*result_bitset, bitset.data());
+    return result_bitset;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+std::shared_ptr<BasicBitset<WordT, ConcurrencyPolicy, Allocator>>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator&(const BitsetView& view) const {
+    auto result_bitset = make_result(view.size());
+    binary_into<kernels::AndOp>(*result_bitset, view);
+    return result_bitset;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>&
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator|=(const BasicBitset& bitset) {
+    binary_into<kernels::OrOp>(*this, bitset.data());
+    return *this;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>&
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator|=(const BitsetView& view) {
+    binary_into<kernels::OrOp>(*this, view);
+    return *this;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+std::shared_ptr<BasicBitset<WordT, ConcurrencyPolicy, Allocator>>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator|(const BasicBitset& bitset) const {
+    auto result_bitset = make_result(bitset.size());
+    binary_into<kernels::OrOp>(*result_bitset, bitset.data());
+    return result_bitset;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+std::shared_ptr<BasicBitset<WordT, ConcurrencyPolicy, Allocator>>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator|(const BitsetView& view) const {
+    auto result_bitset = make_result(view.size());
+    binary_into<kernels::OrOp>(*result_bitset, view);
+    return result_bitset;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>&
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator^=(const BasicBitset& bitset) {
+    binary_into<kernels::XorOp>(*this, bitset.data());
+    return *this;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>&
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator^=(const BitsetView& view) {
+    binary_into<kernels::XorOp>(*this, view);
+    return *this;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+std::shared_ptr<BasicBitset<WordT, ConcurrencyPolicy, Allocator>>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator^(const BasicBitset& bitset) const {
+    auto result_bitset = make_result(bitset.size());
+    binary_into<kernels::XorOp>(*result_bitset, bitset.data());
+    return result_bitset;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+std::shared_ptr<BasicBitset<WordT, ConcurrencyPolicy, Allocator>>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator^(const BitsetView& view) const {
+    auto result_bitset = make_result(view.size());
+    binary_into<kernels::XorOp>(*result_bitset, view);
+    return result_bitset;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>&
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator-=(const BasicBitset& bitset) {
+    binary_into<kernels::AndNotOp>(*this, bitset.data());
+    return *this;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>&
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator-=(const BitsetView& view) {
+    binary_into<kernels::AndNotOp>(*this, view);
+    return *this;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+std::shared_ptr<BasicBitset<WordT, ConcurrencyPolicy, Allocator>>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator-(const BasicBitset& bitset) const {
+    auto result_bitset = make_result(bitset.size());
+    binary_into<kernels::AndNotOp>(*result_bitset, bitset.data());
+    return result_bitset;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+std::shared_ptr<BasicBitset<WordT, ConcurrencyPolicy, Allocator>>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator-(const BitsetView& view) const {
+    auto result_bitset = make_result(view.size());
+    binary_into<kernels::AndNotOp>(*result_bitset, view);
+    return result_bitset;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+void
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::andnot_into(const BasicBitset& bitset, BasicBitset& dst) const {
+    assert(dst.size() == size());
+    binary_into<kernels::AndNotOp>(dst, bitset.data());
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+void
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::andnot_into(const BitsetView& view, BasicBitset& dst) const {
+    assert(dst.size() == size());
+    binary_into<kernels::AndNotOp>(dst, view);
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>&
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::negate() {
+    unary_into<kernels::NotOp>(*this);
+    return *this;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>&
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator<<=(size_t n) {
+    kernels::shift_up(mutable_data(), data(), n, size_);
+    recount_into(*this);
+    return *this;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>&
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator>>=(size_t n) {
+    kernels::shift_down(mutable_data(), data(), size_, n, size_);
+    recount_into(*this);
+    return *this;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+std::shared_ptr<BasicBitset<WordT, ConcurrencyPolicy, Allocator>>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator<<(size_t n) const {
+    auto result_bitset = make_result(size_);
+    kernels::shift_up(result_bitset->mutable_data(), data(), n, size_);
+    recount_into(*result_bitset);
+    return result_bitset;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+std::shared_ptr<BasicBitset<WordT, ConcurrencyPolicy, Allocator>>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator>>(size_t n) const {
+    return extract(n, size_);
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+std::shared_ptr<BasicBitset<WordT, ConcurrencyPolicy, Allocator>>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::extract(size_t offset, size_t length) const {
+    auto result_bitset = make_result(length);
+    extract_into(offset, *result_bitset);
+    return result_bitset;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+void
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::extract_into(size_t offset, BasicBitset& dst) const {
+    assert(&dst != this);
+    kernels::shift_down(dst.mutable_data(), data(), size_, offset, dst.size_);
+    recount_into(dst);
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+size_t
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::count() const {
+    if (cardinality_.enabled()) {
+        return cardinality_.load();
+    }
+    return kernels::popcount(data(), size_);
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+BasicBitset<WordT, ConcurrencyPolicy, Allocator>::operator std::string() const {
+    const char one = '1';
+    const char zero = '0';
+    const size_t len = size();
+    std::string s;
+    s.assign(len, zero);
+
+    for (size_t i = 0; i < len; ++i) {
+        if (test(id_type_t(i)))
+            s[len - 1 - i] = one;
+    }
+    return s;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+bool
+operator==(const BasicBitset<WordT, ConcurrencyPolicy, Allocator>& lhs,
+           const BasicBitset<WordT, ConcurrencyPolicy, Allocator>& rhs) {
+    if (std::addressof(lhs) == std::addressof(rhs)) {
+        return true;
+    }
+
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+
+    auto ret = std::memcmp(lhs.data(), rhs.data(), lhs.byte_size());
+    return ret == 0;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+bool
+operator!=(const BasicBitset<WordT, ConcurrencyPolicy, Allocator>& lhs,
+           const BasicBitset<WordT, ConcurrencyPolicy, Allocator>& rhs) {
+    return !(lhs == rhs);
+}
+
+// estimate_count_and of the views, with the upper bound capped by the
+// count of either bitset that tracks it
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+CountEstimate
+estimate_count_and(const BasicBitset<WordT, ConcurrencyPolicy, Allocator>& lhs,
+                   const BasicBitset<WordT, ConcurrencyPolicy, Allocator>& rhs, double error = 0.02,
+                   double confidence = 0.95) {
+    auto ret = estimate_count_and(BitsetView(lhs), BitsetView(rhs), error, confidence);
+    for (auto* bitset : {&lhs, &rhs}) {
+        if (bitset->tracks_count()) {
+            ret.upper = std::min(ret.upper, bitset->count());
+        }
+    }
+    ret.lower = std::min(ret.lower, ret.upper);
+    ret.count = std::min(ret.count, ret.upper);
+    ret.exact = ret.exact || ret.lower == ret.upper;
+    return ret;
+}
+
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+std::ostream&
+operator<<(std::ostream& os, const BasicBitset<WordT, ConcurrencyPolicy, Allocator>& bitset) {
+    os << std::string(bitset);
+    return os;
+}
+
+}  // namespace faiss
@@ -0,0 +1,229 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+#include "BitSlicedIndex.h"
+#include "BitsetKernels.h"
+
+namespace faiss {
+
+namespace {
+
+// One slice of the comparison walk, in a single pass: keep the rows of eq
+// whose bit in slice equals the key bit, and if tracked, move the others to
+// side.
+void
+compare_step(uint8_t* eq, uint8_t* side, const uint8_t* slice, size_t n8, bool bit, bool tracked) {
+    uint64_t flip = bit ? 0 : ~uint64_t(0);
+
+    size_t n64 = n8 / 8;
+    if (tracked) {
+        for (size_t i = 0; i < n64; i++) {
+            uint64_t match = kernels::load_u64(slice + i * 8) ^ flip;
+            uint64_t e = kernels::load_u64(eq + i * 8);
+            kernels::store_u64(side + i * 8, kernels::load_u64(side + i * 8) | (e & ~match));
+            kernels::store_u64(eq + i * 8, e & match);
+        }
+    } else {
+        for (size_t i = 0; i < n64; i++) {
+            kernels::store_u64(eq + i * 8, kernels::load_u64(eq + i * 8) & (kernels::load_u64(slice + i * 8) ^ flip));
+        }
+    }
+
+    for (size_t i = n64 * 8; i < n8; i++) {
+        uint8_t match = slice[i] ^ uint8_t(flip);
+        if (tracked) {
+            side[i] |= eq[i] & ~match;
+        }
+        eq[i] &= match;
+    }
+}
+
+}  // namespace
+
+void
+BitSlicedIndex::append(int64_t value) {
+    append(&value, 1);
+}
+
+void
+BitSlicedIndex::append(const int64_t* values, size_t n) {
+    reserve(rows_ + n);
+    for (size_t i = 0; i < n; i++) {
+        assert(values[i] >= base_);
+        uint64_t key = uint64_t(values[i]) - uint64_t(base_);
+        size_t width = key ? 64 - __builtin_clzll(key) : 0;
+        while (slices_.size() < width) {
+            slices_.emplace_back(capacity_);
+        }
+        for (; key; key &= key - 1) {
+            slices_[__builtin_ctzll(key)].set(rows_ + i);
+        }
+    }
+    rows_ += n;
+}
+
+int64_t
+BitSlicedIndex::get(size_t row) const {
+    uint64_t key = 0;
+    for (size_t i = 0; i < slices_.size(); i++) {
+        if (slices_[i].test(row)) {
+            key |= uint64_t(1) << i;
+        }
+    }
+    return int64_t(uint64_t(base_) + key);
+}
+
+ConcurrentBitset2Ptr
+BitSlicedIndex::compare(CompareOp op, int64_t value) const {
+    bool below = value < base_;
+    uint64_t key = below ? 0 : uint64_t(value) - uint64_t(base_);
+    bool above = !below && slices_.size() < 64 && (key >> slices_.size()) != 0;
+    if (below || above) {
+        bool match_all = below ? (op == CompareOp::NE || op == CompareOp::GT || op == CompareOp::GE)
+                               : (op == CompareOp::NE || op == CompareOp::LT || op == CompareOp::LE);
+        return match_all ? std::make_shared<ConcurrentBitset2>(all_rows()) : std::make_shared<ConcurrentBitset2>(rows_);
+    }
+
+    // O'Neil-Quass: eq holds the rows whose high bits equal those of key so
+    // far; a row leaves eq for lt (gt) at the first slice where its bit is
+    // below (above) the key's
+    bool want_lt = op == CompareOp::LT || op == CompareOp::LE;
+    bool want_gt = op == CompareOp::GT || op == CompareOp::GE;
+    auto eq = all_rows();
+    auto side = std::make_shared<ConcurrentBitset2>(rows_);
+    for (size_t i = slices_.size(); i-- > 0;) {
+        bool bit = (key >> i) & 0x1;
+        compare_step(eq.mutable_data(), side->mutable_data(), slices_[i].data(), eq.byte_size(), bit,
+                     bit ? want_lt : want_gt);
+    }
+
+    switch (op) {
+        case CompareOp::EQ:
+            return std::make_shared<ConcurrentBitset2>(std::move(eq));
+        case CompareOp::NE:
+            eq.negate();
+            clear_tail(eq);
+            return std::make_shared<ConcurrentBitset2>(std::move(eq));
+        case CompareOp::LE:
+        case CompareOp::GE:
+            *side |= eq;
+            return side;
+        default:
+            return side;
+    }
+}
+
+ConcurrentBitset2Ptr
+BitSlicedIndex::between(int64_t lower, int64_t upper) const {
+    if (lower > upper) {
+        return std::make_shared<ConcurrentBitset2>(rows_);
+    }
+    auto ret = compare(CompareOp::GE, lower);
+    *ret &= *compare(CompareOp::LE, upper);
+    return ret;
+}
+
+int64_t
+BitSlicedIndex::sum(const BitsetView& filter) const {
+    assert(filter.size() >= rows_);
+    std::vector<uint8_t> scratch;
+    auto rows = filter.subview(0, rows_).lined_up(scratch);
+    uint64_t ret = uint64_t(base_) * kernels::popcount(rows.data(), rows_);
+    for (size_t i = 0; i < slices_.size(); i++) {
+        ret += uint64_t(kernels::popcount_and(slices_[i].data(), rows.data(), rows_)) << i;
+    }
+    return int64_t(ret);
+}
+
+ConcurrentBitset2Ptr
+BitSlicedIndex::top_k(size_t k, const BitsetView& filter) const {
+    assert(filter.size() >= rows_);
+    auto top = std::make_shared<ConcurrentBitset2>(rows_);
+    auto candidates = ConcurrentBitset2(rows_);
+    filter.extract_into(0, rows_, candidates.mutable_data());
+    if (k == 0) {
+        return top;
+    }
+    if (candidates.count() <= k) {
+        return std::make_shared<ConcurrentBitset2>(std::move(candidates));
+    }
+
+    // top holds rows known to be in the result, candidates the rows tied
+    // with the k-th value on the slices seen so far
+    size_t n_top = 0;
+    auto rest = ConcurrentBitset2(rows_);
+    for (size_t i = slices_.size(); i-- > 0;) {
+        auto slice = BitsetView(slices_[i]);
+        candidates.andnot_into(slice, rest);
+        candidates ^= rest;
+        size_t n_high = candidates.count();
+        if (n_top + n_high > k) {
+            continue;
+        }
+        *top |= candidates;
+        n_top += n_high;
+        if (n_top == k) {
+            return top;
+        }
+        std::swap(candidates, rest);
+    }
+
+    for (size_t row = 0; row < rows_ && n_top < k; row++) {
+        if (candidates.test(row)) {
+            top->set(row);
+            n_top++;
+        }
+    }
+    return top;
+}
+
+size_t
+BitSlicedIndex::memory_size() const {
+    size_t ret = 0;
+    for (auto& slice : slices_) {
+        ret += slice.byte_size();
+    }
+    return ret;
+}
+
+void
+BitSlicedIndex::reserve(size_t rows) {
+    if (rows <= capacity_) {
+        return;
+    }
+    capacity_ = std::max({rows, capacity_ * 2, size_t(64)});
+    for (auto& slice : slices_) {
+        auto grown = ConcurrentBitset2(capacity_);
+        memcpy(grown.mutable_data(), slice.data(), slice.byte_size());
+        slice = std::move(grown);
+    }
+}
+
+ConcurrentBitset2
+BitSlicedIndex::all_rows() const {
+    auto ret = ConcurrentBitset2(rows_, uint8_t(0xff));
+    clear_tail(ret);
+    return ret;
+}
+
+void
+BitSlicedIndex::clear_tail(ConcurrentBitset2& bitset) const {
+    for (size_t i = rows_; i < bitset.byte_size() * 8; i++) {
+        bitset.clear(i);
+    }
+}
+
+}  // namespace faiss
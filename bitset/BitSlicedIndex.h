@@ -0,0 +1,97 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Bitset2.h"
+#include "BitsetView.h"
+#include "ScanKernels.h"
+
+namespace faiss {
+
+// Bit-sliced index over an integer column: slice i is a bitset holding bit
+// i of (value - base) for every row. A comparison against a constant walks
+// the slices from the most significant one down, so it costs one bitwise
+// pass per slice instead of a pass over the values. Slices are added as
+// larger values are appended; values must not be below base.
+//
+// Query results have size() bits, bit i set when row i matches. The filter
+// of sum() and top_k() selects the rows whose bit is set, and must cover
+// size() rows.
+class BitSlicedIndex {
+ public:
+    explicit BitSlicedIndex(int64_t base = 0) : base_(base) {
+    }
+
+    void
+    append(int64_t value);
+
+    void
+    append(const int64_t* values, size_t n);
+
+    int64_t
+    get(size_t row) const;
+
+    // value op constant
+    ConcurrentBitset2Ptr
+    compare(CompareOp op, int64_t value) const;
+
+    // lower <= value <= upper
+    ConcurrentBitset2Ptr
+    between(int64_t lower, int64_t upper) const;
+
+    // sum of the values of the rows in filter
+    int64_t
+    sum(const BitsetView& filter) const;
+
+    // the k rows of filter with the largest values; ties go to the lowest
+    // row ids
+    ConcurrentBitset2Ptr
+    top_k(size_t k, const BitsetView& filter) const;
+
+    inline size_t
+    size() const {
+        return rows_;
+    }
+
+    // number of slices
+    inline size_t
+    bit_width() const {
+        return slices_.size();
+    }
+
+    // bytes held by the slices, including room reserved for appends
+    size_t
+    memory_size() const;
+
+ private:
+    void
+    reserve(size_t rows);
+
+    // all size() rows set, bits past size() clear
+    ConcurrentBitset2
+    all_rows() const;
+
+    void
+    clear_tail(ConcurrentBitset2& bitset) const;
+
+ private:
+    int64_t base_;
+    size_t rows_ = 0;
+    size_t capacity_ = 0;  // rows each slice has room for
+    std::vector<ConcurrentBitset2> slices_;
+};
+
+}  // namespace faiss
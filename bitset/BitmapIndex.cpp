@@ -0,0 +1,333 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "BitmapIndex.h"
+#include "BitsetKernels.h"
+
+namespace faiss {
+
+namespace {
+
+// serialized layout: header, entry table, then the bitmaps, each starting
+// on an 8-byte boundary
+constexpr uint32_t SERIAL_MAGIC = 0x49504d42;  // "BMPI"
+constexpr uint32_t SERIAL_VERSION = 1;
+constexpr size_t HEADER_BYTES = 24;       // magic, version, rows, entry count
+constexpr size_t ENTRY_BYTES = 40;        // value, count, offset, length, flat + padding
+
+// 512 words of dst (4KB) stay in L1 while every source streams through
+constexpr size_t TILE_WORDS = 512;
+
+inline size_t
+align8(size_t n) {
+    return (n + 7) & ~size_t(7);
+}
+
+template <typename T>
+inline void
+put(uint8_t*& p, T value) {
+    memcpy(p, &value, sizeof(T));
+    p += sizeof(T);
+}
+
+template <typename T>
+inline T
+get(const uint8_t*& p) {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+}
+
+// dst = (dst if keep_dst) | srcs[0] | ... | srcs[k - 1], & ~deleted if
+// given, in one pass over n8 bytes
+void
+or_many(uint8_t* dst, size_t n8, const std::vector<const uint8_t*>& srcs, bool keep_dst, const uint8_t* deleted) {
+    size_t n64 = n8 / 8;
+    for (size_t begin = 0; begin < n64; begin += TILE_WORDS) {
+        size_t end = std::min(begin + TILE_WORDS, n64);
+        size_t k = 0;
+        if (!keep_dst) {
+            if (srcs.empty()) {
+                memset(dst + begin * 8, 0, (end - begin) * 8);
+            } else {
+                memcpy(dst + begin * 8, srcs[0] + begin * 8, (end - begin) * 8);
+                k = 1;
+            }
+        }
+        for (; k < srcs.size(); k++) {
+            for (size_t i = begin; i < end; i++) {
+                kernels::store_u64(dst + i * 8, kernels::load_u64(dst + i * 8) | kernels::load_u64(srcs[k] + i * 8));
+            }
+        }
+        if (deleted) {
+            for (size_t i = begin; i < end; i++) {
+                kernels::store_u64(dst + i * 8, kernels::load_u64(dst + i * 8) & ~kernels::load_u64(deleted + i * 8));
+            }
+        }
+    }
+
+    for (size_t i = n64 * 8; i < n8; i++) {
+        uint8_t byte = keep_dst ? dst[i] : 0;
+        for (auto src : srcs) {
+            byte |= src[i];
+        }
+        if (deleted) {
+            byte &= ~deleted[i];
+        }
+        dst[i] = byte;
+    }
+}
+
+}  // namespace
+
+void
+BitmapIndex::append(int64_t value) {
+    append(&value, 1);
+}
+
+void
+BitmapIndex::append(const int64_t* values, size_t n) {
+    reserve(rows_ + n);
+    for (size_t i = 0; i < n; i++) {
+        auto it = positions_.find(values[i]);
+        if (it == positions_.end()) {
+            it = positions_.emplace(values[i], entries_.size()).first;
+            entries_.emplace_back();
+            entries_.back().value = values[i];
+        }
+        auto& entry = entries_[it->second];
+        if (entry.flat) {
+            entry.dense.set(rows_ + i);
+        } else {
+            entry.sparse.set(rows_ + i);
+        }
+        entry.count++;
+        if (!entry.flat && entry.count * 16 > capacity_) {
+            make_flat(entry);
+        }
+    }
+    rows_ += n;
+}
+
+void
+BitmapIndex::in(const int64_t* values, size_t n_values, ConcurrentBitset2& dst) const {
+    in(values, n_values, BitsetView(), dst);
+}
+
+void
+BitmapIndex::in(const int64_t* values, size_t n_values, const BitsetView& deleted, ConcurrentBitset2& dst) const {
+    assert(dst.size() == rows_);
+    assert(deleted.empty() || deleted.size() >= rows_);
+    std::vector<const uint8_t*> flats;
+    std::vector<const RoaringBitset*> sparses;
+    for (size_t i = 0; i < n_values; i++) {
+        auto it = positions_.find(values[i]);
+        if (it == positions_.end()) {
+            continue;
+        }
+        auto& entry = entries_[it->second];
+        if (entry.flat) {
+            flats.push_back(entry.data());
+        } else {
+            sparses.push_back(&entry.sparse);
+        }
+    }
+
+    uint8_t* blocks = dst.mutable_data();
+    if (!sparses.empty()) {
+        memset(blocks, 0, dst.byte_size());
+        for (auto sparse : sparses) {
+            sparse->or_into(blocks, rows_);
+        }
+    }
+    std::vector<uint8_t> scratch;
+    auto deleted_rows = deleted.empty() ? deleted : deleted.subview(0, rows_).lined_up(scratch);
+    or_many(blocks, dst.byte_size(), flats, !sparses.empty(), deleted.empty() ? nullptr : deleted_rows.data());
+    if (dst.tracks_count()) {
+        dst.enable_count_tracking();
+    }
+    if (dst.tracks_fingerprint()) {
+        dst.enable_fingerprint();
+    }
+}
+
+size_t
+BitmapIndex::count(int64_t value) const {
+    auto it = positions_.find(value);
+    return it == positions_.end() ? 0 : entries_[it->second].count;
+}
+
+size_t
+BitmapIndex::flat_count() const {
+    return std::count_if(entries_.begin(), entries_.end(), [](const Entry& entry) { return entry.flat; });
+}
+
+size_t
+BitmapIndex::memory_size() const {
+    size_t ret = 0;
+    for (auto& entry : entries_) {
+        ret += entry.flat ? (entry.mapped ? 0 : entry.dense.byte_size()) : entry.sparse.memory_size();
+    }
+    return ret;
+}
+
+void
+BitmapIndex::optimize() {
+    for (auto& entry : entries_) {
+        if (entry.flat && entry.count * 32 < capacity_) {
+            make_sparse(entry);
+        } else if (!entry.flat && entry.count * 16 > capacity_) {
+            make_flat(entry);
+        } else if (!entry.flat) {
+            entry.sparse.optimize();
+        }
+    }
+}
+
+size_t
+BitmapIndex::serialized_size() const {
+    size_t ret = HEADER_BYTES + ENTRY_BYTES * entries_.size();
+    for (auto& entry : entries_) {
+        ret += align8(entry.flat ? (rows_ + 7) / 8 : entry.sparse.serialized_size());
+    }
+    return ret;
+}
+
+void
+BitmapIndex::serialize(uint8_t* buf) const {
+    uint8_t* p = buf;
+    put<uint32_t>(p, SERIAL_MAGIC);
+    put<uint32_t>(p, SERIAL_VERSION);
+    put<uint64_t>(p, rows_);
+    put<uint64_t>(p, entries_.size());
+
+    size_t offset = HEADER_BYTES + ENTRY_BYTES * entries_.size();
+    for (auto& entry : entries_) {
+        size_t length = entry.flat ? (rows_ + 7) / 8 : entry.sparse.serialized_size();
+        put<int64_t>(p, entry.value);
+        put<uint64_t>(p, entry.count);
+        put<uint64_t>(p, offset);
+        put<uint64_t>(p, length);
+        put<uint64_t>(p, entry.flat ? 1 : 0);
+        offset += align8(length);
+    }
+
+    for (auto& entry : entries_) {
+        size_t length;
+        if (entry.flat) {
+            length = (rows_ + 7) / 8;
+            memcpy(p, entry.data(), length);
+        } else {
+            length = entry.sparse.serialized_size();
+            entry.sparse.serialize(p);
+        }
+        memset(p + length, 0, align8(length) - length);
+        p += align8(length);
+    }
+}
+
+std::vector<uint8_t>
+BitmapIndex::serialize() const {
+    std::vector<uint8_t> buf(serialized_size());
+    serialize(buf.data());
+    return buf;
+}
+
+bool
+BitmapIndex::load(const uint8_t* buf, size_t len) {
+    clear();
+    const uint8_t* p = buf;
+    if (len < HEADER_BYTES || get<uint32_t>(p) != SERIAL_MAGIC || get<uint32_t>(p) != SERIAL_VERSION) {
+        return false;
+    }
+    auto rows = get<uint64_t>(p);
+    auto n_entries = get<uint64_t>(p);
+    if (n_entries > (len - HEADER_BYTES) / ENTRY_BYTES) {
+        return false;
+    }
+
+    rows_ = rows;
+    capacity_ = rows;
+    entries_.resize(n_entries);
+    for (auto& entry : entries_) {
+        entry.value = get<int64_t>(p);
+        entry.count = get<uint64_t>(p);
+        auto offset = get<uint64_t>(p);
+        auto length = get<uint64_t>(p);
+        entry.flat = get<uint64_t>(p) != 0;
+        bool valid = offset % 8 == 0 && offset <= len && length <= len && align8(length) <= len - offset &&
+                     positions_.emplace(entry.value, &entry - entries_.data()).second;
+        if (valid && entry.flat) {
+            valid = length == (rows + 7) / 8;
+            entry.mapped = buf + offset;
+        } else if (valid) {
+            valid = entry.sparse.deserialize(buf + offset, length);
+            entry.count = entry.sparse.count();
+        }
+        if (!valid) {
+            clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+BitmapIndex::reserve(size_t rows) {
+    if (rows <= capacity_) {
+        return;
+    }
+    capacity_ = std::max({rows, capacity_ * 2, size_t(64)});
+    for (auto& entry : entries_) {
+        if (!entry.flat) {
+            continue;
+        }
+        if (entry.count * 32 < capacity_) {
+            make_sparse(entry);
+            continue;
+        }
+        auto grown = ConcurrentBitset2(capacity_);
+        memcpy(grown.mutable_data(), entry.data(), (rows_ + 7) / 8);
+        entry.dense = std::move(grown);
+        entry.mapped = nullptr;
+    }
+}
+
+void
+BitmapIndex::make_flat(Entry& entry) {
+    entry.dense = ConcurrentBitset2(capacity_);
+    entry.sparse.or_into(entry.dense.mutable_data(), capacity_);
+    entry.sparse = RoaringBitset();
+    entry.flat = true;
+}
+
+void
+BitmapIndex::make_sparse(Entry& entry) {
+    entry.sparse = RoaringBitset(BitsetView(entry.data(), rows_));
+    entry.dense = ConcurrentBitset2(0);
+    entry.mapped = nullptr;
+    entry.flat = false;
+}
+
+void
+BitmapIndex::clear() {
+    rows_ = 0;
+    capacity_ = 0;
+    entries_.clear();
+    positions_.clear();
+}
+
+}  // namespace faiss
@@ -0,0 +1,133 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "Bitset2.h"
+#include "BitsetView.h"
+#include "RoaringBitset.h"
+
+namespace faiss {
+
+// Equality-encoded bitmap index over a categorical column: one bitmap per
+// distinct value, bit i set when row i holds that value. A value's bitmap
+// is kept flat once more than 1/16 of the rows hold it and compressed
+// (RoaringBitset) otherwise; the choice is revisited when the index grows
+// and by optimize(). Rows are limited to 32-bit ids by the compressed form.
+//
+// in() ORs the flat bitmaps of all requested values in one tiled pass,
+// masking out deleted rows in the same pass; compressed bitmaps are
+// applied before it.
+//
+// load() is zero-copy for flat bitmaps: they point into the caller's
+// buffer, which must outlive the index (or its next append, which copies
+// them out).
+class BitmapIndex {
+ public:
+    BitmapIndex() = default;
+
+    void
+    append(int64_t value);
+
+    void
+    append(const int64_t* values, size_t n);
+
+    // dst = rows holding one of values; dst.size() must equal size(). A
+    // tracked count or fingerprint of dst is resynchronized afterwards.
+    void
+    in(const int64_t* values, size_t n_values, ConcurrentBitset2& dst) const;
+
+    // same, leaving out the rows set in deleted, which covers size() rows
+    void
+    in(const int64_t* values, size_t n_values, const BitsetView& deleted, ConcurrentBitset2& dst) const;
+
+    // number of rows holding value
+    size_t
+    count(int64_t value) const;
+
+    inline size_t
+    size() const {
+        return rows_;
+    }
+
+    // number of distinct values
+    inline size_t
+    cardinality() const {
+        return entries_.size();
+    }
+
+    // number of values stored as flat bitmaps
+    size_t
+    flat_count() const;
+
+    // bytes held by the bitmaps, not counting mapped ones
+    size_t
+    memory_size() const;
+
+    // re-pick flat or compressed for every value
+    void
+    optimize();
+
+    size_t
+    serialized_size() const;
+
+    void
+    serialize(uint8_t* buf) const;
+
+    std::vector<uint8_t>
+    serialize() const;
+
+    // return false, leaving the index empty, if buf is not a valid
+    // serialized index of at most len bytes; flat bitmaps keep pointing
+    // into buf
+    bool
+    load(const uint8_t* buf, size_t len);
+
+ private:
+    struct Entry {
+        int64_t value;
+        size_t count = 0;
+        bool flat = false;
+        RoaringBitset sparse;
+        ConcurrentBitset2 dense = ConcurrentBitset2(0);
+        const uint8_t* mapped = nullptr;  // flat bitmap inside a loaded buffer
+
+        inline const uint8_t*
+        data() const {
+            return mapped ? mapped : dense.data();
+        }
+    };
+
+    void
+    reserve(size_t rows);
+
+    void
+    make_flat(Entry& entry);
+
+    void
+    make_sparse(Entry& entry);
+
+    void
+    clear();
+
+ private:
+    size_t rows_ = 0;
+    size_t capacity_ = 0;  // rows the flat bitmaps have room for
+    std::vector<Entry> entries_;
+    std::unordered_map<int64_t, size_t> positions_;  // value -> entry
+};
+
+}  // namespace faiss
@@ -9,143 +9,21 @@
 // is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
 // or implied. See the License for the specific language governing permissions and limitations under the License.
 
+
 #pragma once
 
-#include <assert.h>
-#include <atomic>
+#include <cstdint>
 #include <memory>
-#include <iostream>
-#include <string.h>
-#include <vector>
-
-namespace faiss {
-
-class BitsetView;
-
-class ConcurrentBitset {
-
- friend
- bool operator==(const ConcurrentBitset& lhs, const ConcurrentBitset& rhs);
-
- friend
- bool operator!=(const ConcurrentBitset& lhs, const ConcurrentBitset& rhs);
-
- friend
- std::ostream& operator<<(std::ostream& os, const ConcurrentBitset& bitset);
-
- public:
-
-    using id_type_t = int64_t;
-    explicit ConcurrentBitset(size_t size, uint8_t init_value = 0)
-    : size_(size), bitset_(((size + 8 - 1) >> 3)) {
-        if (init_value) {
-            memset(mutable_data(), init_value, (size_ + 8 - 1) >> 3);
-        }
-    }
-
-    explicit ConcurrentBitset(size_t size, const uint8_t* data) : size_(size), bitset_(((size + 8 - 1) >> 3)) {
-        memcpy(mutable_data(), data, (size_ + 8 - 1) >> 3);
-    }
-
-    ConcurrentBitset&
-    operator&=(const ConcurrentBitset& bitset);
-
-    ConcurrentBitset&
-    operator&=(const BitsetView& view);
-
-    std::shared_ptr<ConcurrentBitset>
-    operator&(const ConcurrentBitset& bitset) const;
-
-    std::shared_ptr<ConcurrentBitset>
-    operator&(const BitsetView& view) const;
-
-    ConcurrentBitset&
-    operator|=(const ConcurrentBitset& bitset);
-
-    ConcurrentBitset&
-    operator|=(const BitsetView& view);
-
-    std::shared_ptr<ConcurrentBitset>
-    operator|(const ConcurrentBitset& bitset) const;
 
-    std::shared_ptr<ConcurrentBitset>
-    operator|(const BitsetView& view) const;
+#include "BasicBitset.h"
 
-    ConcurrentBitset&
-    negate();
-
-    inline bool
-    test(id_type_t id) const {
-        unsigned char mask = (unsigned char)(0x01) << (id & 0x07);
-        return (bitset_[id >> 3].load() & mask);
-    }
-
-    inline void
-    set(id_type_t id) {
-        unsigned char mask = (unsigned char)(0x01) << (id & 0x07);
-        bitset_[id >> 3].fetch_or(mask);
-    }
-
-    /*
-    bool
-    all() const;
-
-    inline bool
-    any() const;
-
-    inline bool
-    none() const {
-	    return !any();
-    }
-    */
-
-    inline bool
-    empty() const {
-	    return size_ == 0;
-    }
-
-
-    // todo rename to reset
-    inline void
-    clear(id_type_t id) {
-        unsigned char mask = (unsigned char)(0x01) << (id & 0x07);
-        bitset_[id >> 3].fetch_and(~mask);
-    }
-
-    size_t
-    count() const ;
-
-    inline size_t
-    size() const {
-        return size_;
-    }
-
-    inline size_t
-    byte_size() const {
-        return ((size_ + 8 - 1) >> 3);
-    }
-
-    inline const uint8_t*
-    data() const {
-        return reinterpret_cast<const uint8_t*>(bitset_.data());
-    }
-
-    inline uint8_t*
-    mutable_data() {
-        return reinterpret_cast<uint8_t*>(bitset_.data());
-    }
-
-    operator std::string() const;
-
- private:
-    size_t size_; // number of bits
-    std::vector<std::atomic<uint8_t>> bitset_;
-};
+namespace faiss {
 
-bool operator==(const ConcurrentBitset& lhs, const ConcurrentBitset& rhs);
-bool operator!=(const ConcurrentBitset& lhs, const ConcurrentBitset& rhs);
-std::ostream& operator<<(std::ostream& os, const ConcurrentBitset& bitset);
+// shared bitset, set/clear are atomic
+using ConcurrentBitset = BasicBitset<uint8_t, AtomicPolicy>;
 
 using ConcurrentBitsetPtr = std::shared_ptr<ConcurrentBitset>;
 
+extern template class BasicBitset<uint8_t, AtomicPolicy>;
+
 }  // namespace faiss
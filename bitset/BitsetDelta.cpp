@@ -0,0 +1,284 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <assert.h>
+#include <utility>
+
+#include "BitsetDelta.h"
+#include "BitsetKernels.h"
+#include "HashKernels.h"
+
+namespace faiss {
+
+namespace {
+
+void
+put_varint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+// return false if the varint at p runs past end or does not fit 64 bits
+bool
+get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (size_t shift = 0; p < end; shift += 7) {
+        uint8_t byte = *p++;
+        if (shift == 63 && byte > 1) {
+            return false;
+        }
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// a varint of a delta that deserialize() or diff() already checked
+inline uint64_t
+get_varint(const uint8_t*& p, const uint8_t* end) {
+    uint64_t value;
+    bool ok = get_varint(p, end, value);
+    assert(ok);
+    (void)ok;
+    return value;
+}
+
+// Skip the equal words of lhs and rhs from byte i (a multiple of 8) on, up
+// to n8 (also a multiple of 8): return the byte of the first word that
+// differs, or where the scalar loop has to go on.
+
+#if defined(__x86_64__)
+
+BITSET_TARGET_AVX512 size_t
+skip_equal_avx512(const uint8_t* lhs, const uint8_t* rhs, size_t i, size_t n8) {
+    for (; i + 64 <= n8; i += 64) {
+        __mmask8 ne = _mm512_cmpneq_epi64_mask(_mm512_loadu_si512(lhs + i), _mm512_loadu_si512(rhs + i));
+        if (ne) {
+            return i + 8 * __builtin_ctz(ne);
+        }
+    }
+    return i;
+}
+
+BITSET_TARGET_AVX2 size_t
+skip_equal_avx2(const uint8_t* lhs, const uint8_t* rhs, size_t i, size_t n8) {
+    for (; i + 32 <= n8; i += 32) {
+        __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i));
+        __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + i));
+        uint32_t ne = ~uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(l, r)));
+        if (ne) {
+            return i + (__builtin_ctz(ne) & ~0x7);
+        }
+    }
+    return i;
+}
+
+#endif
+
+size_t
+skip_equal(const uint8_t* lhs, const uint8_t* rhs, size_t i, size_t n8, SimdLevel level) {
+#if defined(__x86_64__)
+    if (level == SimdLevel::AVX512) {
+        i = skip_equal_avx512(lhs, rhs, i, n8);
+    } else if (level == SimdLevel::AVX2) {
+        i = skip_equal_avx2(lhs, rhs, i, n8);
+    }
+#else
+    (void)level;
+#endif
+    for (; i < n8 && kernels::load_u64(lhs + i) == kernels::load_u64(rhs + i); i += 8) {
+    }
+    return i;
+}
+
+}  // namespace
+
+bool
+BitsetDelta::deserialize(const uint8_t* buf, size_t len) {
+    bytes_.clear();
+    size_ = 0;
+    header_ = 0;
+
+    const uint8_t* p = buf;
+    const uint8_t* end = buf + len;
+    uint64_t size;
+    if (!get_varint(p, end, size)) {
+        return false;
+    }
+    size_t header = p - buf;
+    uint64_t n_words = size / 64 + (size % 64 != 0);
+    // bits of the last word that lie past size
+    uint64_t tail = size % 64 ? ~uint64_t(0) << (size % 64) : 0;
+    uint64_t w = 0;
+    while (p < end) {
+        uint64_t skip, run;
+        if (!get_varint(p, end, skip) || !get_varint(p, end, run)) {
+            return false;
+        }
+        uint64_t length = run >> 1;
+        if (skip > n_words - w || length > n_words - w - skip) {
+            return false;
+        }
+        w += skip;
+        if (run & 1) {
+            if (length > uint64_t(end - p)) {
+                return false;
+            }
+            for (uint64_t k = 0; k < length; k++, w++) {
+                uint8_t bit = *p++;
+                if (bit >= 64 || (w == n_words - 1 && (tail >> bit) & 1)) {
+                    return false;
+                }
+            }
+        } else {
+            if (length > uint64_t(end - p) / 8) {
+                return false;
+            }
+            p += length * 8;
+            w += length;
+            if (length && w == n_words && (kernels::load_u64(p - 8) & tail)) {
+                return false;
+            }
+        }
+    }
+
+    bytes_.assign(buf, end);
+    size_ = size;
+    header_ = header;
+    return true;
+}
+
+bool
+BitsetDelta::empty() const {
+    return bytes_.size() == header_;
+}
+
+BitsetDelta
+diff(const BitsetView& old_bits, const BitsetView& new_bits, SimdLevel level) {
+    assert(old_bits.size() == new_bits.size());
+    size_t size = old_bits.size();
+    size_t n_words = (size + 63) >> 6;
+    size_t full_words = size >> 6;
+    bool plain = old_bits.offset() == 0 && new_bits.offset() == 0 && !old_bits.complemented() &&
+                 !new_bits.complemented();
+    uint64_t flip = (old_bits.complemented() != new_bits.complemented()) ? ~uint64_t(0) : 0;
+    size_t old_n8 = (old_bits.offset() + size + 7) >> 3;
+    size_t new_n8 = (new_bits.offset() + size + 7) >> 3;
+
+    // the XOR of word w, bits past size cleared
+    auto changes = [&](size_t w) {
+        uint64_t ret;
+        if (plain && w < full_words) {
+            ret = kernels::load_u64(old_bits.blocks() + w * 8) ^ kernels::load_u64(new_bits.blocks() + w * 8);
+        } else {
+            ret = kernels::load_bits(old_bits.blocks(), old_n8, old_bits.offset() + w * 64) ^
+                  kernels::load_bits(new_bits.blocks(), new_n8, new_bits.offset() + w * 64) ^ flip;
+        }
+        if (size - w * 64 < 64) {
+            ret &= (uint64_t(1) << (size - w * 64)) - 1;
+        }
+        return ret;
+    };
+    // the first changed word from w on, or n_words
+    auto next_change = [&](size_t w) {
+        if (plain && w < full_words) {
+            w = skip_equal(old_bits.blocks(), new_bits.blocks(), w * 8, full_words * 8, level) / 8;
+        }
+        for (; w < n_words && !changes(w); w++) {
+        }
+        return w;
+    };
+
+    BitsetDelta ret;
+    ret.size_ = size;
+    put_varint(ret.bytes_, size);
+    ret.header_ = ret.bytes_.size();
+    std::vector<uint64_t> run;
+    size_t last = 0;  // word after the last run
+    for (size_t w = next_change(0); w < n_words; w = next_change(w)) {
+        size_t begin = w;
+        for (uint64_t word; w < n_words && (word = changes(w)); w++) {
+            run.push_back(word);
+        }
+        put_varint(ret.bytes_, begin - last);
+        if (run.size() == 1 && __builtin_popcountll(run[0]) == 1) {
+            put_varint(ret.bytes_, (1 << 1) | 1);
+            ret.bytes_.push_back(uint8_t(__builtin_ctzll(run[0])));
+        } else {
+            put_varint(ret.bytes_, run.size() << 1);
+            size_t at = ret.bytes_.size();
+            ret.bytes_.resize(at + run.size() * 8);
+            for (size_t i = 0; i < run.size(); i++) {
+                kernels::store_u64(ret.bytes_.data() + at + i * 8, run[i]);
+            }
+        }
+        run.clear();
+        last = w;
+    }
+    return ret;
+}
+
+int64_t
+apply_delta(uint8_t* data, const BitsetDelta& delta, uint64_t* fingerprint) {
+    if (delta.byte_size() == 0) {
+        return 0;
+    }
+    size_t n8 = (delta.size() + 7) >> 3;
+    const uint8_t* end = delta.data() + delta.byte_size();
+    const uint8_t* p = delta.data();
+    get_varint(p, end);
+    int64_t ret = 0;
+    size_t w = 0;
+    while (p < end) {
+        w += get_varint(p, end);
+        uint64_t header = get_varint(p, end);
+        bool single = header & 1;
+        for (size_t k = 0; k < (header >> 1); k++, w++) {
+            uint64_t word;
+            if (single) {
+                assert(p < end);
+                word = uint64_t(1) << (*p++ & 63);
+            } else {
+                assert(p + 8 <= end);
+                word = kernels::load_u64(p);
+                p += 8;
+            }
+            assert(w * 8 < n8);
+            if (fingerprint) {
+                *fingerprint ^= kernels::word_fingerprint(w, word);
+            }
+            if (w * 8 + 8 <= n8) {
+                uint64_t old = kernels::load_u64(data + w * 8);
+                kernels::store_u64(data + w * 8, old ^ word);
+                ret += int64_t(__builtin_popcountll(old ^ word)) - __builtin_popcountll(old);
+            } else {
+                // the partial last word, a byte at a time
+                for (size_t i = w * 8; i < n8; i++, word >>= 8) {
+                    uint8_t old = data[i];
+                    data[i] = old ^ uint8_t(word);
+                    ret += int64_t(__builtin_popcount(data[i])) - __builtin_popcount(old);
+                }
+            }
+        }
+    }
+    return ret;
+}
+
+}  // namespace faiss
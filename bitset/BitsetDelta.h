@@ -0,0 +1,90 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "BitsetView.h"
+#include "Simd.h"
+
+namespace faiss {
+
+// The changes between two versions of a bitset, to ship to a replica that
+// holds the old one instead of the whole new one. The encoding is the
+// XOR of the two, as runs of changed 64-bit words:
+//
+//   varint size in bits
+//   per run: varint count of unchanged words skipped since the last run,
+//            varint (length << 1 | single), then either length raw
+//            little-endian XOR words, or (single: one word that flips
+//            one bit) the byte of that bit
+//
+// so a scattered flip costs about 3 bytes and a rewritten region 8 bytes
+// per word. data() / byte_size() are what goes over the wire, and
+// deserialize() checks them on the way back in.
+class BitsetDelta {
+ public:
+    BitsetDelta() = default;
+
+    // Take the len bytes of another delta's data(). Return false, leaving
+    // this delta empty, if they are not a valid delta: a varint or payload
+    // running past len, a run past the size, or a change to the bits past
+    // it.
+    bool
+    deserialize(const uint8_t* buf, size_t len);
+
+    // bits of the bitsets the delta was taken between
+    inline size_t
+    size() const {
+        return size_;
+    }
+
+    // no bit changed
+    bool
+    empty() const;
+
+    inline size_t
+    byte_size() const {
+        return bytes_.size();
+    }
+
+    inline const uint8_t*
+    data() const {
+        return bytes_.data();
+    }
+
+ private:
+    friend BitsetDelta
+    diff(const BitsetView& old_bits, const BitsetView& new_bits, SimdLevel level);
+
+    std::vector<uint8_t> bytes_;
+    size_t size_ = 0;
+    size_t header_ = 0;  // bytes of the size
+};
+
+// The delta from old_bits to new_bits, of the same size. Unchanged stretches
+// are skipped 64 bytes (AVX-512) or 32 bytes (AVX2) per compare; views
+// that start inside a byte or are complemented take a word loop.
+BitsetDelta
+diff(const BitsetView& old_bits, const BitsetView& new_bits, SimdLevel level = simd_level());
+
+// XOR the changes of delta into data, delta.size() bits holding the old
+// version (bits past it untouched); returns how much the count of 1-bits
+// changed, and XORs the change of the fingerprint into *fingerprint if
+// given. Owning bitsets use BasicBitset::apply_delta, which checks the
+// size; the delta itself was checked by diff() or deserialize().
+int64_t
+apply_delta(uint8_t* data, const BitsetDelta& delta, uint64_t* fingerprint = nullptr);
+
+}  // namespace faiss
@@ -0,0 +1,305 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace faiss {
+namespace kernels {
+
+// Word operators. Each kernel below is instantiated once per operator so the
+// inner loop is a single straight-line instruction the compiler can vectorize.
+struct AndOp {
+    template <typename T>
+    inline T
+    operator()(T lhs, T rhs) const {
+        return lhs & rhs;
+    }
+};
+
+struct OrOp {
+    template <typename T>
+    inline T
+    operator()(T lhs, T rhs) const {
+        return lhs | rhs;
+    }
+};
+
+struct XorOp {
+    template <typename T>
+    inline T
+    operator()(T lhs, T rhs) const {
+        return lhs ^ rhs;
+    }
+};
+
+// lhs & ~rhs
+struct AndNotOp {
+    template <typename T>
+    inline T
+    operator()(T lhs, T rhs) const {
+        return lhs & ~rhs;
+    }
+};
+
+struct NotOp {
+    template <typename T>
+    inline T
+    operator()(T value) const {
+        return ~value;
+    }
+};
+
+// Op on operands kept complemented, as under a complemented BitsetView:
+// lhs and rhs are negated first if NegL / NegR, the result after if
+// NegOut. Instantiated per combination, the negations fold into the
+// operator (and-not, or-not, xnor) instead of costing a pass of their own.
+template <typename Op, bool NegL, bool NegR, bool NegOut = false>
+struct ComplementOp {
+    template <typename T>
+    inline T
+    operator()(T lhs, T rhs) const {
+        T ret = Op()(NegL ? T(~lhs) : lhs, NegR ? T(~rhs) : rhs);
+        return NegOut ? T(~ret) : ret;
+    }
+};
+
+// Call func with an instance of the operator computing Op under the given
+// negations. The plain operators are passed where one matches (lhs & ~rhs
+// is AndNotOp, lhs & ~~rhs is AndOp), so those keep their own kernels.
+template <typename Op, bool NegL, bool NegR, typename Func>
+inline void
+with_complement_out(bool neg_out, Func&& func) {
+    if (neg_out) {
+        func(ComplementOp<Op, NegL, NegR, true>());
+    } else if constexpr (!NegL && !NegR) {
+        func(Op());
+    } else if constexpr (!NegL && std::is_same<Op, AndOp>::value) {
+        func(AndNotOp());
+    } else if constexpr (!NegL && std::is_same<Op, AndNotOp>::value) {
+        func(AndOp());
+    } else {
+        func(ComplementOp<Op, NegL, NegR>());
+    }
+}
+
+template <typename Op, typename Func>
+inline void
+with_complement(bool neg_lhs, bool neg_rhs, bool neg_out, Func&& func) {
+    if (neg_lhs) {
+        if (neg_rhs) {
+            with_complement_out<Op, true, true>(neg_out, func);
+        } else {
+            with_complement_out<Op, true, false>(neg_out, func);
+        }
+    } else {
+        if (neg_rhs) {
+            with_complement_out<Op, false, true>(neg_out, func);
+        } else {
+            with_complement_out<Op, false, false>(neg_out, func);
+        }
+    }
+}
+
+// Word access at any byte address: subviews may start anywhere, so the
+// buffers below are not necessarily 8-byte aligned.
+inline uint64_t
+load_u64(const uint8_t* p) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+    return word;
+}
+
+inline void
+store_u64(uint8_t* p, uint64_t word) {
+    memcpy(p, &word, 8);
+}
+
+// dst[i] = op(lhs[i], rhs[i]) over n8 bytes; dst may alias lhs.
+// With Count, also return the number of 1-bits written to dst.
+template <typename Op, bool Count = false>
+inline size_t
+binary_op(uint8_t* dst, const uint8_t* lhs, const uint8_t* rhs, size_t n8) {
+    Op op;
+    size_t ret = 0;
+    size_t n64 = n8 / 8;
+    for (size_t i = 0; i < n64; i++) {
+        uint64_t word = op(load_u64(lhs + i * 8), load_u64(rhs + i * 8));
+        store_u64(dst + i * 8, word);
+        if constexpr (Count) {
+            ret += __builtin_popcountll(word);
+        }
+    }
+
+    for (size_t i = n64 * 8; i < n8; i++) {
+        dst[i] = op(lhs[i], rhs[i]);
+        if constexpr (Count) {
+            ret += __builtin_popcount(dst[i]);
+        }
+    }
+    return ret;
+}
+
+// dst[i] = op(src[i]) over n8 bytes; dst may alias src.
+// With Count, also return the number of 1-bits written to dst.
+template <typename Op, bool Count = false>
+inline size_t
+unary_op(uint8_t* dst, const uint8_t* src, size_t n8) {
+    Op op;
+    size_t ret = 0;
+    size_t n64 = n8 / 8;
+    for (size_t i = 0; i < n64; i++) {
+        uint64_t word = op(load_u64(src + i * 8));
+        store_u64(dst + i * 8, word);
+        if constexpr (Count) {
+            ret += __builtin_popcountll(word);
+        }
+    }
+
+    for (size_t i = n64 * 8; i < n8; i++) {
+        dst[i] = op(src[i]);
+        if constexpr (Count) {
+            ret += __builtin_popcount(dst[i]);
+        }
+    }
+    return ret;
+}
+
+// the 64 bits of data from bit pos on, for any pos; data has n8 bytes and
+// bytes past them read as 0
+inline uint64_t
+load_bits(const uint8_t* data, size_t n8, size_t pos) {
+    size_t byte = pos >> 3;
+    size_t shift = pos & 0x7;
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+    if (byte + 9 <= n8) {
+        memcpy(&lo, data + byte, 8);
+        hi = data[byte + 8];
+    } else {
+        if (byte < n8) {
+            memcpy(&lo, data + byte, std::min<size_t>(8, n8 - byte));
+        }
+        if (byte + 8 < n8) {
+            hi = data[byte + 8];
+        }
+    }
+    return shift ? (lo >> shift) | (hi << (64 - shift)) : lo;
+}
+
+// Like binary_op, for operands that do not start on a byte boundary:
+// bits [offset, offset + nbits) of dst = op(the same bits of lhs, bits
+// [rhs_offset, rhs_offset + nbits) of rhs). Each rhs word is shifted into
+// place out of the bytes it straddles; dst bits outside the range are kept.
+// dst may alias lhs. With Count, return the number of 1-bits in the range.
+template <typename Op, bool Count = false>
+inline size_t
+binary_op_shifted(uint8_t* dst, const uint8_t* lhs, size_t offset, const uint8_t* rhs, size_t rhs_offset,
+                  size_t nbits) {
+    Op op;
+    size_t ret = 0;
+    size_t end = offset + nbits;
+    size_t n8 = (end + 7) >> 3;
+    size_t rhs_n8 = (rhs_offset + nbits + 7) >> 3;
+    size_t n_words = (end + 63) >> 6;
+
+    // word w of dst with its bits outside the range kept; the first and
+    // last word go through here, the others take the loop below
+    auto edge = [&](size_t w) {
+        uint64_t r = w == 0 && rhs_offset < offset ? load_bits(rhs, rhs_n8, 0) << (offset - rhs_offset)
+                                                   : load_bits(rhs, rhs_n8, w * 64 + rhs_offset - offset);
+        uint64_t mask = ~uint64_t(0);
+        if (w == 0) {
+            mask <<= offset;
+        }
+        if (end - w * 64 < 64) {
+            mask &= (uint64_t(1) << (end - w * 64)) - 1;
+        }
+        size_t len = std::min<size_t>(8, n8 - w * 8);
+        uint64_t l = 0;
+        uint64_t d = 0;
+        memcpy(&l, lhs + w * 8, len);
+        memcpy(&d, dst + w * 8, len);
+        uint64_t value = (d & ~mask) | (op(l, r) & mask);
+        memcpy(dst + w * 8, &value, len);
+        if constexpr (Count) {
+            ret += __builtin_popcountll(value & mask);
+        }
+    };
+
+    if (n_words == 0) {
+        return 0;
+    }
+    edge(0);
+    for (size_t w = 1; w + 1 < n_words; w++) {
+        uint64_t word = op(load_u64(lhs + w * 8), load_bits(rhs, rhs_n8, w * 64 + rhs_offset - offset));
+        store_u64(dst + w * 8, word);
+        if constexpr (Count) {
+            ret += __builtin_popcountll(word);
+        }
+    }
+    if (n_words > 1) {
+        edge(n_words - 1);
+    }
+    return ret;
+}
+
+// count of 1-bits among the first nbits bits; bits past nbits in the
+// last byte are ignored
+inline size_t
+popcount(const uint8_t* data, size_t nbits) {
+    size_t ret = 0;
+    size_t n64 = nbits >> 6;
+    for (size_t i = 0; i < n64; i++) {
+        ret += __builtin_popcountll(load_u64(data + i * 8));
+    }
+
+    size_t full_bytes = nbits >> 3;
+    for (size_t i = n64 * 8; i < full_bytes; i++) {
+        ret += __builtin_popcount(data[i]);
+    }
+
+    size_t remain = nbits & 0x7;
+    if (remain) {
+        ret += __builtin_popcount(data[full_bytes] & ((1u << remain) - 1));
+    }
+    return ret;
+}
+
+// count of 1-bits in lhs & rhs among the first nbits bits, without
+// materializing the intersection
+inline size_t
+popcount_and(const uint8_t* lhs, const uint8_t* rhs, size_t nbits) {
+    size_t ret = 0;
+    size_t n64 = nbits >> 6;
+    for (size_t i = 0; i < n64; i++) {
+        ret += __builtin_popcountll(load_u64(lhs + i * 8) & load_u64(rhs + i * 8));
+    }
+
+    size_t full_bytes = nbits >> 3;
+    for (size_t i = n64 * 8; i < full_bytes; i++) {
+        ret += __builtin_popcount(lhs[i] & rhs[i]);
+    }
+
+    size_t remain = nbits & 0x7;
+    if (remain) {
+        ret += __builtin_popcount(lhs[full_bytes] & rhs[full_bytes] & ((1u << remain) - 1));
+    }
+    return ret;
+}
+
+}  // namespace kernels
+}  // namespace faiss
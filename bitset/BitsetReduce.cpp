@@ -0,0 +1,358 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "BitsetKernels.h"
+#include "BitsetReduce.h"
+#include "Simd.h"
+
+namespace faiss {
+
+namespace {
+
+constexpr size_t TILE_BYTES = 4096;
+
+// clear the bits of dst's last byte past size, after a fill with 1s
+inline void
+clear_tail(uint8_t* dst, size_t size) {
+    if (size & 0x7) {
+        dst[size >> 3] &= uint8_t((1u << (size & 0x7)) - 1);
+    }
+}
+
+// reduce bytes [begin, end) of the operands into dst; begin is a multiple
+// of 8, end is too unless it is the end of dst
+template <bool Intersect>
+void
+reduce_tile(const BitsetView* views, size_t n, uint8_t* dst, size_t begin, size_t end) {
+    if (n == 0) {
+        memset(dst + begin, Intersect ? 0xff : 0, end - begin);
+        return;
+    }
+    memcpy(dst + begin, views[0].data() + begin, end - begin);
+
+    size_t w_begin = begin / 8;
+    size_t w_end = end / 8;
+    for (size_t k = 1; k < n; k++) {
+        auto src = views[k].data();
+        uint64_t any = 0;
+        for (size_t i = w_begin; i < w_end; i++) {
+            uint64_t word = kernels::load_u64(dst + i * 8);
+            if constexpr (Intersect) {
+                word &= kernels::load_u64(src + i * 8);
+                any |= word;
+            } else {
+                word |= kernels::load_u64(src + i * 8);
+            }
+            kernels::store_u64(dst + i * 8, word);
+        }
+        for (size_t i = w_end * 8; i < end; i++) {
+            if constexpr (Intersect) {
+                dst[i] &= src[i];
+                any |= dst[i];
+            } else {
+                dst[i] |= src[i];
+            }
+        }
+        if (Intersect && any == 0) {
+            return;
+        }
+    }
+}
+
+// the operands as views the kernels below can read bytewise, each lined up
+// into its scratch if need be
+std::vector<BitsetView>
+line_up(const BitsetView* views, size_t n, std::vector<std::vector<uint8_t>>& scratch) {
+    std::vector<BitsetView> ret(n);
+    scratch.resize(n);
+    for (size_t k = 0; k < n; k++) {
+        ret[k] = views[k].lined_up(scratch[k]);
+    }
+    return ret;
+}
+
+template <bool Intersect>
+void
+reduce(const BitsetView* operands, size_t n, uint8_t* dst, size_t size, bool parallel) {
+    std::vector<std::vector<uint8_t>> scratch;
+    auto lined = line_up(operands, n, scratch);
+    const BitsetView* views = lined.data();
+    size_t n8 = (size + 8 - 1) >> 3;
+    int64_t n_tiles = int64_t((n8 + TILE_BYTES - 1) / TILE_BYTES);
+    // static: thread t takes the t-th contiguous run of tiles, the pages
+    // first_touch placed on its node when dst came from a NumaAllocator
+#pragma omp parallel for schedule(static) if (parallel)
+    for (int64_t t = 0; t < n_tiles; t++) {
+        size_t begin = size_t(t) * TILE_BYTES;
+        reduce_tile<Intersect>(views, n, dst, begin, std::min(begin + TILE_BYTES, n8));
+    }
+    if (Intersect && n == 0) {
+        clear_tail(dst, size);
+    }
+}
+
+// bits counted at a time by threshold, per operand
+constexpr size_t BLOCK_WORDS = 64;
+
+#define THRESHOLD_INLINE inline __attribute__((always_inline))
+
+// Bit-sliced counters for one block: plane j holds bit j of the number of
+// operands set at each bit position. An operand of weight 2^j waits in
+// pending[j] until a second one arrives, then both go through a carry-save
+// adder with plane j and the carry moves up to weight 2^(j+1).
+struct Counter {
+    explicit Counter(size_t n_planes)
+    : n_planes(n_planes),
+      planes(n_planes * BLOCK_WORDS),
+      pending(n_planes * BLOCK_WORDS),
+      carry(BLOCK_WORDS),
+      has_pending(n_planes) {
+    }
+
+    size_t n_planes;
+    std::vector<uint64_t> planes;
+    std::vector<uint64_t> pending;
+    std::vector<uint64_t> carry;
+    std::vector<char> has_pending;
+};
+
+// One carry-save adder over a block: plane, carry = sum and carry of
+// plane + pending + x. x may be carry.
+struct CsaGeneric {
+    static THRESHOLD_INLINE void
+    add(uint64_t* plane, const uint64_t* pending, const uint64_t* x, uint64_t* carry) {
+        for (size_t i = 0; i < BLOCK_WORDS; i++) {
+            uint64_t a = plane[i], b = pending[i], c = x[i];
+            uint64_t u = a ^ b;
+            plane[i] = u ^ c;
+            carry[i] = (a & b) | (u & c);
+        }
+    }
+};
+
+#if defined(__x86_64__)
+
+// sum and carry as one vpternlogq each: 0x96 is a ^ b ^ c, 0xe8 the
+// majority of a, b, c
+struct CsaAvx512 {
+    BITSET_TARGET_AVX512 static inline void
+    add(uint64_t* plane, const uint64_t* pending, const uint64_t* x, uint64_t* carry) {
+        for (size_t i = 0; i < BLOCK_WORDS; i += 8) {
+            __m512i a = _mm512_loadu_si512(plane + i);
+            __m512i b = _mm512_loadu_si512(pending + i);
+            __m512i c = _mm512_loadu_si512(x + i);
+            _mm512_storeu_si512(plane + i, _mm512_ternarylogic_epi64(a, b, c, 0x96));
+            _mm512_storeu_si512(carry + i, _mm512_ternarylogic_epi64(a, b, c, 0xe8));
+        }
+    }
+};
+
+struct CsaAvx2 {
+    BITSET_TARGET_AVX2 static inline void
+    add(uint64_t* plane, const uint64_t* pending, const uint64_t* x, uint64_t* carry) {
+        for (size_t i = 0; i < BLOCK_WORDS; i += 4) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(plane + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pending + i));
+            __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+            __m256i u = _mm256_xor_si256(a, b);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(plane + i), _mm256_xor_si256(u, c));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(carry + i),
+                                _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(u, c)));
+        }
+    }
+};
+
+#endif
+
+template <typename Csa>
+THRESHOLD_INLINE void
+counter_add(Counter& counter, const uint64_t* x, size_t j) {
+    for (; j < counter.n_planes; j++) {
+        uint64_t* pending = counter.pending.data() + j * BLOCK_WORDS;
+        if (!counter.has_pending[j]) {
+            memcpy(pending, x, BLOCK_WORDS * 8);
+            counter.has_pending[j] = 1;
+            return;
+        }
+        uint64_t* plane = counter.planes.data() + j * BLOCK_WORDS;
+        uint64_t* carry = counter.carry.data();
+        Csa::add(plane, pending, x, carry);
+        counter.has_pending[j] = 0;
+        x = carry;
+    }
+}
+
+// count the operands of one block and write the words where the count is
+// at least t; the adders run n times per block, the flush and compare
+// below once per plane
+template <typename Csa>
+THRESHOLD_INLINE void
+threshold_block_generic(const uint64_t* const* srcs, size_t n, size_t t, Counter& counter, uint64_t* out) {
+    size_t n_planes = counter.n_planes;
+    std::fill(counter.planes.begin(), counter.planes.end(), 0);
+    std::fill(counter.has_pending.begin(), counter.has_pending.end(), 0);
+    for (size_t k = 0; k < n; k++) {
+        counter_add<Csa>(counter, srcs[k], 0);
+    }
+
+    // flush the waiting operands with half adders
+    for (size_t j = 0; j < n_planes; j++) {
+        if (!counter.has_pending[j]) {
+            continue;
+        }
+        uint64_t* carry = counter.carry.data();
+        memcpy(carry, counter.pending.data() + j * BLOCK_WORDS, BLOCK_WORDS * 8);
+        for (size_t l = j; l < n_planes; l++) {
+            uint64_t* plane = counter.planes.data() + l * BLOCK_WORDS;
+            for (size_t i = 0; i < BLOCK_WORDS; i++) {
+                uint64_t c = plane[i] & carry[i];
+                plane[i] ^= carry[i];
+                carry[i] = c;
+            }
+        }
+    }
+
+    // count >= t, from the most significant plane down: gt collects the
+    // positions already known to be above t, out those still equal to it
+    uint64_t gt[BLOCK_WORDS] = {};
+    std::fill(out, out + BLOCK_WORDS, ~uint64_t(0));
+    for (size_t j = n_planes; j-- > 0;) {
+        const uint64_t* plane = counter.planes.data() + j * BLOCK_WORDS;
+        if ((t >> j) & 0x1) {
+            for (size_t i = 0; i < BLOCK_WORDS; i++) {
+                out[i] &= plane[i];
+            }
+        } else {
+            for (size_t i = 0; i < BLOCK_WORDS; i++) {
+                gt[i] |= out[i] & plane[i];
+                out[i] &= ~plane[i];
+            }
+        }
+    }
+    for (size_t i = 0; i < BLOCK_WORDS; i++) {
+        out[i] |= gt[i];
+    }
+}
+
+#if defined(__x86_64__)
+
+BITSET_TARGET_AVX512 void
+threshold_block_avx512(const uint64_t* const* srcs, size_t n, size_t t, Counter& counter, uint64_t* out) {
+    threshold_block_generic<CsaAvx512>(srcs, n, t, counter, out);
+}
+
+BITSET_TARGET_AVX2 void
+threshold_block_avx2(const uint64_t* const* srcs, size_t n, size_t t, Counter& counter, uint64_t* out) {
+    threshold_block_generic<CsaAvx2>(srcs, n, t, counter, out);
+}
+
+#endif
+
+void
+threshold_block(const uint64_t* const* srcs, size_t n, size_t t, Counter& counter, uint64_t* out, SimdLevel level) {
+#if defined(__x86_64__)
+    if (level == SimdLevel::AVX512) {
+        return threshold_block_avx512(srcs, n, t, counter, out);
+    }
+    if (level == SimdLevel::AVX2) {
+        return threshold_block_avx2(srcs, n, t, counter, out);
+    }
+#endif
+    threshold_block_generic<CsaGeneric>(srcs, n, t, counter, out);
+}
+
+#undef THRESHOLD_INLINE
+
+void
+majority3(const BitsetView* views, uint8_t* dst, size_t n8) {
+    const uint8_t* a = views[0].data();
+    const uint8_t* b = views[1].data();
+    const uint8_t* c = views[2].data();
+    size_t n64 = n8 / 8;
+    for (size_t i = 0; i < n64; i++) {
+        uint64_t x = kernels::load_u64(a + i * 8);
+        uint64_t y = kernels::load_u64(b + i * 8);
+        uint64_t z = kernels::load_u64(c + i * 8);
+        kernels::store_u64(dst + i * 8, (x & y) | (z & (x | y)));
+    }
+    for (size_t i = n64 * 8; i < n8; i++) {
+        dst[i] = (a[i] & b[i]) | (c[i] & (a[i] | b[i]));
+    }
+}
+
+}  // namespace
+
+void
+union_many(const BitsetView* views, size_t n, uint8_t* dst, size_t size, bool parallel) {
+    reduce<false>(views, n, dst, size, parallel);
+}
+
+void
+intersect_many(const BitsetView* views, size_t n, uint8_t* dst, size_t size, bool parallel) {
+    reduce<true>(views, n, dst, size, parallel);
+}
+
+void
+threshold(const BitsetView* operands, size_t n, size_t t, uint8_t* dst, size_t size) {
+    std::vector<std::vector<uint8_t>> scratch;
+    auto lined = line_up(operands, n, scratch);
+    const BitsetView* views = lined.data();
+    size_t n8 = (size + 8 - 1) >> 3;
+    if (t == 0 || t > n) {
+        memset(dst, t == 0 ? 0xff : 0, n8);
+        clear_tail(dst, size);
+        return;
+    }
+    if (t == 1) {
+        return union_many(views, n, dst, size);
+    }
+    if (t == n) {
+        return intersect_many(views, n, dst, size);
+    }
+    if (n == 3) {
+        return majority3(views, dst, n8);
+    }
+
+    size_t n_planes = 64 - __builtin_clzll(n);
+    auto level = simd_level();
+    Counter counter(n_planes);
+    std::vector<const uint64_t*> srcs(n);
+    // each block of the operands is staged into words (zero padded for the
+    // last, partial one), which the views need not be aligned to
+    std::vector<uint64_t> staged(n * BLOCK_WORDS);
+    for (size_t k = 0; k < n; k++) {
+        srcs[k] = staged.data() + k * BLOCK_WORDS;
+    }
+    uint64_t out[BLOCK_WORDS];
+
+    constexpr size_t block_bytes = BLOCK_WORDS * 8;
+    for (size_t begin = 0; begin < n8; begin += block_bytes) {
+        size_t len = std::min(block_bytes, n8 - begin);
+        if (len < block_bytes) {
+            std::fill(staged.begin(), staged.end(), 0);
+        }
+        for (size_t k = 0; k < n; k++) {
+            memcpy(staged.data() + k * BLOCK_WORDS, views[k].data() + begin, len);
+        }
+        threshold_block(srcs.data(), n, t, counter, out, level);
+        memcpy(dst + begin, out, len);
+    }
+}
+
+}  // namespace faiss
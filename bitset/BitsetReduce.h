@@ -0,0 +1,49 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "BitsetView.h"
+
+namespace faiss {
+
+// N-ary reductions over views[0..n), each covering at least size bits,
+// written to the (size + 7) / 8 bytes of dst. The work is split into 4KB
+// tiles of dst: every operand is streamed through a tile while it stays in
+// L1, so dst is written once instead of once per operand as with chained
+// operator|=. With parallel, tiles are split into one contiguous run per
+// OpenMP thread, matching first_touch (see Numa.h). Subviews starting
+// inside a byte and complemented views are lined up into a copy first
+// (BitsetView::lined_up).
+
+// dst = views[0] | ... | views[n - 1]; dst is cleared when n == 0
+void
+union_many(const BitsetView* views, size_t n, uint8_t* dst, size_t size, bool parallel = false);
+
+// dst = views[0] & ... & views[n - 1]; dst is all 1s when n == 0. A tile
+// that becomes all 0 skips the remaining operands.
+void
+intersect_many(const BitsetView* views, size_t n, uint8_t* dst, size_t size, bool parallel = false);
+
+// dst = the bits set in at least t of views[0..n). Each operand is added to
+// per-bit counters held as bit planes, through a tree of carry-save adders
+// (one pass of bitwise ops per operand and plane), and the planes are then
+// compared against t. The adders are written with AVX-512 (vpternlogq) and
+// AVX2 intrinsics; the once-per-block flush and compare are left to the
+// compiler. t == 1 and t == n go to union_many and intersect_many, and
+// majority of 3 to its closed form.
+void
+threshold(const BitsetView* views, size_t n, size_t t, uint8_t* dst, size_t size);
+
+}  // namespace faiss
@@ -10,14 +10,158 @@
 // or implied. See the License for the specific language governing permissions and limitations under the License.
 
 #include <assert.h>
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <atomic>
 #include <memory>
 #include <vector>
+#include "BitsetKernels.h"
 #include "BitsetView.h"
+#include "HashKernels.h"
+#include "RelationKernels.h"
+#include "ShiftKernels.h"
+#include "StreamKernels.h"
 
 namespace faiss {
 
+namespace {
+
+// Run an in-place shift over bits [offset, offset + size) of blocks: the
+// shift runs over bits [0, offset + size), with the bits before offset
+// cleared so that none of them moves in, and the bits of the first and
+// last byte outside the range (which the shift clears) are put back
+// afterwards.
+template <typename Shift>
+void
+shift_within(uint8_t* blocks, size_t offset, size_t size, Shift shift) {
+    if (offset == 0 && (size & 0x7) == 0) {
+        shift(blocks, size);
+        return;
+    }
+    if (size == 0) {
+        return;
+    }
+    size_t end = offset + size;
+    size_t last = (end - 1) >> 3;
+    uint8_t head_mask = uint8_t((1u << offset) - 1);
+    uint8_t tail_mask = (end & 0x7) ? uint8_t(~((1u << (end & 0x7)) - 1)) : 0;
+    uint8_t head = blocks[0] & head_mask;
+    uint8_t tail = blocks[last] & tail_mask;
+    blocks[0] &= ~head_mask;
+    shift(blocks, end);
+    blocks[0] = (blocks[0] & ~head_mask) | head;
+    blocks[last] = (blocks[last] & ~tail_mask) | tail;
+}
+
+// set (value) or clear bits [begin, end) of blocks
+void
+fill_bits(uint8_t* blocks, size_t begin, size_t end, bool value) {
+    auto fill_bit = [&](size_t i) {
+        uint8_t mask = uint8_t(1u << (i & 0x7));
+        blocks[i >> 3] = value ? blocks[i >> 3] | mask : blocks[i >> 3] & ~mask;
+    };
+    for (; begin < end && (begin & 0x7); begin++) {
+        fill_bit(begin);
+    }
+    if (end - begin >= 8) {
+        memset(blocks + (begin >> 3), value ? 0xff : 0, (end - begin) >> 3);
+        begin += (end - begin) & ~size_t(0x7);
+    }
+    for (; begin < end; begin++) {
+        fill_bit(begin);
+    }
+}
+
+// relation_flags for views, which may start inside a byte or be
+// complemented; those take a word loop instead of the kernel
+uint32_t
+view_relation_flags(const BitsetView& lhs, const BitsetView& rhs, uint32_t stop) {
+    assert(lhs.size() == rhs.size());
+    size_t size = lhs.size();
+    if (lhs.offset() == 0 && rhs.offset() == 0 && !lhs.complemented() && !rhs.complemented()) {
+        return kernels::relation_flags(lhs.blocks(), rhs.blocks(), size, stop);
+    }
+    uint64_t lhs_flip = lhs.complemented() ? ~uint64_t(0) : 0;
+    uint64_t rhs_flip = rhs.complemented() ? ~uint64_t(0) : 0;
+    size_t lhs_n8 = (lhs.offset() + size + 7) >> 3;
+    size_t rhs_n8 = (rhs.offset() + size + 7) >> 3;
+    uint32_t found = 0;
+    for (size_t i = 0; i < size && (found & stop) != stop; i += 64) {
+        uint64_t l = kernels::load_bits(lhs.blocks(), lhs_n8, lhs.offset() + i) ^ lhs_flip;
+        uint64_t r = kernels::load_bits(rhs.blocks(), rhs_n8, rhs.offset() + i) ^ rhs_flip;
+        if (size - i < 64) {
+            uint64_t mask = (uint64_t(1) << (size - i)) - 1;
+            l &= mask;
+            r &= mask;
+        }
+        found |= (l & ~r) ? kernels::ONLY_LHS : 0;
+        found |= (r & ~l) ? kernels::ONLY_RHS : 0;
+        found |= (l & r) ? kernels::IN_BOTH : 0;
+    }
+    return found;
+}
+
+
+// bits per sampled block: one cache line
+constexpr size_t SAMPLE_BITS = 512;
+
+// how many sampled blocks ahead are prefetched
+constexpr size_t SAMPLE_PREFETCH = 8;
+
+// Stratified sample of size bits: block_count(begin, end) counts the 1-bits
+// of bits [begin, end), exact_count() all of them, and prefetch(begin) is
+// called a few blocks before block_count reads there. Each stratum adds
+// its sampled block's count scaled to the stratum's bits, a term within
+// [0, stratum bits], so by Hoeffding the sum is within
+// sqrt(ln(2 / (1 - confidence)) / 2 * sum(stratum bits^2)) of the count.
+template <typename BlockCount, typename ExactCount, typename Prefetch>
+CountEstimate
+sample_count(size_t size, double error, double confidence, BlockCount block_count, ExactCount exact_count,
+             Prefetch prefetch) {
+    assert(error > 0 && confidence > 0 && confidence < 1);
+    size_t n_blocks = (size + SAMPLE_BITS - 1) / SAMPLE_BITS;
+    double log_term = std::log(2 / (1 - confidence));
+    double strata = std::ceil(log_term / (2 * error * error));
+    if (strata * 2 >= double(n_blocks)) {
+        size_t count = exact_count();
+        return CountEstimate{count, count, count, true};
+    }
+    size_t n_strata = size_t(strata);
+
+    // the sampled block of stratum k, which spans blocks [first, last)
+    auto sampled = [&](size_t k) {
+        size_t first = k * n_blocks / n_strata;
+        size_t last = (k + 1) * n_blocks / n_strata;
+        return first + kernels::mix64(k) % (last - first);
+    };
+    for (size_t k = 0; k < SAMPLE_PREFETCH && k < n_strata; k++) {
+        prefetch(sampled(k) * SAMPLE_BITS);
+    }
+    double sum = 0;
+    double square_sum = 0;
+    for (size_t k = 0; k < n_strata; k++) {
+        if (k + SAMPLE_PREFETCH < n_strata) {
+            prefetch(sampled(k + SAMPLE_PREFETCH) * SAMPLE_BITS);
+        }
+        size_t begin = sampled(k) * SAMPLE_BITS;
+        size_t end = std::min(size, begin + SAMPLE_BITS);
+        size_t stratum_begin = k * n_blocks / n_strata * SAMPLE_BITS;
+        size_t stratum_end = std::min(size, (k + 1) * n_blocks / n_strata * SAMPLE_BITS);
+        double stratum_bits = double(stratum_end - stratum_begin);
+        sum += double(block_count(begin, end)) * stratum_bits / double(end - begin);
+        square_sum += stratum_bits * stratum_bits;
+    }
+    double half_width = std::sqrt(log_term / 2 * square_sum);
+    CountEstimate ret;
+    ret.count = size_t(std::min(std::round(sum), double(size)));
+    ret.lower = size_t(std::max(std::floor(sum - half_width), 0.0));
+    ret.upper = size_t(std::min(std::ceil(sum + half_width), double(size)));
+    return ret;
+}
+
+}  // namespace
+
     bool
     BitsetView::empty() const {
         return size_ == 0;
@@ -38,19 +182,211 @@ namespace faiss {
 
     const uint8_t*
     BitsetView::data() const {
+        assert(offset_ == 0 && !complement_);
         return blocks_;
     }
 
     uint8_t*
     BitsetView::mutable_data() {
+        assert(offset_ == 0 && !complement_);
         return const_cast<uint8_t*>(blocks_);
     }
 
+    BitsetView
+    BitsetView::lined_up(std::vector<uint8_t>& scratch) const {
+        if (offset_ == 0 && !complement_) {
+            return *this;
+        }
+        scratch.resize(byte_size());
+        extract_into(0, size_, scratch.data());
+        return BitsetView(scratch.data(), size_);
+    }
+
+    BitsetView
+    BitsetView::subview(size_t bit_offset, size_t bit_len) const {
+        assert(bit_offset + bit_len <= size_);
+        size_t pos = offset_ + bit_offset;
+        auto ret = BitsetView(blocks_ + (pos >> 3), bit_len, pos & 0x7);
+        ret.complement_ = complement_;
+        return ret;
+    }
+
+    BitsetView
+    BitsetView::operator~() const {
+        auto ret = *this;
+        ret.complement_ = !complement_;
+        return ret;
+    }
+
     bool
     BitsetView::test(int64_t index) const {
+	index += offset_;
 	auto block_id = index >> 3;
 	auto block_offset = index & 0x7;
-	return (blocks_[block_id] >> block_offset) & 0x1;
+	return ((blocks_[block_id] >> block_offset) & 0x1) ^ complement_;
+    }
+
+    // The stored bits of a complemented view are negated on the way in and
+    // the result on the way out, which with_complement folds into Op.
+    bool
+    BitsetView::intersects(const BitsetView& view) const {
+        return view_relation_flags(*this, view, kernels::IN_BOTH) & kernels::IN_BOTH;
+    }
+
+    bool
+    BitsetView::is_disjoint(const BitsetView& view) const {
+        return !intersects(view);
+    }
+
+    bool
+    BitsetView::is_subset_of(const BitsetView& view) const {
+        return !(view_relation_flags(*this, view, kernels::ONLY_LHS) & kernels::ONLY_LHS);
+    }
+
+    BitsetRelation
+    BitsetView::compare(const BitsetView& view) const {
+        auto found = view_relation_flags(*this, view, kernels::ONLY_LHS | kernels::ONLY_RHS | kernels::IN_BOTH);
+        if (!(found & kernels::ONLY_LHS)) {
+            return found & kernels::ONLY_RHS ? BitsetRelation::SUBSET : BitsetRelation::EQUAL;
+        }
+        if (!(found & kernels::ONLY_RHS)) {
+            return BitsetRelation::SUPERSET;
+        }
+        return found & kernels::IN_BOTH ? BitsetRelation::OVERLAP : BitsetRelation::DISJOINT;
+    }
+
+    template <typename Op>
+    void
+    BitsetView::binary_assign(const BitsetView& view) {
+        auto blocks = const_cast<uint8_t*>(blocks_);
+        kernels::with_complement<Op>(complement_, view.complement_, complement_, [&](auto op) {
+            using Applied = decltype(op);
+            if (offset_ == 0 && view.offset_ == 0) {
+                // the bits after the view in its last byte are not ours to change
+                size_t full_bytes = size_ >> 3;
+                kernels::binary_op<Applied>(blocks, blocks_, view.blocks_, full_bytes);
+                if (size_ & 0x7) {
+                    uint8_t mask = uint8_t((1u << (size_ & 0x7)) - 1);
+                    uint8_t value = uint8_t(op(blocks_[full_bytes], view.blocks_[full_bytes]));
+                    blocks[full_bytes] = (blocks_[full_bytes] & ~mask) | (value & mask);
+                }
+            } else {
+                kernels::binary_op_shifted<Applied>(blocks, blocks_, offset_, view.blocks_, view.offset_, size_);
+            }
+        });
+    }
+
+    template <typename Op>
+    void
+    BitsetView::binary_into(const BitsetView& view, uint8_t* dst) const {
+        kernels::with_complement<Op>(complement_, view.complement_, false, [&](auto op) {
+            using Applied = decltype(op);
+            if (offset_ == 0 && view.offset_ == 0) {
+                kernels::binary_op_into<Applied>(dst, blocks_, view.blocks_, byte_size());
+                return;
+            }
+            // line *this up with dst first, then merge view in
+            const uint8_t* lhs = blocks_;
+            if (offset_ != 0) {
+                kernels::shift_down(dst, blocks_, offset_ + size_, offset_, size_);
+                lhs = dst;
+            }
+            kernels::binary_op_shifted<Applied>(dst, lhs, 0, view.blocks_, view.offset_, size_);
+        });
+        // a negated operand turns its zero tail into ones
+        if ((complement_ || view.complement_) && (size_ & 0x7)) {
+            dst[size_ >> 3] &= uint8_t((1u << (size_ & 0x7)) - 1);
+        }
+    }
+
+    BitsetView&
+    BitsetView::operator&=(const BitsetView& view) {
+        binary_assign<kernels::AndOp>(view);
+        return *this;
+    }
+
+    BitsetView&
+    BitsetView::operator|=(const BitsetView& view) {
+        binary_assign<kernels::OrOp>(view);
+        return *this;
+    }
+
+    BitsetView&
+    BitsetView::operator^=(const BitsetView& view) {
+        binary_assign<kernels::XorOp>(view);
+        return *this;
+    }
+
+    BitsetView&
+    BitsetView::operator-=(const BitsetView& view) {
+        binary_assign<kernels::AndNotOp>(view);
+        return *this;
+    }
+
+    void
+    BitsetView::xor_into(const BitsetView& view, uint8_t* dst) const {
+        binary_into<kernels::XorOp>(view, dst);
+    }
+
+    void
+    BitsetView::andnot_into(const BitsetView& view, uint8_t* dst) const {
+        binary_into<kernels::AndNotOp>(view, dst);
+    }
+
+    BitsetView&
+    BitsetView::operator<<=(size_t n) {
+        shift_within(const_cast<uint8_t*>(blocks_), offset_, size_,
+                     [n](uint8_t* blocks, size_t nbits) { kernels::shift_up(blocks, blocks, n, nbits); });
+        // the cleared low bits read as 0 only once set
+        if (complement_) {
+            fill_bits(const_cast<uint8_t*>(blocks_), offset_, offset_ + std::min(n, size_), true);
+        }
+        return *this;
+    }
+
+    BitsetView&
+    BitsetView::operator>>=(size_t n) {
+        shift_within(const_cast<uint8_t*>(blocks_), offset_, size_,
+                     [n](uint8_t* blocks, size_t nbits) { kernels::shift_down(blocks, blocks, nbits, n, nbits); });
+        if (complement_) {
+            fill_bits(const_cast<uint8_t*>(blocks_), offset_ + size_ - std::min(n, size_), offset_ + size_, true);
+        }
+        return *this;
+    }
+
+    void
+    BitsetView::shift_left_into(size_t n, uint8_t* dst) const {
+        if (complement_) {
+            extract_into(0, size_, dst);
+            kernels::shift_up(dst, dst, n, size_);
+        } else if (offset_ == 0) {
+            kernels::shift_up(dst, blocks_, n, size_);
+        } else {
+            kernels::shift_down(dst, blocks_, offset_ + size_, offset_, size_);
+            kernels::shift_up(dst, dst, n, size_);
+        }
+    }
+
+    void
+    BitsetView::shift_right_into(size_t n, uint8_t* dst) const {
+        if (complement_) {
+            extract_into(0, size_, dst);
+            kernels::shift_down(dst, dst, size_, n, size_);
+            return;
+        }
+        kernels::shift_down(dst, blocks_, offset_ + size_, offset_ + n, size_);
+    }
+
+    void
+    BitsetView::extract_into(size_t offset, size_t length, uint8_t* dst) const {
+        kernels::shift_down(dst, blocks_, offset_ + size_, offset_ + offset, length);
+        if (complement_) {
+            // the bits past size() that shift_down read as 0 must stay 0
+            size_t n8 = (length + 7) >> 3;
+            size_t valid = offset < size_ ? std::min(length, size_ - offset) : 0;
+            kernels::unary_op<kernels::NotOp>(dst, dst, n8);
+            fill_bits(dst, valid, n8 * 8, false);
+        }
     }
 
     BitsetView::operator bool() const {
@@ -59,29 +395,91 @@ namespace faiss {
 
     size_t
     BitsetView::count() const {
-	size_t ret = 0;
-	auto p_data = reinterpret_cast<const uint64_t *>(blocks_);
-	auto len = size_ >> 6;
-	//auto remainder = size() % 8;
-	auto popcount8 = [&](uint8_t x) -> int{
-	    x = (x & 0x55) + ((x >> 1) & 0x55);
-	    x = (x & 0x33) + ((x >> 2) & 0x33);
-	    x = (x & 0x0F) + ((x >> 4) & 0x0F);
-	    return x;
-	};
-	for (int64_t i = 0; i < len; ++i) {
-	    ret += __builtin_popcountl(*p_data);
-	    p_data++;
-	}
-	auto p_byte = blocks_ + (len << 3);
-	for (auto i = (len << 3); i < byte_size(); ++i) {
-	    ret += popcount8(*p_byte);
-	    p_byte++;
-	}
-	return ret;
-     }
+        size_t ret = kernels::popcount(blocks_, offset_ + size_) - kernels::popcount(blocks_, offset_);
+        return complement_ ? size_ - ret : ret;
+    }
 
 
+    CountEstimate
+    BitsetView::estimate_count(double error, double confidence) const {
+        // bits [begin, end) of the view, begin a multiple of SAMPLE_BITS
+        auto block_count = [this](size_t begin, size_t end) {
+            const uint8_t* blocks = blocks_ + (begin >> 3);
+            size_t ret = kernels::popcount(blocks, offset_ + end - begin) - kernels::popcount(blocks, offset_);
+            return complement_ ? end - begin - ret : ret;
+        };
+        auto prefetch = [this](size_t begin) { __builtin_prefetch(blocks_ + (begin >> 3)); };
+        return sample_count(size_, error, confidence, block_count, [this] { return count(); }, prefetch);
+    }
+
+CountEstimate
+estimate_count_and(const BitsetView& lhs, const BitsetView& rhs, double error, double confidence) {
+    assert(lhs.size() == rhs.size());
+    size_t size = lhs.size();
+    auto block_count = [&](size_t begin, size_t end) {
+        if (lhs.offset() == 0 && rhs.offset() == 0 && !lhs.complemented() && !rhs.complemented()) {
+            return kernels::popcount_and(lhs.blocks() + (begin >> 3), rhs.blocks() + (begin >> 3), end - begin);
+        }
+        uint64_t lhs_flip = lhs.complemented() ? ~uint64_t(0) : 0;
+        uint64_t rhs_flip = rhs.complemented() ? ~uint64_t(0) : 0;
+        size_t lhs_n8 = (lhs.offset() + size + 7) >> 3;
+        size_t rhs_n8 = (rhs.offset() + size + 7) >> 3;
+        size_t ret = 0;
+        for (size_t i = begin; i < end; i += 64) {
+            uint64_t word = (kernels::load_bits(lhs.blocks(), lhs_n8, lhs.offset() + i) ^ lhs_flip) &
+                            (kernels::load_bits(rhs.blocks(), rhs_n8, rhs.offset() + i) ^ rhs_flip);
+            if (end - i < 64) {
+                word &= (uint64_t(1) << (end - i)) - 1;
+            }
+            ret += __builtin_popcountll(word);
+        }
+        return ret;
+    };
+    auto exact_count = [&] { return block_count(0, size); };
+    auto prefetch = [&](size_t begin) {
+        __builtin_prefetch(lhs.blocks() + (begin >> 3));
+        __builtin_prefetch(rhs.blocks() + (begin >> 3));
+    };
+    return sample_count(size, error, confidence, block_count, exact_count, prefetch);
+}
+
+    Hash128
+    BitsetView::hash128() const {
+        if (offset_ == 0 && !complement_) {
+            return kernels::hash_bits(blocks_, size_);
+        }
+        // the bits are lined up in a chunk of whole stripes at a time
+        constexpr size_t chunk_bits = 1 << 15;
+        uint8_t chunk[chunk_bits / 8];
+        kernels::BitsHasher hasher;
+        size_t i = 0;
+        for (; i + chunk_bits <= size_; i += chunk_bits) {
+            extract_into(i, chunk_bits, chunk);
+            hasher.update(chunk, chunk_bits / 512);
+        }
+        extract_into(i, size_ - i, chunk);
+        hasher.update(chunk, (size_ - i) / 512);
+        return hasher.finish(chunk + (size_ - i) / 512 * 64, size_);
+    }
+
+    uint64_t
+    BitsetView::fingerprint() const {
+        if (offset_ == 0 && !complement_) {
+            return kernels::fingerprint_bits(blocks_, size_);
+        }
+        size_t n8 = (offset_ + size_ + 7) >> 3;
+        uint64_t flip = complement_ ? ~uint64_t(0) : 0;
+        uint64_t ret = kernels::mix64(size_);
+        for (size_t w = 0; w * 64 < size_; w++) {
+            uint64_t word = kernels::load_bits(blocks_, n8, offset_ + w * 64) ^ flip;
+            if (size_ - w * 64 < 64) {
+                word &= (uint64_t(1) << (size_ - w * 64)) - 1;
+            }
+            ret ^= kernels::word_fingerprint(w, word);
+        }
+        return ret;
+    }
+
 BitsetView::operator std::string() const { 
     const char one = '1';
     const char zero = '0';
@@ -110,8 +508,33 @@ bool operator==(const BitsetView& lhs, const BitsetView& rhs) {
     }
 
 
-    auto ret = std::memcmp(lhs.data(), rhs.data(), lhs.byte_size());
-    return ret == 0;
+    // bits past size() in the last byte are not compared: for a subview
+    // they belong to the bits after it
+    if (lhs.offset() == 0 && rhs.offset() == 0 && lhs.complemented() == rhs.complemented()) {
+        size_t full_bytes = lhs.size() >> 3;
+        size_t remain = lhs.size() & 0x7;
+        if (full_bytes && std::memcmp(lhs.blocks(), rhs.blocks(), full_bytes) != 0) {
+            return false;
+        }
+        return !remain || ((lhs.blocks()[full_bytes] ^ rhs.blocks()[full_bytes]) & ((1u << remain) - 1)) == 0;
+    }
+
+    // a complemented side flips every stored bit of the difference
+    uint64_t flip = lhs.complemented() != rhs.complemented() ? ~uint64_t(0) : 0;
+    size_t size = lhs.size();
+    size_t lhs_n8 = (lhs.offset() + size + 7) >> 3;
+    size_t rhs_n8 = (rhs.offset() + size + 7) >> 3;
+    for (size_t i = 0; i < size; i += 64) {
+        uint64_t diff = kernels::load_bits(lhs.blocks(), lhs_n8, lhs.offset() + i) ^
+                        kernels::load_bits(rhs.blocks(), rhs_n8, rhs.offset() + i) ^ flip;
+        if (size - i < 64) {
+            diff &= (uint64_t(1) << (size - i)) - 1;
+        }
+        if (diff) {
+            return false;
+        }
+    }
+    return true;
 }
 
 bool operator!=(const BitsetView& lhs, const BitsetView& rhs){ 
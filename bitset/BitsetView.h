@@ -18,11 +18,36 @@
 #include <string.h>
 #include <vector>
 
-#include "Bitset.h"
-#include "Bitset2.h"
+#include "BitsetKernels.h"
+#include "HashKernels.h"
 
 namespace faiss {
 
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+class BasicBitset;
+
+template <size_t N>
+class FixedBitset;
+
+// How two bitsets of the same size relate as sets, from compare(): the
+// first of these that holds.
+enum class BitsetRelation {
+    EQUAL,
+    SUBSET,    // proper subset of the other
+    SUPERSET,  // proper superset
+    DISJOINT,  // no common bit, and each has bits the other lacks
+    OVERLAP,   // some common bits, and each has bits the other lacks
+};
+
+// A count of 1-bits from estimate_count(): the true count lies in
+// [lower, upper] with the confidence asked for, and is count if exact.
+struct CountEstimate {
+    size_t count = 0;
+    size_t lower = 0;
+    size_t upper = 0;
+    bool exact = false;
+};
+
 class BitsetView {
 
  friend
@@ -40,22 +65,20 @@ class BitsetView {
     BitsetView(const uint8_t* blocks, int64_t size) : blocks_(blocks), size_(size) {
     }
 
-    explicit BitsetView(const ConcurrentBitset& bitset) : blocks_(bitset.data()), size_(bitset.size()) {
+    template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+    explicit BitsetView(const BasicBitset<WordT, ConcurrencyPolicy, Allocator>& bitset)
+    : blocks_(bitset.data()), size_(bitset.size()) {
     }
 
-    BitsetView(const ConcurrentBitsetPtr& bitset_ptr) {
+    template <typename WordT, typename ConcurrencyPolicy, typename Allocator>
+    BitsetView(const std::shared_ptr<BasicBitset<WordT, ConcurrencyPolicy, Allocator>>& bitset_ptr) {
         if (bitset_ptr) {
             *this = BitsetView(*bitset_ptr);
         }
     }
 
-    explicit BitsetView(const ConcurrentBitset2& bitset) : blocks_(bitset.data()), size_(bitset.size()) {
-    }
-
-    BitsetView(const ConcurrentBitset2Ptr& bitset_ptr) {
-        if (bitset_ptr) {
-            *this = BitsetView(*bitset_ptr);
-        }
+    template <size_t N>
+    explicit BitsetView(const FixedBitset<N>& bitset) : blocks_(bitset.data()), size_(bitset.size()) {
     }
 
     BitsetView(const std::nullptr_t nullptr_value): BitsetView() {
@@ -77,23 +100,198 @@ class BitsetView {
     size_t
     byte_size() const;
 
+    // the viewed bytes; only for views starting on a byte boundary and not
+    // complemented, see offset() and complemented()
     const uint8_t*
     data() const;
 
     uint8_t*
     mutable_data();
 
+    // this view when data() holds its bits as they read, else a view of
+    // them lined up (and negated if complemented) into scratch by
+    // extract_into; for code reading the raw bytes. The result lives as
+    // long as scratch and the viewed buffer.
+    BitsetView
+    lined_up(std::vector<uint8_t>& scratch) const;
+
+    // A subview may start inside a byte: bit i of the view is bit
+    // offset() + i of blocks(), offset() < 8. Every operation of the view
+    // and the binary operations of BasicBitset with a view handle this;
+    // code reading data() directly needs offset() == 0.
+    inline size_t
+    offset() const {
+        return offset_;
+    }
+
+    inline const uint8_t*
+    blocks() const {
+        return blocks_;
+    }
+
+    // A complemented view reads as the negation of its bits, without
+    // touching them: test, count, for_each and every operation of the view
+    // or of BasicBitset with it see ~blocks(), and binary kernels fold the
+    // negation into their operator, so a & ~b runs as one and-not pass.
+    // Bits past size() still read as 0. Writes through a complemented view
+    // store the complement of the result.
+    inline bool
+    complemented() const {
+        return complement_;
+    }
+
+    BitsetView
+    operator~() const;
+
+    // zero-copy view of bits [bit_offset, bit_offset + bit_len), complemented
+    // if this view is
+    BitsetView
+    subview(size_t bit_offset, size_t bit_len) const;
+
+    // call func(i) for every 1-bit, in increasing order
+    template <typename Func>
+    void
+    for_each(Func func) const;
+
     bool
     test(int64_t index) const;
 
+    // Count of 1-bits estimated from a sample of 64-byte blocks: the blocks
+    // are split into equal strata and one block at a fixed pseudo-random
+    // place is counted in each, enough of them that the estimate is within
+    // error * size() of count() with probability confidence (Hoeffding).
+    // The sample is deterministic, so repeated calls agree; the bound holds
+    // unless the bits line up with the sampled places. Counts exactly when
+    // sampling would read about as much.
+    CountEstimate
+    estimate_count(double error = 0.02, double confidence = 0.95) const;
+
+    // Hash of the bits and the size, for keying caches by content: equal
+    // views hash equal whatever their offset or complement. Runs at about
+    // memory bandwidth (kernels::hash_bits); views starting inside a byte
+    // or complemented are lined up a chunk at a time first.
+    Hash128
+    hash128() const;
+
+    inline uint64_t
+    hash64() const {
+        return hash128().low;
+    }
+
+    // kernels::fingerprint_bits of the view's bits; what
+    // BasicBitset::fingerprint() keeps up to date under set/clear
+    uint64_t
+    fingerprint() const;
+
+    // Set relations with a view of the same size, computed without
+    // materializing an intersection or difference; each stops at the first
+    // block that decides it.
+    bool
+    intersects(const BitsetView& view) const;
+
+    bool
+    is_disjoint(const BitsetView& view) const;
+
+    // every bit of *this is set in view
+    bool
+    is_subset_of(const BitsetView& view) const;
+
+    BitsetRelation
+    compare(const BitsetView& view) const;
+
+    // in-place ops write through to the viewed buffer
+    BitsetView&
+    operator&=(const BitsetView& view);
+
+    BitsetView&
+    operator|=(const BitsetView& view);
+
+    BitsetView&
+    operator^=(const BitsetView& view);
+
+    BitsetView&
+    operator-=(const BitsetView& view);
+
+    inline BitsetView&
+    andnot(const BitsetView& view) {
+        return *this -= view;
+    }
+
+    // dst = *this ^ view, dst = *this & ~view, over byte_size() bytes
+    void
+    xor_into(const BitsetView& view, uint8_t* dst) const;
+
+    void
+    andnot_into(const BitsetView& view, uint8_t* dst) const;
+
+    // shifts as on BasicBitset, written through to the viewed buffer
+    BitsetView&
+    operator<<=(size_t n);
+
+    BitsetView&
+    operator>>=(size_t n);
+
+    // the same shifts into dst, over byte_size() bytes
+    void
+    shift_left_into(size_t n, uint8_t* dst) const;
+
+    void
+    shift_right_into(size_t n, uint8_t* dst) const;
+
+    // dst = bits [offset, offset + length), over (length + 7) / 8 bytes;
+    // bits past size() read as 0
+    void
+    extract_into(size_t offset, size_t length, uint8_t* dst) const;
+
     operator bool() const;
     operator std::string() const;
 
+ private:
+    BitsetView(const uint8_t* blocks, size_t size, size_t offset) : blocks_(blocks), size_(size), offset_(offset) {
+    }
+
+    // dst bits [offset_, offset_ + size_) op= view, as a write-through
+    template <typename Op>
+    void
+    binary_assign(const BitsetView& view);
+
+    // dst = *this op view, over byte_size() bytes
+    template <typename Op>
+    void
+    binary_into(const BitsetView& view, uint8_t* dst) const;
+
  private:
     const uint8_t* blocks_ = nullptr;
-    size_t size_ = 0;  // count of bits
+    size_t size_ = 0;    // count of bits
+    size_t offset_ = 0;  // bit 0 within blocks_[0]
+    bool complement_ = false;
 };
 
+template <typename Func>
+void
+BitsetView::for_each(Func func) const {
+    size_t n8 = (offset_ + size_ + 7) >> 3;
+    size_t n_words = (size_ + 63) >> 6;
+    for (size_t w = 0; w < n_words; w++) {
+        uint64_t word = kernels::load_bits(blocks_, n8, offset_ + w * 64);
+        if (complement_) {
+            word = ~word;
+        }
+        if (size_ - w * 64 < 64) {
+            word &= (uint64_t(1) << (size_ - w * 64)) - 1;
+        }
+        while (word) {
+            func(int64_t((w << 6) | __builtin_ctzll(word)));
+            word &= word - 1;
+        }
+    }
+}
+
+// estimate_count of lhs & rhs (of the same size), sampling the same
+// blocks of both without materializing the intersection
+CountEstimate
+estimate_count_and(const BitsetView& lhs, const BitsetView& rhs, double error = 0.02, double confidence = 0.95);
+
 bool operator==(const BitsetView& lhs, const BitsetView& rhs);
 bool operator!=(const BitsetView& lhs, const BitsetView& rhs);
 std::ostream& operator<<(std::ostream& os, const BitsetView& view);
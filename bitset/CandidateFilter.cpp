@@ -0,0 +1,213 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "CandidateFilter.h"
+
+namespace faiss {
+
+namespace {
+
+// with complement, the bitset reads as the negation of blocks: a candidate
+// is kept where its stored bit is set
+inline bool
+keep_candidate(const uint8_t* blocks, size_t size, bool complement, int64_t id) {
+    if (id < 0) {
+        return false;
+    }
+    if (uint64_t(id) >= size) {
+        return true;
+    }
+    return bool((blocks[id >> 3] >> (id & 0x7)) & 0x1) == complement;
+}
+
+size_t
+filter_scalar(const uint8_t* blocks, size_t size, bool complement, int64_t* ids, float* distances, size_t begin,
+              size_t out, size_t n) {
+    for (size_t i = begin; i < n; i++) {
+        if (keep_candidate(blocks, size, complement, ids[i])) {
+            ids[out] = ids[i];
+            distances[out] = distances[i];
+            out++;
+        }
+    }
+    return out;
+}
+
+// for views starting inside a byte, a bit at a time through
+// BitsetView::test
+size_t
+filter_view(const BitsetView& bitset, int64_t* ids, float* distances, size_t n) {
+    size_t out = 0;
+    for (size_t i = 0; i < n; i++) {
+        int64_t id = ids[i];
+        if (id >= 0 && (uint64_t(id) >= bitset.size() || !bitset.test(id))) {
+            ids[out] = id;
+            distances[out] = distances[i];
+            out++;
+        }
+    }
+    return out;
+}
+
+// Ids below this bound have the whole aligned 32-bit word holding their bit
+// inside the bitset buffer, so it can be gathered without reading past the
+// end. Ids in [bound, size) take the scalar path.
+inline int64_t
+gather_limit(size_t size) {
+    size_t n8 = (size + 8 - 1) >> 3;
+    return int64_t((n8 >> 2) << 5);
+}
+
+// The vector loops store a full vector of survivors at ids + out. Since
+// out <= i, that only overwrites candidates already loaded.
+
+#if defined(__x86_64__)
+
+BITSET_TARGET_AVX512 size_t
+filter_avx512(const uint8_t* blocks, size_t size, bool complement, int64_t* ids, float* distances, size_t n) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i limit = _mm512_set1_epi64(gather_limit(size));
+    const __m512i size_v = _mm512_set1_epi64(int64_t(size));
+    const __m512i low5 = _mm512_set1_epi64(31);
+    const __m512i one = _mm512_set1_epi64(1);
+    const __mmask8 flip = complement ? 0xff : 0;
+
+    size_t out = 0, i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i id = _mm512_loadu_si512(ids + i);
+        __m256 dist = _mm256_loadu_ps(distances + i);
+
+        __mmask8 nonneg = _mm512_cmpge_epi64_mask(id, zero);
+        __mmask8 gathered = nonneg & _mm512_cmplt_epi64_mask(id, limit);
+        __mmask8 uncovered = nonneg & _mm512_cmpge_epi64_mask(id, size_v);
+        __mmask8 keep = 0;
+        if ((nonneg & ~gathered & ~uncovered) == 0) {
+            __m256i words =
+                _mm512_mask_i64gather_epi32(_mm256_setzero_si256(), gathered, _mm512_srli_epi64(id, 5), blocks, 4);
+            __m512i bits = _mm512_srlv_epi64(_mm512_cvtepu32_epi64(words), _mm512_and_si512(id, low5));
+            __mmask8 filtered = _mm512_test_epi64_mask(bits, one) ^ flip;
+            keep = (gathered & ~filtered) | uncovered;
+        } else {
+            for (int k = 0; k < 8; k++) {
+                keep |= __mmask8(keep_candidate(blocks, size, complement, ids[i + k]) << k);
+            }
+        }
+
+        _mm512_storeu_si512(ids + out, _mm512_maskz_compress_epi64(keep, id));
+        _mm256_storeu_ps(distances + out, _mm256_maskz_compress_ps(keep, dist));
+        out += __builtin_popcount(keep);
+    }
+    return filter_scalar(blocks, size, complement, ids, distances, i, out, n);
+}
+
+// lane permutations moving the lanes selected by a 4-bit mask to the front
+struct CompressTable {
+    int32_t ids[16][8];        // 64-bit lanes as pairs of 32-bit lanes
+    int32_t distances[16][4];
+};
+
+constexpr CompressTable
+make_compress_table() {
+    CompressTable table{};
+    for (int mask = 0; mask < 16; mask++) {
+        int out = 0;
+        for (int lane = 0; lane < 4; lane++) {
+            if (mask & (1 << lane)) {
+                table.ids[mask][2 * out] = 2 * lane;
+                table.ids[mask][2 * out + 1] = 2 * lane + 1;
+                table.distances[mask][out] = lane;
+                out++;
+            }
+        }
+    }
+    return table;
+}
+
+alignas(32) constexpr CompressTable compress_table = make_compress_table();
+
+BITSET_TARGET_AVX2 size_t
+filter_avx2(const uint8_t* blocks, size_t size, bool complement, int64_t* ids, float* distances, size_t n) {
+    const __m256i minus_one = _mm256_set1_epi64x(-1);
+    const __m256i limit = _mm256_set1_epi64x(gather_limit(size));
+    const __m256i last = _mm256_set1_epi64x(int64_t(size) - 1);
+    const __m256i low5 = _mm256_set1_epi64x(31);
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i even_lanes = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    const int flip = complement ? 0xf : 0;
+
+    size_t out = 0, i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i id = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ids + i));
+        __m128 dist = _mm_loadu_ps(distances + i);
+
+        __m256i nonneg_v = _mm256_cmpgt_epi64(id, minus_one);
+        __m256i gathered_v = _mm256_and_si256(nonneg_v, _mm256_cmpgt_epi64(limit, id));
+        int nonneg = _mm256_movemask_pd(_mm256_castsi256_pd(nonneg_v));
+        int gathered = _mm256_movemask_pd(_mm256_castsi256_pd(gathered_v));
+        int uncovered = nonneg & _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(id, last)));
+        int keep = 0;
+        if ((nonneg & ~gathered & ~uncovered) == 0) {
+            __m128i mask = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(gathered_v, even_lanes));
+            __m128i words = _mm256_mask_i64gather_epi32(_mm_setzero_si128(), reinterpret_cast<const int*>(blocks),
+                                                        _mm256_srli_epi64(id, 5), mask, 4);
+            __m256i bits = _mm256_srlv_epi64(_mm256_cvtepu32_epi64(words), _mm256_and_si256(id, low5));
+            __m256i filtered_v = _mm256_cmpeq_epi64(_mm256_and_si256(bits, one), one);
+            int filtered = _mm256_movemask_pd(_mm256_castsi256_pd(filtered_v)) ^ flip;
+            keep = (gathered & ~filtered) | uncovered;
+        } else {
+            for (int k = 0; k < 4; k++) {
+                keep |= int(keep_candidate(blocks, size, complement, ids[i + k])) << k;
+            }
+        }
+
+        __m256i id_perm = _mm256_load_si256(reinterpret_cast<const __m256i*>(compress_table.ids[keep]));
+        __m128i dist_perm = _mm_load_si128(reinterpret_cast<const __m128i*>(compress_table.distances[keep]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(ids + out), _mm256_permutevar8x32_epi32(id, id_perm));
+        _mm_storeu_ps(distances + out, _mm_permutevar_ps(dist, dist_perm));
+        out += __builtin_popcount(keep);
+    }
+    return filter_scalar(blocks, size, complement, ids, distances, i, out, n);
+}
+
+#endif
+
+}  // namespace
+
+size_t
+filter_candidates(const BitsetView& bitset, int64_t* ids, float* distances, size_t n) {
+    return filter_candidates(bitset, ids, distances, n, simd_level());
+}
+
+size_t
+filter_candidates(const BitsetView& bitset, int64_t* ids, float* distances, size_t n, SimdLevel level) {
+    if (bitset.offset() != 0) {
+        return filter_view(bitset, ids, distances, n);
+    }
+    // a complemented view is filtered on its stored bits, each flipped
+    const uint8_t* blocks = bitset.blocks();
+    size_t size = bitset.size();
+    bool complement = bitset.complemented();
+#if defined(__x86_64__)
+    if (level == SimdLevel::AVX512) {
+        return filter_avx512(blocks, size, complement, ids, distances, n);
+    }
+    if (level == SimdLevel::AVX2) {
+        return filter_avx2(blocks, size, complement, ids, distances, n);
+    }
+#endif
+    return filter_scalar(blocks, size, complement, ids, distances, 0, 0, n);
+}
+
+}  // namespace faiss
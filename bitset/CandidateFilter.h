@@ -0,0 +1,40 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "BitsetView.h"
+#include "Simd.h"
+
+namespace faiss {
+
+// Drop the search candidates whose id is set in bitset and compact the
+// survivors to the front of ids/distances, keeping their order. Negative
+// ids (empty result slots) are dropped; ids at or past bitset.size() are
+// kept, they belong to rows the bitset does not cover. Returns the number
+// of survivors.
+//
+// The AVX-512 path gathers 8 bitset words per step and compacts with
+// vpcompressq/vcompressps; the AVX2 path gathers 4 and compacts through a
+// permutation table. Complemented views ("NOT IN" filters) run on the same
+// kernels with the gathered bit flipped; views starting inside a byte are
+// filtered one test() at a time.
+size_t
+filter_candidates(const BitsetView& bitset, int64_t* ids, float* distances, size_t n);
+
+// same, forcing a kernel; level must be supported by the CPU
+size_t
+filter_candidates(const BitsetView& bitset, int64_t* ids, float* distances, size_t n, SimdLevel level);
+
+}  // namespace faiss
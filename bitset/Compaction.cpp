@@ -0,0 +1,327 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "Compaction.h"
+
+namespace faiss {
+
+namespace {
+
+constexpr size_t CHUNK_WORDS = 1024;
+
+// word w of a buffer of n8 bytes, zero-padded past the end
+inline uint64_t
+load_word(const uint8_t* data, size_t n8, size_t w) {
+    uint64_t word = 0;
+    if (w * 8 + 8 <= n8) {
+        memcpy(&word, data + w * 8, 8);
+    } else {
+        memcpy(&word, data + w * 8, n8 - w * 8);
+    }
+    return word;
+}
+
+// Appends bits to a zeroed buffer from bit begin on. Only this writer
+// touches the bytes strictly inside [begin, end); the two end bytes may be
+// shared with the neighbouring chunks and are OR-ed in atomically.
+class BitWriter {
+ public:
+    BitWriter(uint8_t* out, size_t begin, size_t end)
+    : out_(out), byte_(begin / 8), first_(begin / 8), last_(end ? (end - 1) / 8 : 0), n_acc_(begin % 8) {
+    }
+
+    // count <= 32
+    inline void
+    put(uint64_t bits, size_t count) {
+        acc_ |= bits << n_acc_;
+        n_acc_ += count;
+        while (n_acc_ >= 8) {
+            write(uint8_t(acc_));
+            acc_ >>= 8;
+            n_acc_ -= 8;
+        }
+    }
+
+    inline void
+    put64(uint64_t bits, size_t count) {
+        put(bits & 0xffffffff, std::min<size_t>(count, 32));
+        if (count > 32) {
+            put(bits >> 32, count - 32);
+        }
+    }
+
+    inline void
+    finish() {
+        if (n_acc_) {
+            write(uint8_t(acc_));
+        }
+    }
+
+ private:
+    inline void
+    write(uint8_t byte) {
+        if (byte_ == first_ || byte_ == last_) {
+            __atomic_fetch_or(out_ + byte_, byte, __ATOMIC_RELAXED);
+        } else {
+            out_[byte_] = byte;
+        }
+        byte_++;
+    }
+
+ private:
+    uint8_t* out_;
+    size_t byte_;
+    size_t first_;
+    size_t last_;
+    uint64_t acc_ = 0;
+    size_t n_acc_;
+};
+
+struct Chunk {
+    const uint8_t* deleted;
+    const uint8_t* filter;  // null without a filter
+    size_t size;            // rows
+    size_t n8;
+    size_t begin_word;
+    size_t end_word;
+    int64_t base;  // first new offset of the chunk
+};
+
+// surviving rows of word w
+inline uint64_t
+live_word(const Chunk& c, size_t w) {
+    uint64_t live = ~load_word(c.deleted, c.n8, w);
+    size_t remain = c.size - w * 64;
+    return remain >= 64 ? live : live & ((uint64_t(1) << remain) - 1);
+}
+
+// decode word w from row offset k on; returns the new k
+inline int64_t
+decode_word_scalar(const Chunk& c, size_t w, uint64_t live, int64_t k, CompactionRemap& out) {
+    int64_t* remap = out.remap.data() + w * 64;
+    size_t rows = std::min<size_t>(64, c.size - w * 64);
+    for (size_t b = 0; b < rows; b++) {
+        int64_t bit = (live >> b) & 0x1;
+        remap[b] = bit ? k : -1;
+        k += bit;
+    }
+    int64_t* survivors = out.survivors.data();
+    int64_t s = k - __builtin_popcountll(live);
+    for (uint64_t l = live; l; l &= l - 1) {
+        survivors[s++] = int64_t(w * 64 + __builtin_ctzll(l));
+    }
+    return k;
+}
+
+// the filter bits of the rows in live, packed
+inline uint64_t
+pack_scalar(uint64_t filter, uint64_t live) {
+    uint64_t packed = 0;
+    size_t n = 0;
+    for (uint64_t l = live; l; l &= l - 1) {
+        packed |= ((filter >> __builtin_ctzll(l)) & 0x1) << n++;
+    }
+    return packed;
+}
+
+void
+decode_chunk_scalar(const Chunk& c, CompactionRemap& out, BitWriter* writer) {
+    int64_t k = c.base;
+    for (size_t w = c.begin_word; w < c.end_word; w++) {
+        uint64_t live = live_word(c, w);
+        k = decode_word_scalar(c, w, live, k, out);
+        if (writer) {
+            writer->put64(pack_scalar(load_word(c.filter, c.n8, w), live), __builtin_popcountll(live));
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+// For each byte m of a live word: the positions of its set bits, and for
+// each bit b the number of set bits below b; one byte per entry.
+struct ByteTables {
+    uint64_t positions[256];
+    uint64_t prefix[256];
+
+    constexpr ByteTables() : positions(), prefix() {
+        for (size_t m = 0; m < 256; m++) {
+            size_t n = 0;
+            for (size_t b = 0; b < 8; b++) {
+                prefix[m] |= uint64_t(n) << (b * 8);
+                if ((m >> b) & 0x1) {
+                    positions[m] |= uint64_t(b) << (n++ * 8);
+                }
+            }
+        }
+    }
+};
+
+constexpr ByteTables byte_tables;
+
+BITSET_TARGET_AVX2 void
+decode_chunk_avx2(const Chunk& c, CompactionRemap& out, BitWriter* writer) {
+    const __m256i iota = _mm256_setr_epi64x(0, 1, 2, 3);
+    const __m256i four = _mm256_set1_epi64x(4);
+    const __m256i lane_bits = _mm256_setr_epi64x(1, 2, 4, 8);
+    const __m256i minus_one = _mm256_set1_epi64x(-1);
+    int64_t* remap = out.remap.data();
+    int64_t* survivors = out.survivors.data();
+    size_t full_words = c.size / 64;
+
+    int64_t k = c.base;
+    for (size_t w = c.begin_word; w < c.end_word; w++) {
+        uint64_t live = live_word(c, w);
+        if (w >= full_words) {
+            k = decode_word_scalar(c, w, live, k, out);
+        } else {
+            for (size_t g = 0; g < 8; g++) {
+                size_t m = (live >> (g * 8)) & 0xff;
+                __m256i n = _mm256_set1_epi64x(__builtin_popcount(m));
+
+                // survivors: the positions of the set bits, stored up to
+                // the count so that the next chunk's survivors stay untouched
+                __m128i positions = _mm_cvtsi64_si128(int64_t(byte_tables.positions[m]));
+                __m256i base = _mm256_set1_epi64x(int64_t(w * 64 + g * 8));
+                __m256i lo = _mm256_add_epi64(base, _mm256_cvtepu8_epi64(positions));
+                __m256i hi = _mm256_add_epi64(base, _mm256_cvtepu8_epi64(_mm_srli_si128(positions, 4)));
+                _mm256_maskstore_epi64((long long*)(survivors + k), _mm256_cmpgt_epi64(n, iota), lo);
+                _mm256_maskstore_epi64((long long*)(survivors + k + 4),
+                                       _mm256_cmpgt_epi64(n, _mm256_add_epi64(iota, four)), hi);
+
+                // remap: k plus the survivors below each live row, -1 elsewhere
+                __m128i prefix = _mm_cvtsi64_si128(int64_t(byte_tables.prefix[m]));
+                __m256i offsets = _mm256_set1_epi64x(k);
+                __m256i bits = _mm256_set1_epi64x(int64_t(m));
+                __m256i live_lo = _mm256_cmpeq_epi64(_mm256_and_si256(bits, lane_bits), lane_bits);
+                __m256i live_hi = _mm256_cmpeq_epi64(
+                    _mm256_and_si256(_mm256_srli_epi64(bits, 4), lane_bits), lane_bits);
+                lo = _mm256_add_epi64(offsets, _mm256_cvtepu8_epi64(prefix));
+                hi = _mm256_add_epi64(offsets, _mm256_cvtepu8_epi64(_mm_srli_si128(prefix, 4)));
+                _mm256_storeu_si256((__m256i*)(remap + w * 64 + g * 8), _mm256_blendv_epi8(minus_one, lo, live_lo));
+                _mm256_storeu_si256((__m256i*)(remap + w * 64 + g * 8 + 4),
+                                    _mm256_blendv_epi8(minus_one, hi, live_hi));
+                k += __builtin_popcount(m);
+            }
+        }
+        if (writer) {
+            writer->put64(pack_scalar(load_word(c.filter, c.n8, w), live), __builtin_popcountll(live));
+        }
+    }
+}
+
+BITSET_TARGET_AVX512 void
+decode_chunk_avx512(const Chunk& c, CompactionRemap& out, BitWriter* writer) {
+    const __m512i iota = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m512i minus_one = _mm512_set1_epi64(-1);
+    int64_t* remap = out.remap.data();
+    int64_t* survivors = out.survivors.data();
+    size_t full_words = c.size / 64;
+
+    int64_t k = c.base;
+    for (size_t w = c.begin_word; w < c.end_word; w++) {
+        uint64_t live = live_word(c, w);
+        if (w >= full_words) {
+            k = decode_word_scalar(c, w, live, k, out);
+        } else {
+            for (size_t g = 0; g < 8; g++) {
+                __mmask8 m = __mmask8(live >> (g * 8));
+                __m512i ids = _mm512_add_epi64(iota, _mm512_set1_epi64(int64_t(w * 64 + g * 8)));
+                _mm512_mask_compressstoreu_epi64(survivors + k, m, ids);
+                __m512i offsets = _mm512_add_epi64(iota, _mm512_set1_epi64(k));
+                _mm512_storeu_si512(remap + w * 64 + g * 8, _mm512_mask_expand_epi64(minus_one, m, offsets));
+                k += __builtin_popcount(m);
+            }
+        }
+        if (writer) {
+            writer->put64(_pext_u64(load_word(c.filter, c.n8, w), live), __builtin_popcountll(live));
+        }
+    }
+}
+
+#endif
+
+}  // namespace
+
+size_t
+compaction_remap(const BitsetView& deleted_view, CompactionRemap& out, const BitsetView& filter_view, bool parallel,
+                 SimdLevel level) {
+    // the chunks read whole words, so subviews and complemented views are
+    // lined up first
+    std::vector<uint8_t> deleted_scratch, filter_scratch;
+    auto deleted = deleted_view.lined_up(deleted_scratch);
+    auto filter = filter_view.lined_up(filter_scratch);
+    size_t size = deleted.size();
+    size_t n8 = (size + 8 - 1) >> 3;
+    size_t n_words = (size + 64 - 1) / 64;
+    size_t n_chunks = (n_words + CHUNK_WORDS - 1) / CHUNK_WORDS;
+    assert(filter.empty() || filter.size() >= size);
+
+    std::vector<Chunk> chunks(n_chunks);
+    for (size_t i = 0; i < n_chunks; i++) {
+        chunks[i] = Chunk{deleted.data(), filter.empty() ? nullptr : filter.data(), size, n8, i * CHUNK_WORDS,
+                          std::min((i + 1) * CHUNK_WORDS, n_words), 0};
+    }
+
+    // pass 1: survivors per chunk
+    std::vector<int64_t> counts(n_chunks);
+#pragma omp parallel for if (parallel)
+    for (int64_t i = 0; i < int64_t(n_chunks); i++) {
+        int64_t n = 0;
+        for (size_t w = chunks[i].begin_word; w < chunks[i].end_word; w++) {
+            n += __builtin_popcountll(live_word(chunks[i], w));
+        }
+        counts[i] = n;
+    }
+    int64_t total = 0;
+    for (size_t i = 0; i < n_chunks; i++) {
+        chunks[i].base = total;
+        total += counts[i];
+    }
+
+    out.remap.resize(size);
+    out.survivors.resize(total);
+    out.filter = filter.empty() ? nullptr : std::make_shared<ConcurrentBitset2>(total);
+    uint8_t* filter_out = out.filter ? out.filter->mutable_data() : nullptr;
+
+    // pass 2: decode every chunk from its first new offset
+#pragma omp parallel for if (parallel)
+    for (int64_t i = 0; i < int64_t(n_chunks); i++) {
+        auto& c = chunks[i];
+        BitWriter writer(filter_out, c.base, c.base + counts[i]);
+        BitWriter* w = filter_out ? &writer : nullptr;
+#if defined(__x86_64__)
+        if (level == SimdLevel::AVX512) {
+            decode_chunk_avx512(c, out, w);
+        } else if (level == SimdLevel::AVX2) {
+            decode_chunk_avx2(c, out, w);
+        } else {
+            decode_chunk_scalar(c, out, w);
+        }
+#else
+        decode_chunk_scalar(c, out, w);
+#endif
+        if (w) {
+            w->finish();
+        }
+    }
+    return size_t(total);
+}
+
+}  // namespace faiss
@@ -0,0 +1,46 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Bitset2.h"
+#include "BitsetView.h"
+#include "Simd.h"
+
+namespace faiss {
+
+// Offsets for compacting a segment of deleted.size() rows, dropping the
+// rows set in deleted.
+struct CompactionRemap {
+    std::vector<int64_t> remap;      // old offset -> new offset, -1 if deleted
+    std::vector<int64_t> survivors;  // new offset -> old offset
+    ConcurrentBitset2Ptr filter;     // the filter in the new id space, if one was given
+};
+
+// Fill out and return the number of survivors. The rows are split into
+// chunks of 64K: a first pass counts the survivors of each chunk, a prefix
+// sum gives each chunk its first new offset, and a second pass decodes the
+// chunk word by word (AVX-512: vpcompressq for survivors, vpexpandq for the
+// remap, pext for the filter; AVX2: per-byte tables of the set bits and of
+// their prefix counts, masked stores for survivors). With parallel, the
+// chunks of both passes are spread over OpenMP threads.
+//
+// If filter is not empty it must cover deleted.size() rows; its bits of
+// the surviving rows are packed into out.filter in the same pass.
+size_t
+compaction_remap(const BitsetView& deleted, CompactionRemap& out, const BitsetView& filter = BitsetView(),
+                 bool parallel = false, SimdLevel level = simd_level());
+
+}  // namespace faiss
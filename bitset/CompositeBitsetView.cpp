@@ -0,0 +1,116 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#include <algorithm>
+#include <cassert>
+
+#include "CompositeBitsetView.h"
+
+namespace faiss {
+
+CompositeBitsetView::CompositeBitsetView(const std::vector<BitsetView>& segments) {
+    for (auto& segment : segments) {
+        append(segment);
+    }
+}
+
+void
+CompositeBitsetView::append(const BitsetView& segment, int64_t base) {
+    assert(base >= int64_t(size()));
+    segments_.push_back(segment);
+    bases_.push_back(base);
+}
+
+void
+CompositeBitsetView::append(const BitsetView& segment) {
+    append(segment, int64_t(size()));
+}
+
+size_t
+CompositeBitsetView::find(int64_t id) const {
+    auto it = std::upper_bound(bases_.begin(), bases_.end(), id);
+    if (it == bases_.begin()) {
+        return segments_.size();
+    }
+    size_t i = it - bases_.begin() - 1;
+    return size_t(id - bases_[i]) < segments_[i].size() ? i : segments_.size();
+}
+
+bool
+CompositeBitsetView::test(int64_t id) const {
+    size_t i = find(id);
+    return i < segments_.size() && segments_[i].test(id - bases_[i]);
+}
+
+size_t
+CompositeBitsetView::count() const {
+    size_t ret = 0;
+    for (auto& segment : segments_) {
+        ret += segment.count();
+    }
+    return ret;
+}
+
+size_t
+CompositeBitsetView::size() const {
+    return segments_.empty() ? 0 : size_t(bases_.back()) + segments_.back().size();
+}
+
+bool
+CompositeBitsetView::same_layout(const CompositeBitsetView& other) const {
+    if (bases_ != other.bases_) {
+        return false;
+    }
+    for (size_t i = 0; i < segments_.size(); i++) {
+        if (segments_[i].size() != other.segments_[i].size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+CompositeBitsetView&
+CompositeBitsetView::operator&=(const CompositeBitsetView& other) {
+    assert(same_layout(other));
+    for (size_t i = 0; i < segments_.size(); i++) {
+        segments_[i] &= other.segments_[i];
+    }
+    return *this;
+}
+
+CompositeBitsetView&
+CompositeBitsetView::operator|=(const CompositeBitsetView& other) {
+    assert(same_layout(other));
+    for (size_t i = 0; i < segments_.size(); i++) {
+        segments_[i] |= other.segments_[i];
+    }
+    return *this;
+}
+
+CompositeBitsetView&
+CompositeBitsetView::operator^=(const CompositeBitsetView& other) {
+    assert(same_layout(other));
+    for (size_t i = 0; i < segments_.size(); i++) {
+        segments_[i] ^= other.segments_[i];
+    }
+    return *this;
+}
+
+CompositeBitsetView&
+CompositeBitsetView::operator-=(const CompositeBitsetView& other) {
+    assert(same_layout(other));
+    for (size_t i = 0; i < segments_.size(); i++) {
+        segments_[i] -= other.segments_[i];
+    }
+    return *this;
+}
+
+}  // namespace faiss
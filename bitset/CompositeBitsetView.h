@@ -0,0 +1,116 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "BitsetView.h"
+
+namespace faiss {
+
+// One logical bitset stitched from per-segment views, e.g. the deletion
+// masks of a collection's segments: segment i covers the global ids
+// [base(i), base(i) + segment(i).size()). Segments are kept in base order
+// and do not overlap; ids in gaps between them read as 0. Nothing is
+// copied, so the viewed bitsets must outlive the composite, and writes
+// through it land in them.
+class CompositeBitsetView {
+ public:
+    CompositeBitsetView() = default;
+
+    // segments laid end to end from id 0
+    explicit CompositeBitsetView(const std::vector<BitsetView>& segments);
+
+    // add a segment at base, which must not be below size()
+    void
+    append(const BitsetView& segment, int64_t base);
+
+    // add a segment right after the last one
+    void
+    append(const BitsetView& segment);
+
+    inline size_t
+    segment_count() const {
+        return segments_.size();
+    }
+
+    inline const BitsetView&
+    segment(size_t i) const {
+        return segments_[i];
+    }
+
+    inline int64_t
+    base(size_t i) const {
+        return bases_[i];
+    }
+
+    // index of the segment holding id, or segment_count() if it is in no
+    // segment; a binary search over the bases
+    size_t
+    find(int64_t id) const;
+
+    bool
+    test(int64_t id) const;
+
+    // count of all 1-bits, summed over the segments
+    size_t
+    count() const;
+
+    // one past the last id covered
+    size_t
+    size() const;
+
+    inline bool
+    empty() const {
+        return segments_.empty();
+    }
+
+    // call func(id) for every 1-bit, with global ids in increasing order
+    template <typename Func>
+    void
+    for_each(Func func) const;
+
+    // same segment count, bases and segment sizes
+    bool
+    same_layout(const CompositeBitsetView& other) const;
+
+    // segment by segment, written through to the segments of this view;
+    // other must have the same layout
+    CompositeBitsetView&
+    operator&=(const CompositeBitsetView& other);
+
+    CompositeBitsetView&
+    operator|=(const CompositeBitsetView& other);
+
+    CompositeBitsetView&
+    operator^=(const CompositeBitsetView& other);
+
+    CompositeBitsetView&
+    operator-=(const CompositeBitsetView& other);
+
+ private:
+    std::vector<BitsetView> segments_;
+    std::vector<int64_t> bases_;
+};
+
+template <typename Func>
+void
+CompositeBitsetView::for_each(Func func) const {
+    for (size_t i = 0; i < segments_.size(); i++) {
+        int64_t base = bases_[i];
+        segments_[i].for_each([&](int64_t id) { func(base + id); });
+    }
+}
+
+}  // namespace faiss
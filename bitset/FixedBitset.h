@@ -0,0 +1,299 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include "BitsetView.h"
+
+namespace faiss {
+
+// Bitset of N bits known at compile time, stored inline: no allocation and
+// no indirection. Every loop runs over a constant number of 64-bit words and
+// is unrolled through an index_sequence, so a FixedBitset<256> is four
+// instructions per operation. The byte layout matches BasicBitset, and bits
+// past N are kept zero. Binary operators return by value.
+template <size_t N>
+class FixedBitset {
+ public:
+    using id_type_t = int64_t;
+
+    static constexpr size_t word_bits = 64;
+    static constexpr size_t word_count = N == 0 ? 1 : (N + word_bits - 1) / word_bits;
+
+    constexpr FixedBitset() = default;
+
+    // the first N bits of data; the rest of its last byte is dropped
+    explicit FixedBitset(const uint8_t* data) {
+        memcpy(words_, data, byte_size());
+        words_[word_count - 1] &= tail_mask();
+    }
+
+    // copy the first N bits of a view; bits the view does not have stay 0
+    explicit FixedBitset(const BitsetView& view) {
+        view.extract_into(0, std::min(N, view.size()), reinterpret_cast<uint8_t*>(words_));
+    }
+
+    constexpr FixedBitset&
+    operator&=(const FixedBitset& bitset) {
+        apply([](uint64_t& l, uint64_t r) { l &= r; }, bitset, std::make_index_sequence<word_count>{});
+        return *this;
+    }
+
+    FixedBitset&
+    operator&=(const BitsetView& view) {
+        return *this &= FixedBitset(view);
+    }
+
+    constexpr FixedBitset
+    operator&(const FixedBitset& bitset) const {
+        FixedBitset result(*this);
+        result &= bitset;
+        return result;
+    }
+
+    FixedBitset
+    operator&(const BitsetView& view) const {
+        FixedBitset result(*this);
+        result &= view;
+        return result;
+    }
+
+    constexpr FixedBitset&
+    operator|=(const FixedBitset& bitset) {
+        apply([](uint64_t& l, uint64_t r) { l |= r; }, bitset, std::make_index_sequence<word_count>{});
+        return *this;
+    }
+
+    FixedBitset&
+    operator|=(const BitsetView& view) {
+        return *this |= FixedBitset(view);
+    }
+
+    constexpr FixedBitset
+    operator|(const FixedBitset& bitset) const {
+        FixedBitset result(*this);
+        result |= bitset;
+        return result;
+    }
+
+    FixedBitset
+    operator|(const BitsetView& view) const {
+        FixedBitset result(*this);
+        result |= view;
+        return result;
+    }
+
+    constexpr FixedBitset&
+    operator^=(const FixedBitset& bitset) {
+        apply([](uint64_t& l, uint64_t r) { l ^= r; }, bitset, std::make_index_sequence<word_count>{});
+        return *this;
+    }
+
+    FixedBitset&
+    operator^=(const BitsetView& view) {
+        return *this ^= FixedBitset(view);
+    }
+
+    constexpr FixedBitset
+    operator^(const FixedBitset& bitset) const {
+        FixedBitset result(*this);
+        result ^= bitset;
+        return result;
+    }
+
+    FixedBitset
+    operator^(const BitsetView& view) const {
+        FixedBitset result(*this);
+        result ^= view;
+        return result;
+    }
+
+    // andnot: clear the bits that are set in the operand
+    constexpr FixedBitset&
+    operator-=(const FixedBitset& bitset) {
+        apply([](uint64_t& l, uint64_t r) { l &= ~r; }, bitset, std::make_index_sequence<word_count>{});
+        return *this;
+    }
+
+    FixedBitset&
+    operator-=(const BitsetView& view) {
+        return *this -= FixedBitset(view);
+    }
+
+    constexpr FixedBitset
+    operator-(const FixedBitset& bitset) const {
+        FixedBitset result(*this);
+        result -= bitset;
+        return result;
+    }
+
+    FixedBitset
+    operator-(const BitsetView& view) const {
+        FixedBitset result(*this);
+        result -= view;
+        return result;
+    }
+
+    constexpr FixedBitset&
+    andnot(const FixedBitset& bitset) {
+        return *this -= bitset;
+    }
+
+    FixedBitset&
+    andnot(const BitsetView& view) {
+        return *this -= view;
+    }
+
+    // dst = *this & ~operand, without touching *this; dst may be *this
+    constexpr void
+    andnot_into(const FixedBitset& bitset, FixedBitset& dst) const {
+        dst.assign([](uint64_t l, uint64_t r) { return l & ~r; }, *this, bitset,
+                   std::make_index_sequence<word_count>{});
+    }
+
+    void
+    andnot_into(const BitsetView& view, FixedBitset& dst) const {
+        andnot_into(FixedBitset(view), dst);
+    }
+
+    constexpr FixedBitset&
+    negate() {
+        apply([](uint64_t& l, uint64_t) { l = ~l; }, *this, std::make_index_sequence<word_count>{});
+        words_[word_count - 1] &= tail_mask();
+        return *this;
+    }
+
+    constexpr bool
+    test(id_type_t id) const {
+        return (words_[id >> 6] >> (id & 0x3f)) & 0x1;
+    }
+
+    constexpr void
+    set(id_type_t id) {
+        words_[id >> 6] |= uint64_t(1) << (id & 0x3f);
+    }
+
+    // todo rename to reset
+    constexpr void
+    clear(id_type_t id) {
+        words_[id >> 6] &= ~(uint64_t(1) << (id & 0x3f));
+    }
+
+    constexpr bool
+    empty() const {
+        return N == 0;
+    }
+
+    constexpr size_t
+    count() const {
+        return popcount(std::make_index_sequence<word_count>{});
+    }
+
+    constexpr size_t
+    size() const {
+        return N;
+    }
+
+    // BitsetView::hash128 of the bits
+    inline Hash128
+    hash128() const {
+        return kernels::hash_bits(data(), N);
+    }
+
+    inline uint64_t
+    hash64() const {
+        return hash128().low;
+    }
+
+    constexpr size_t
+    byte_size() const {
+        return (N + 8 - 1) >> 3;
+    }
+
+    const uint8_t*
+    data() const {
+        return reinterpret_cast<const uint8_t*>(words_);
+    }
+
+    uint8_t*
+    mutable_data() {
+        return reinterpret_cast<uint8_t*>(words_);
+    }
+
+    constexpr bool
+    operator==(const FixedBitset& rhs) const {
+        return equal(rhs, std::make_index_sequence<word_count>{});
+    }
+
+    constexpr bool
+    operator!=(const FixedBitset& rhs) const {
+        return !(*this == rhs);
+    }
+
+    operator std::string() const {
+        std::string s(N, '0');
+        for (size_t i = 0; i < N; ++i) {
+            if (test(id_type_t(i)))
+                s[N - 1 - i] = '1';
+        }
+        return s;
+    }
+
+ private:
+    static constexpr uint64_t
+    tail_mask() {
+        return N % word_bits == 0 ? ~uint64_t(0) : (uint64_t(1) << (N % word_bits)) - 1;
+    }
+
+    template <typename Op, size_t... I>
+    constexpr void
+    apply(Op op, const FixedBitset& rhs, std::index_sequence<I...>) {
+        (op(words_[I], rhs.words_[I]), ...);
+    }
+
+    // word by word, so lhs or rhs may be *this
+    template <typename Op, size_t... I>
+    constexpr void
+    assign(Op op, const FixedBitset& lhs, const FixedBitset& rhs, std::index_sequence<I...>) {
+        ((words_[I] = op(lhs.words_[I], rhs.words_[I])), ...);
+    }
+
+    template <size_t... I>
+    constexpr size_t
+    popcount(std::index_sequence<I...>) const {
+        return (size_t(__builtin_popcountll(words_[I])) + ...);
+    }
+
+    template <size_t... I>
+    constexpr bool
+    equal(const FixedBitset& rhs, std::index_sequence<I...>) const {
+        return ((words_[I] == rhs.words_[I]) && ...);
+    }
+
+ private:
+    alignas(word_count * 8 >= 64 ? 64 : 8) uint64_t words_[word_count] = {};
+};
+
+template <size_t N>
+std::ostream&
+operator<<(std::ostream& os, const FixedBitset<N>& bitset) {
+    os << std::string(bitset);
+    return os;
+}
+
+}  // namespace faiss
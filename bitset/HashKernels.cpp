@@ -0,0 +1,188 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <cstring>
+
+#include "BitsetKernels.h"
+#include "HashKernels.h"
+
+#define BITSET_TARGET_PCLMUL __attribute__((target("pclmul")))
+
+namespace faiss {
+namespace kernels {
+
+namespace {
+
+constexpr uint64_t KEY_STEP = 0x9fb21c651e98df25ull;
+constexpr uint64_t SEED_LOW = 0x165667b19e3779f9ull;
+constexpr uint64_t SEED_HIGH = 0xc2b2ae3d27d4eb4full;
+
+inline void
+accumulate_scalar(uint64_t* acc, uint64_t* key, const uint8_t* p, size_t n_stripes) {
+    for (size_t s = 0; s < n_stripes; s++, p += 64) {
+        uint64_t words[8];
+        for (size_t i = 0; i < 8; i++) {
+            words[i] = load_u64(p + i * 8);
+        }
+        for (size_t i = 0; i < 8; i++) {
+            uint64_t keyed = words[i] ^ key[i];
+            acc[i] += words[i ^ 1] + (keyed & 0xffffffff) * (keyed >> 32);
+            key[i] += KEY_STEP;
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+BITSET_TARGET_AVX512 void
+accumulate_avx512(uint64_t* acc, uint64_t* key, const uint8_t* p, size_t n_stripes) {
+    __m512i a = _mm512_loadu_si512(acc);
+    __m512i k = _mm512_loadu_si512(key);
+    const __m512i step = _mm512_set1_epi64(int64_t(KEY_STEP));
+    for (size_t s = 0; s < n_stripes; s++, p += 64) {
+        __m512i words = _mm512_loadu_si512(p);
+        __m512i keyed = _mm512_xor_si512(words, k);
+        a = _mm512_add_epi64(a, _mm512_shuffle_epi32(words, _MM_PERM_BADC));
+        a = _mm512_add_epi64(a, _mm512_mul_epu32(keyed, _mm512_srli_epi64(keyed, 32)));
+        k = _mm512_add_epi64(k, step);
+    }
+    _mm512_storeu_si512(acc, a);
+    _mm512_storeu_si512(key, k);
+}
+
+BITSET_TARGET_AVX2 void
+accumulate_avx2(uint64_t* acc, uint64_t* key, const uint8_t* p, size_t n_stripes) {
+    auto* acc_v = reinterpret_cast<__m256i*>(acc);
+    auto* key_v = reinterpret_cast<__m256i*>(key);
+    __m256i a0 = _mm256_loadu_si256(acc_v);
+    __m256i a1 = _mm256_loadu_si256(acc_v + 1);
+    __m256i k0 = _mm256_loadu_si256(key_v);
+    __m256i k1 = _mm256_loadu_si256(key_v + 1);
+    const __m256i step = _mm256_set1_epi64x(int64_t(KEY_STEP));
+    for (size_t s = 0; s < n_stripes; s++, p += 64) {
+        __m256i w0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i w1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+        __m256i keyed0 = _mm256_xor_si256(w0, k0);
+        __m256i keyed1 = _mm256_xor_si256(w1, k1);
+        a0 = _mm256_add_epi64(a0, _mm256_shuffle_epi32(w0, _MM_SHUFFLE(1, 0, 3, 2)));
+        a1 = _mm256_add_epi64(a1, _mm256_shuffle_epi32(w1, _MM_SHUFFLE(1, 0, 3, 2)));
+        a0 = _mm256_add_epi64(a0, _mm256_mul_epu32(keyed0, _mm256_srli_epi64(keyed0, 32)));
+        a1 = _mm256_add_epi64(a1, _mm256_mul_epu32(keyed1, _mm256_srli_epi64(keyed1, 32)));
+        k0 = _mm256_add_epi64(k0, step);
+        k1 = _mm256_add_epi64(k1, step);
+    }
+    _mm256_storeu_si256(acc_v, a0);
+    _mm256_storeu_si256(acc_v + 1, a1);
+    _mm256_storeu_si256(key_v, k0);
+    _mm256_storeu_si256(key_v + 1, k1);
+}
+
+BITSET_TARGET_PCLMUL uint64_t
+fingerprint_pclmul(const uint8_t* data, size_t n_words) {
+    uint64_t ret = 0;
+    for (size_t w = 0; w < n_words; w++) {
+        uint64_t bits = load_u64(data + w * 8);
+        if (bits) {
+            __m128i product = _mm_clmulepi64_si128(_mm_cvtsi64_si128(int64_t(bits)),
+                                                   _mm_cvtsi64_si128(int64_t(fingerprint_key(w))), 0);
+            ret ^= uint64_t(_mm_cvtsi128_si64(product)) ^
+                   uint64_t(_mm_cvtsi128_si64(_mm_unpackhi_epi64(product, product)));
+        }
+    }
+    return ret;
+}
+
+#endif
+
+}  // namespace
+
+BitsHasher::BitsHasher() {
+    for (size_t i = 0; i < 8; i++) {
+        acc_[i] = 0;
+        key_[i] = mix64(SEED_LOW + i);
+    }
+}
+
+void
+BitsHasher::update(const uint8_t* stripes, size_t n_stripes, SimdLevel level) {
+#if defined(__x86_64__)
+    if (level == SimdLevel::AVX512) {
+        accumulate_avx512(acc_, key_, stripes, n_stripes);
+        return;
+    } else if (level == SimdLevel::AVX2) {
+        accumulate_avx2(acc_, key_, stripes, n_stripes);
+        return;
+    }
+#else
+    (void)level;
+#endif
+    accumulate_scalar(acc_, key_, stripes, n_stripes);
+}
+
+Hash128
+BitsHasher::finish(const uint8_t* tail, size_t nbits) const {
+    uint64_t acc[8];
+    uint64_t key[8];
+    memcpy(acc, acc_, sizeof(acc));
+    memcpy(key, key_, sizeof(key));
+    size_t remain = nbits & 511;
+    if (remain) {
+        uint8_t stripe[64] = {};
+        memcpy(stripe, tail, (remain + 7) >> 3);
+        if (remain & 0x7) {
+            stripe[remain >> 3] &= uint8_t((1u << (remain & 0x7)) - 1);
+        }
+        accumulate_scalar(acc, key, stripe, 1);
+    }
+    Hash128 ret{mix64(nbits ^ SEED_LOW), mix64(nbits ^ SEED_HIGH)};
+    for (size_t i = 0; i < 8; i++) {
+        ret.low = mix64(ret.low ^ acc[i]);
+        ret.high = mix64((ret.high ^ ((acc[i] << 29) | (acc[i] >> 35))) + i);
+    }
+    return ret;
+}
+
+Hash128
+hash_bits(const uint8_t* data, size_t nbits, SimdLevel level) {
+    BitsHasher hasher;
+    hasher.update(data, nbits >> 9, level);
+    return hasher.finish(data + (nbits >> 9) * 64, nbits);
+}
+
+uint64_t
+fingerprint_bits(const uint8_t* data, size_t nbits, SimdLevel level) {
+    size_t full_words = nbits >> 6;
+    uint64_t ret = mix64(nbits);
+    size_t w = 0;
+#if defined(__x86_64__)
+    if (level != SimdLevel::NONE) {
+        ret ^= fingerprint_pclmul(data, full_words);
+        w = full_words;
+    }
+#else
+    (void)level;
+#endif
+    for (; w < full_words; w++) {
+        ret ^= word_fingerprint(w, load_u64(data + w * 8));
+    }
+    if (nbits & 63) {
+        uint64_t last = load_bits(data, (nbits + 7) >> 3, full_words * 64) & ((uint64_t(1) << (nbits & 63)) - 1);
+        ret ^= word_fingerprint(full_words, last);
+    }
+    return ret;
+}
+
+}  // namespace kernels
+}  // namespace faiss
@@ -0,0 +1,109 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Simd.h"
+
+namespace faiss {
+
+struct Hash128 {
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    inline bool
+    operator==(const Hash128& other) const {
+        return low == other.low && high == other.high;
+    }
+
+    inline bool
+    operator!=(const Hash128& other) const {
+        return !(*this == other);
+    }
+};
+
+namespace kernels {
+
+// splitmix64 finalizer
+inline uint64_t
+mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Streaming state of hash_bits, in the style of xxh3: eight 64-bit lanes,
+// and each 64-byte stripe adds word i ^ 1 and the product of the halves of
+// word i ^ key i to lane i. The keys advance every stripe, so that moved
+// stripes hash differently. The AVX2 / AVX-512 bodies give the same
+// results as the scalar one.
+class BitsHasher {
+ public:
+    BitsHasher();
+
+    // n_stripes whole 64-byte stripes
+    void
+    update(const uint8_t* stripes, size_t n_stripes, SimdLevel level = simd_level());
+
+    // the hash of nbits bits: the ones before nbits % 512 went through
+    // update(), the last nbits % 512 are at tail (bits past them ignored)
+    Hash128
+    finish(const uint8_t* tail, size_t nbits) const;
+
+ private:
+    uint64_t acc_[8];
+    uint64_t key_[8];
+};
+
+// hash of the first nbits bits of data, bits past them ignored
+Hash128
+hash_bits(const uint8_t* data, size_t nbits, SimdLevel level = simd_level());
+
+// The fingerprint of a bitset is mix64(size) XORed with
+// word_fingerprint(w, word w) for every 64-bit word w. word_fingerprint is
+// the carry-less product of the word with a key of w, folded to 64 bits,
+// that is the XOR of key(w) rotated left by each set bit; it is linear,
+// so setting or clearing bit id changes the fingerprint by
+// bit_fingerprint(id), and applying an XOR delta by the fingerprint of the
+// delta's words. Keys have odd weight, which makes the product injective
+// within a word. Good for telling bitsets apart, not against adversaries.
+inline uint64_t
+fingerprint_key(size_t word) {
+    uint64_t key = mix64(word ^ 0x2545f4914f6cdd1dull);
+    return key ^ uint64_t(!__builtin_parityll(key));
+}
+
+inline uint64_t
+bit_fingerprint(size_t id) {
+    uint64_t key = fingerprint_key(id >> 6);
+    size_t shift = id & 63;
+    return shift ? (key << shift) | (key >> (64 - shift)) : key;
+}
+
+inline uint64_t
+word_fingerprint(size_t word, uint64_t bits) {
+    uint64_t ret = 0;
+    for (; bits; bits &= bits - 1) {
+        ret ^= bit_fingerprint(word * 64 + __builtin_ctzll(bits));
+    }
+    return ret;
+}
+
+// fingerprint of the first nbits bits of data, with PCLMULQDQ from AVX2 on
+uint64_t
+fingerprint_bits(const uint8_t* data, size_t nbits, SimdLevel level = simd_level());
+
+}  // namespace kernels
+}  // namespace faiss
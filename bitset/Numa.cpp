@@ -0,0 +1,165 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "Numa.h"
+
+namespace faiss {
+
+namespace {
+
+// mbind modes, from <linux/mempolicy.h>; libnuma is not required
+constexpr int POLICY_PREFERRED = 1;
+constexpr int POLICY_INTERLEAVE = 3;
+
+// below this, first_touch stays on the calling thread
+constexpr size_t PARALLEL_TOUCH_BYTES = size_t(1) << 20;
+
+inline size_t
+page_size() {
+    static const size_t size = size_t(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+inline size_t
+round_to_pages(size_t bytes) {
+    return (bytes + page_size() - 1) / page_size() * page_size();
+}
+
+bool
+bind(void* data, size_t len, int mode, const std::vector<int>& nodes) {
+#if defined(__linux__)
+    constexpr size_t word_bits = sizeof(unsigned long) * 8;
+    std::vector<unsigned long> mask((numa_node_count() + word_bits - 1) / word_bits);
+    for (auto node : nodes) {
+        if (node < 0 || size_t(node) >= mask.size() * word_bits) {
+            return false;
+        }
+        mask[node / word_bits] |= 1ul << (node % word_bits);
+    }
+    // maxnode counts one past the last bit, as libnuma passes it
+    return syscall(SYS_mbind, data, len, mode, mask.data(), mask.size() * word_bits + 1, 0) == 0;
+#else
+    return false;
+#endif
+}
+
+}  // namespace
+
+size_t
+numa_node_count() {
+    static const size_t count = [] {
+        // "0", "0-1", "0,2-3": one past the highest node listed
+        size_t ret = 1;
+        FILE* f = fopen("/sys/devices/system/node/online", "r");
+        if (!f) {
+            return ret;
+        }
+        char buf[256] = {};
+        if (fgets(buf, sizeof(buf), f)) {
+            size_t value = 0;
+            for (char* p = buf; *p; p++) {
+                if (*p >= '0' && *p <= '9') {
+                    value = value * 10 + (*p - '0');
+                    ret = std::max(ret, value + 1);
+                } else {
+                    value = 0;
+                }
+            }
+        }
+        fclose(f);
+        return ret;
+    }();
+    return count;
+}
+
+int
+numa_current_node() {
+#if defined(__linux__)
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+        return int(node);
+    }
+#endif
+    return 0;
+}
+
+bool
+numa_place(void* data, size_t len, NumaPlacement placement, int node) {
+    size_t nodes = numa_node_count();
+    switch (placement) {
+        case NumaPlacement::INTERLEAVE: {
+            std::vector<int> all(nodes);
+            for (size_t i = 0; i < nodes; i++) {
+                all[i] = int(i);
+            }
+            return bind(data, len, POLICY_INTERLEAVE, all);
+        }
+        case NumaPlacement::LOCAL:
+            return bind(data, len, POLICY_PREFERRED, {node < 0 ? numa_current_node() : node});
+        case NumaPlacement::PARTITIONED: {
+            size_t part = round_to_pages((len + nodes - 1) / nodes);
+            bool ret = true;
+            for (size_t i = 0; i < nodes && i * part < len; i++) {
+                auto begin = static_cast<uint8_t*>(data) + i * part;
+                ret = bind(begin, std::min(part, len - i * part), POLICY_PREFERRED, {int(i)}) && ret;
+            }
+            return ret;
+        }
+        default:
+            return true;
+    }
+}
+
+void
+first_touch(uint8_t* data, size_t len, uint8_t value) {
+    size_t page = page_size();
+    int64_t n_pages = int64_t((len + page - 1) / page);
+#pragma omp parallel for schedule(static) if (len >= PARALLEL_TOUCH_BYTES)
+    for (int64_t i = 0; i < n_pages; i++) {
+        size_t begin = size_t(i) * page;
+        memset(data + begin, value, std::min(page, len - begin));
+    }
+}
+
+void*
+numa_alloc(size_t bytes, NumaPlacement placement, int node) {
+    if (bytes == 0) {
+        return nullptr;
+    }
+    size_t len = round_to_pages(bytes);
+    void* data = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    numa_place(data, len, placement, node);
+    return data;
+}
+
+void
+numa_free(void* data, size_t bytes) {
+    if (data) {
+        munmap(data, round_to_pages(bytes));
+    }
+}
+
+}  // namespace faiss
@@ -0,0 +1,125 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace faiss {
+
+// Where the pages of a large buffer go on a multi-socket machine.
+enum class NumaPlacement {
+    FIRST_TOUCH,  // to the node of the thread that writes a page first
+    INTERLEAVE,   // round-robin over all nodes
+    LOCAL,        // all on one node
+    PARTITIONED,  // one contiguous part per node, in node order
+};
+
+// number of NUMA nodes, 1 if it cannot be told
+size_t
+numa_node_count();
+
+// node of the calling thread, 0 if it cannot be told
+int
+numa_current_node();
+
+// Apply placement to the pages of [data, data + len) with mbind, before
+// they are first touched; data is page aligned. node picks the node of
+// LOCAL, -1 for the calling thread's. Return false if the kernel refused
+// (or is not Linux); the pages then follow first touch.
+bool
+numa_place(void* data, size_t len, NumaPlacement placement, int node = -1);
+
+// memset(data, value, len), with the pages split into one contiguous part
+// per OpenMP thread (schedule(static)), so under FIRST_TOUCH part t lands
+// on the node of thread t. A schedule(static) loop over the same range
+// later, as union_many and intersect_many run, then finds its part local.
+void
+first_touch(uint8_t* data, size_t len, uint8_t value);
+
+// page-aligned anonymous mapping with placement applied and no page
+// touched yet; throws std::bad_alloc
+void*
+numa_alloc(size_t bytes, NumaPlacement placement, int node = -1);
+
+void
+numa_free(void* data, size_t bytes);
+
+// Allocator on numa_alloc. Elements are default-initialized, which for the
+// bitset words leaves the (zero) pages untouched until first_touch or
+// first use, instead of value-initializing them from one thread. Every
+// allocation takes whole pages, so this is meant for large bitsets.
+template <typename T>
+class NumaAllocator {
+ public:
+    using value_type = T;
+
+    explicit NumaAllocator(NumaPlacement placement = NumaPlacement::FIRST_TOUCH, int node = -1)
+    : placement_(placement), node_(node) {
+    }
+
+    template <typename U>
+    NumaAllocator(const NumaAllocator<U>& other) : placement_(other.placement()), node_(other.node()) {
+    }
+
+    T*
+    allocate(size_t n) {
+        return static_cast<T*>(numa_alloc(n * sizeof(T), placement_, node_));
+    }
+
+    void
+    deallocate(T* p, size_t n) {
+        numa_free(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    void
+    construct(U* p) {
+        ::new (static_cast<void*>(p)) U;
+    }
+
+    template <typename U, typename... Args>
+    void
+    construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+
+    inline NumaPlacement
+    placement() const {
+        return placement_;
+    }
+
+    inline int
+    node() const {
+        return node_;
+    }
+
+ private:
+    NumaPlacement placement_;
+    int node_;
+};
+
+template <typename T, typename U>
+bool
+operator==(const NumaAllocator<T>& lhs, const NumaAllocator<U>& rhs) {
+    return lhs.placement() == rhs.placement() && lhs.node() == rhs.node();
+}
+
+template <typename T, typename U>
+bool
+operator!=(const NumaAllocator<T>& lhs, const NumaAllocator<U>& rhs) {
+    return !(lhs == rhs);
+}
+
+}  // namespace faiss
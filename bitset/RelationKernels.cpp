@@ -0,0 +1,175 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "BitsetKernels.h"
+#include "RelationKernels.h"
+
+namespace faiss {
+namespace kernels {
+
+namespace {
+
+// bytes checked between two early-exit tests in the vector bodies
+constexpr size_t BLOCK_BYTES = 256;
+
+template <uint32_t Wanted>
+inline uint32_t
+word_flags(uint64_t l, uint64_t r) {
+    uint32_t ret = 0;
+    if ((Wanted & ONLY_LHS) && (l & ~r)) {
+        ret |= ONLY_LHS;
+    }
+    if ((Wanted & ONLY_RHS) && (r & ~l)) {
+        ret |= ONLY_RHS;
+    }
+    if ((Wanted & IN_BOTH) && (l & r)) {
+        ret |= IN_BOTH;
+    }
+    return ret;
+}
+
+// Vector bodies over whole blocks: OR the wanted kinds of bits over a
+// block, then test once. Return where the scalar loop has to pick up,
+// which is right after the deciding block if they stopped early.
+
+#if defined(__x86_64__)
+
+template <uint32_t Wanted>
+BITSET_TARGET_AVX512 size_t
+relation_avx512(const uint8_t* lhs, const uint8_t* rhs, size_t n8, uint32_t& found) {
+    size_t i = 0;
+    for (; i + BLOCK_BYTES <= n8; i += BLOCK_BYTES) {
+        __m512i only_l = _mm512_setzero_si512();
+        __m512i only_r = _mm512_setzero_si512();
+        __m512i both = _mm512_setzero_si512();
+        for (size_t k = 0; k < BLOCK_BYTES; k += 64) {
+            __m512i l = _mm512_loadu_si512(lhs + i + k);
+            __m512i r = _mm512_loadu_si512(rhs + i + k);
+            if (Wanted & ONLY_LHS) {
+                only_l = _mm512_or_si512(only_l, _mm512_andnot_si512(r, l));
+            }
+            if (Wanted & ONLY_RHS) {
+                only_r = _mm512_or_si512(only_r, _mm512_andnot_si512(l, r));
+            }
+            if (Wanted & IN_BOTH) {
+                both = _mm512_or_si512(both, _mm512_and_si512(l, r));
+            }
+        }
+        if ((Wanted & ONLY_LHS) && _mm512_test_epi64_mask(only_l, only_l)) {
+            found |= ONLY_LHS;
+        }
+        if ((Wanted & ONLY_RHS) && _mm512_test_epi64_mask(only_r, only_r)) {
+            found |= ONLY_RHS;
+        }
+        if ((Wanted & IN_BOTH) && _mm512_test_epi64_mask(both, both)) {
+            found |= IN_BOTH;
+        }
+        if ((found & Wanted) == Wanted) {
+            return i + BLOCK_BYTES;
+        }
+    }
+    return i;
+}
+
+template <uint32_t Wanted>
+BITSET_TARGET_AVX2 size_t
+relation_avx2(const uint8_t* lhs, const uint8_t* rhs, size_t n8, uint32_t& found) {
+    size_t i = 0;
+    for (; i + BLOCK_BYTES <= n8; i += BLOCK_BYTES) {
+        __m256i only_l = _mm256_setzero_si256();
+        __m256i only_r = _mm256_setzero_si256();
+        __m256i both = _mm256_setzero_si256();
+        for (size_t k = 0; k < BLOCK_BYTES; k += 32) {
+            __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i + k));
+            __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + i + k));
+            if (Wanted & ONLY_LHS) {
+                only_l = _mm256_or_si256(only_l, _mm256_andnot_si256(r, l));
+            }
+            if (Wanted & ONLY_RHS) {
+                only_r = _mm256_or_si256(only_r, _mm256_andnot_si256(l, r));
+            }
+            if (Wanted & IN_BOTH) {
+                both = _mm256_or_si256(both, _mm256_and_si256(l, r));
+            }
+        }
+        if ((Wanted & ONLY_LHS) && !_mm256_testz_si256(only_l, only_l)) {
+            found |= ONLY_LHS;
+        }
+        if ((Wanted & ONLY_RHS) && !_mm256_testz_si256(only_r, only_r)) {
+            found |= ONLY_RHS;
+        }
+        if ((Wanted & IN_BOTH) && !_mm256_testz_si256(both, both)) {
+            found |= IN_BOTH;
+        }
+        if ((found & Wanted) == Wanted) {
+            return i + BLOCK_BYTES;
+        }
+    }
+    return i;
+}
+
+#endif
+
+template <uint32_t Wanted>
+uint32_t
+relation(const uint8_t* lhs, const uint8_t* rhs, size_t nbits, SimdLevel level) {
+    uint32_t found = 0;
+    size_t n64 = nbits >> 6;
+    size_t i = 0;
+#if defined(__x86_64__)
+    if (level == SimdLevel::AVX512) {
+        i = relation_avx512<Wanted>(lhs, rhs, n64 * 8, found);
+    } else if (level == SimdLevel::AVX2) {
+        i = relation_avx2<Wanted>(lhs, rhs, n64 * 8, found);
+    }
+    if ((found & Wanted) == Wanted) {
+        return found;
+    }
+    i /= 8;
+#else
+    (void)level;
+#endif
+    for (; i < n64; i++) {
+        found |= word_flags<Wanted>(load_u64(lhs + i * 8), load_u64(rhs + i * 8));
+        if ((found & Wanted) == Wanted) {
+            return found;
+        }
+    }
+    if (nbits & 63) {
+        size_t n8 = (nbits + 7) >> 3;
+        uint64_t mask = (uint64_t(1) << (nbits & 63)) - 1;
+        found |= word_flags<Wanted>(load_bits(lhs, n8, n64 * 64) & mask, load_bits(rhs, n8, n64 * 64) & mask);
+    }
+    return found;
+}
+
+}  // namespace
+
+uint32_t
+relation_flags(const uint8_t* lhs, const uint8_t* rhs, size_t nbits, uint32_t stop, SimdLevel level) {
+    switch (stop) {
+        case IN_BOTH:
+            return relation<IN_BOTH>(lhs, rhs, nbits, level);
+        case ONLY_LHS:
+            return relation<ONLY_LHS>(lhs, rhs, nbits, level);
+        case ONLY_RHS:
+            return relation<ONLY_RHS>(lhs, rhs, nbits, level);
+        default:
+            return relation<ONLY_LHS | ONLY_RHS | IN_BOTH>(lhs, rhs, nbits, level);
+    }
+}
+
+}  // namespace kernels
+}  // namespace faiss
@@ -0,0 +1,38 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Simd.h"
+
+namespace faiss {
+namespace kernels {
+
+// What relation_flags looks for: bits set in lhs only, in rhs only, in both.
+constexpr uint32_t ONLY_LHS = 0x1;
+constexpr uint32_t ONLY_RHS = 0x2;
+constexpr uint32_t IN_BOTH = 0x4;
+
+// The kinds of bits (of ONLY_LHS, ONLY_RHS, IN_BOTH) found among the first
+// nbits bits of lhs and rhs, without materializing anything. Only the kinds
+// in stop are looked for, and the scan ends at the first block (256 bytes
+// under AVX2 / AVX-512, a word otherwise) after which all of them have
+// been seen: intersects stops at the first common bit, is_subset_of at the
+// first bit lhs has alone.
+uint32_t
+relation_flags(const uint8_t* lhs, const uint8_t* rhs, size_t nbits, uint32_t stop,
+               SimdLevel level = simd_level());
+
+}  // namespace kernels
+}  // namespace faiss
@@ -0,0 +1,890 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#include <assert.h>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include "BitsetKernels.h"
+#include "RoaringBitset.h"
+
+namespace faiss {
+
+namespace {
+
+using Container = RoaringBitset::Container;
+
+constexpr size_t CHUNK_BITS = 1 << 16;
+constexpr size_t CHUNK_WORDS = CHUNK_BITS / 64;
+constexpr size_t CHUNK_BYTES = CHUNK_BITS / 8;
+constexpr size_t ARRAY_MAX = 4096;
+
+// portable format constants
+constexpr uint32_t SERIAL_COOKIE_NO_RUNCONTAINER = 12346;
+constexpr uint32_t SERIAL_COOKIE = 12347;
+constexpr size_t NO_OFFSET_THRESHOLD = 4;
+
+struct AndOp {
+    static constexpr bool keep_lhs_only = false;
+    static constexpr bool keep_rhs_only = false;
+
+    inline uint64_t
+    operator()(uint64_t lhs, uint64_t rhs) const {
+        return lhs & rhs;
+    }
+};
+
+struct OrOp {
+    static constexpr bool keep_lhs_only = true;
+    static constexpr bool keep_rhs_only = true;
+
+    inline uint64_t
+    operator()(uint64_t lhs, uint64_t rhs) const {
+        return lhs | rhs;
+    }
+};
+
+struct XorOp {
+    static constexpr bool keep_lhs_only = true;
+    static constexpr bool keep_rhs_only = true;
+
+    inline uint64_t
+    operator()(uint64_t lhs, uint64_t rhs) const {
+        return lhs ^ rhs;
+    }
+};
+
+struct AndNotOp {
+    static constexpr bool keep_lhs_only = true;
+    static constexpr bool keep_rhs_only = false;
+
+    inline uint64_t
+    operator()(uint64_t lhs, uint64_t rhs) const {
+        return lhs & ~rhs;
+    }
+};
+
+inline void
+put16(uint8_t*& p, uint16_t v) {
+    memcpy(p, &v, sizeof(v));
+    p += sizeof(v);
+}
+
+inline void
+put32(uint8_t*& p, uint32_t v) {
+    memcpy(p, &v, sizeof(v));
+    p += sizeof(v);
+}
+
+inline uint16_t
+get16(const uint8_t* p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t
+get32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+bool
+contains(const Container& c, uint16_t v) {
+    if (c.type == Container::BITMAP) {
+        return (c.words[v >> 6] >> (v & 0x3f)) & 0x1;
+    }
+    if (c.type == Container::ARRAY) {
+        return std::binary_search(c.values.begin(), c.values.end(), v);
+    }
+    // last run whose start is <= v
+    size_t lo = 0, hi = c.values.size() / 2;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (c.values[mid * 2] <= v) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo > 0 && v - c.values[(lo - 1) * 2] <= c.values[(lo - 1) * 2 + 1];
+}
+
+void
+to_words(const Container& c, uint64_t* words) {
+    if (c.type == Container::BITMAP) {
+        memcpy(words, c.words.data(), CHUNK_BYTES);
+        return;
+    }
+    memset(words, 0, CHUNK_BYTES);
+    if (c.type == Container::ARRAY) {
+        for (auto v : c.values) {
+            words[v >> 6] |= uint64_t(1) << (v & 0x3f);
+        }
+        return;
+    }
+    for (size_t r = 0; r < c.values.size(); r += 2) {
+        uint32_t start = c.values[r];
+        uint32_t end = start + c.values[r + 1];  // inclusive
+        size_t first = start >> 6, last = end >> 6;
+        uint64_t first_mask = ~uint64_t(0) << (start & 0x3f);
+        uint64_t last_mask = ~uint64_t(0) >> (63 - (end & 0x3f));
+        if (first == last) {
+            words[first] |= first_mask & last_mask;
+            continue;
+        }
+        words[first] |= first_mask;
+        for (size_t w = first + 1; w < last; w++) {
+            words[w] = ~uint64_t(0);
+        }
+        words[last] |= last_mask;
+    }
+}
+
+// build the smallest container holding the bits of a 1024-word chunk
+Container
+from_words(const uint64_t* words) {
+    Container c;
+    size_t card = 0, runs = 0;
+    uint64_t carry = 0;  // top bit of the previous word
+    for (size_t w = 0; w < CHUNK_WORDS; w++) {
+        uint64_t word = words[w];
+        card += __builtin_popcountll(word);
+        runs += __builtin_popcountll(word & ~((word << 1) | carry));
+        carry = word >> 63;
+    }
+    c.cardinality = uint32_t(card);
+    if (card == 0) {
+        return c;
+    }
+
+    size_t run_bytes = 2 + 4 * runs;
+    size_t other_bytes = card <= ARRAY_MAX ? 2 * card : CHUNK_BYTES;
+    if (run_bytes < other_bytes) {
+        c.type = Container::RUN;
+        c.values.reserve(runs * 2);
+        size_t v = 0;
+        while (v < CHUNK_BITS) {
+            uint64_t word = words[v >> 6] >> (v & 0x3f);
+            if (!word) {
+                v = (v | 0x3f) + 1;
+                continue;
+            }
+            v += __builtin_ctzll(word);
+            size_t start = v;
+            while (v < CHUNK_BITS) {
+                uint64_t inv = ~words[v >> 6] >> (v & 0x3f);
+                // bits above position 63 - (v & 0x3f) shifted in as 0s
+                size_t avail = 64 - (v & 0x3f);
+                size_t ones = inv ? std::min<size_t>(__builtin_ctzll(inv), avail) : avail;
+                v += ones;
+                if (ones < avail) {
+                    break;
+                }
+            }
+            c.values.push_back(uint16_t(start));
+            c.values.push_back(uint16_t(v - start - 1));
+        }
+    } else if (card <= ARRAY_MAX) {
+        c.type = Container::ARRAY;
+        c.values.reserve(card);
+        for (size_t w = 0; w < CHUNK_WORDS; w++) {
+            uint64_t word = words[w];
+            while (word) {
+                c.values.push_back(uint16_t((w << 6) | __builtin_ctzll(word)));
+                word &= word - 1;
+            }
+        }
+    } else {
+        c.type = Container::BITMAP;
+        c.words.assign(words, words + CHUNK_WORDS);
+    }
+    return c;
+}
+
+// array container for sorted values; switches to the best container
+// when the array alone is not the smallest form
+Container
+from_values(std::vector<uint16_t>&& values) {
+    size_t runs = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+        if (i == 0 || values[i] != values[i - 1] + 1) {
+            runs++;
+        }
+    }
+    if (values.size() > ARRAY_MAX || 2 + 4 * runs < 2 * values.size()) {
+        std::vector<uint64_t> words(CHUNK_WORDS, 0);
+        for (auto v : values) {
+            words[v >> 6] |= uint64_t(1) << (v & 0x3f);
+        }
+        return from_words(words.data());
+    }
+    Container c;
+    c.cardinality = uint32_t(values.size());
+    c.values = std::move(values);
+    return c;
+}
+
+template <typename Op>
+Container
+container_op(const Container& lhs, const Container& rhs) {
+    constexpr bool filter_lhs = std::is_same<Op, AndOp>::value || std::is_same<Op, AndNotOp>::value;
+    if (filter_lhs && lhs.type == Container::ARRAY) {
+        // the result is a subset of lhs; probe rhs for each value
+        std::vector<uint16_t> values;
+        values.reserve(lhs.values.size());
+        for (auto v : lhs.values) {
+            if (contains(rhs, v) == std::is_same<Op, AndOp>::value) {
+                values.push_back(v);
+            }
+        }
+        return from_values(std::move(values));
+    }
+    if (std::is_same<Op, AndOp>::value && rhs.type == Container::ARRAY) {
+        return container_op<Op>(rhs, lhs);
+    }
+    if (lhs.type == Container::ARRAY && rhs.type == Container::ARRAY) {
+        std::vector<uint16_t> values;
+        auto out = std::back_inserter(values);
+        if (std::is_same<Op, OrOp>::value) {
+            std::set_union(lhs.values.begin(), lhs.values.end(), rhs.values.begin(), rhs.values.end(), out);
+        } else {
+            std::set_symmetric_difference(lhs.values.begin(), lhs.values.end(), rhs.values.begin(),
+                                          rhs.values.end(), out);
+        }
+        return from_values(std::move(values));
+    }
+
+    Op op;
+    uint64_t lhs_words[CHUNK_WORDS], rhs_words[CHUNK_WORDS];
+    to_words(lhs, lhs_words);
+    to_words(rhs, rhs_words);
+    for (size_t w = 0; w < CHUNK_WORDS; w++) {
+        lhs_words[w] = op(lhs_words[w], rhs_words[w]);
+    }
+    return from_words(lhs_words);
+}
+
+// load the bits [key << 16, (key + 1) << 16) of view, through extract_into;
+// return false if they are all 0
+bool
+load_chunk(const BitsetView& view, size_t key, uint64_t* words) {
+    size_t begin = key * CHUNK_BITS;
+    memset(words, 0, CHUNK_BYTES);
+    view.extract_into(begin, std::min(CHUNK_BITS, view.size() - begin), reinterpret_cast<uint8_t*>(words));
+    uint64_t any = 0;
+    for (size_t w = 0; w < CHUNK_WORDS; w++) {
+        any |= words[w];
+    }
+    return any != 0;
+}
+
+// chunks a flat bitset of size bits spans, capped to the 32-bit id space
+inline size_t
+chunk_count(size_t size) {
+    return std::min((size + CHUNK_BITS - 1) / CHUNK_BITS, size_t(1) << 16);
+}
+
+}  // namespace
+
+RoaringBitset::RoaringBitset(const BitsetView& view) {
+    uint64_t words[CHUNK_WORDS];
+    for (size_t key = 0; key < chunk_count(view.size()); key++) {
+        if (load_chunk(view, key, words)) {
+            keys_.push_back(uint16_t(key));
+            containers_.push_back(from_words(words));
+        }
+    }
+}
+
+template <typename Op>
+RoaringBitset&
+RoaringBitset::apply(const RoaringBitset& bitset) {
+    std::vector<uint16_t> keys;
+    std::vector<Container> containers;
+    size_t i = 0, j = 0;
+    auto emit = [&](uint16_t key, Container&& c) {
+        if (c.cardinality) {
+            keys.push_back(key);
+            containers.push_back(std::move(c));
+        }
+    };
+    while (i < keys_.size() || j < bitset.keys_.size()) {
+        if (j == bitset.keys_.size() || (i < keys_.size() && keys_[i] < bitset.keys_[j])) {
+            if (Op::keep_lhs_only) {
+                emit(keys_[i], std::move(containers_[i]));
+            }
+            i++;
+        } else if (i == keys_.size() || bitset.keys_[j] < keys_[i]) {
+            if (Op::keep_rhs_only) {
+                emit(bitset.keys_[j], Container(bitset.containers_[j]));
+            }
+            j++;
+        } else {
+            emit(keys_[i], container_op<Op>(containers_[i], bitset.containers_[j]));
+            i++;
+            j++;
+        }
+    }
+    keys_ = std::move(keys);
+    containers_ = std::move(containers);
+    return *this;
+}
+
+template <typename Op>
+RoaringBitset&
+RoaringBitset::apply(const BitsetView& view) {
+    std::vector<uint16_t> keys;
+    std::vector<Container> containers;
+    uint64_t words[CHUNK_WORDS];
+    size_t n_keys = keys_.empty() ? 0 : size_t(keys_.back()) + 1;
+    if (Op::keep_rhs_only) {
+        n_keys = std::max(n_keys, chunk_count(view.size()));
+    }
+    size_t i = 0;
+    for (size_t key = 0; key < n_keys; key++) {
+        bool own = i < keys_.size() && keys_[i] == key;
+        if (!own && !Op::keep_rhs_only) {
+            continue;
+        }
+        bool loaded = key < chunk_count(view.size()) && load_chunk(view, key, words);
+        Container c;
+        if (own && loaded) {
+            c = container_op<Op>(containers_[i], from_words(words));
+        } else if (own) {
+            if (Op::keep_lhs_only) {
+                c = std::move(containers_[i]);
+            }
+        } else if (loaded) {
+            c = from_words(words);
+        }
+        if (own) {
+            i++;
+        }
+        if (c.cardinality) {
+            keys.push_back(uint16_t(key));
+            containers.push_back(std::move(c));
+        }
+    }
+    keys_ = std::move(keys);
+    containers_ = std::move(containers);
+    return *this;
+}
+
+template <typename Op>
+void
+RoaringBitset::apply_into(uint8_t* blocks, size_t size) const {
+    Op op;
+    uint64_t words[CHUNK_WORDS], own[CHUNK_WORDS];
+    size_t i = 0;
+    for (size_t key = 0; key < chunk_count(size); key++) {
+        while (i < keys_.size() && keys_[i] < key) {
+            i++;
+        }
+        bool present = i < keys_.size() && keys_[i] == key;
+        if (!present && Op::keep_lhs_only) {
+            continue;
+        }
+        load_chunk(BitsetView(blocks, size), key, words);
+        if (present) {
+            to_words(containers_[i], own);
+        } else {
+            memset(own, 0, CHUNK_BYTES);
+        }
+        for (size_t w = 0; w < CHUNK_WORDS; w++) {
+            words[w] = op(words[w], own[w]);
+        }
+        size_t begin = key * CHUNK_BYTES;
+        size_t n8 = std::min(CHUNK_BYTES, (size + 7) / 8 - begin);
+        size_t valid = std::min(CHUNK_BITS, size - key * CHUNK_BITS);
+        if (valid < CHUNK_BITS) {
+            // the chunk was loaded with bits past size cleared; keep
+            // whatever the caller has there
+            auto tail = reinterpret_cast<uint8_t*>(words);
+            uint8_t keep = uint8_t(~((1u << (valid & 0x7)) - 1));
+            if (valid & 0x7) {
+                tail[valid >> 3] = (tail[valid >> 3] & ~keep) | (blocks[begin + (valid >> 3)] & keep);
+            }
+        }
+        memcpy(blocks + begin, words, n8);
+    }
+}
+
+RoaringBitset&
+RoaringBitset::operator&=(const RoaringBitset& bitset) {
+    return apply<AndOp>(bitset);
+}
+
+RoaringBitset&
+RoaringBitset::operator&=(const BitsetView& view) {
+    return apply<AndOp>(view);
+}
+
+std::shared_ptr<RoaringBitset>
+RoaringBitset::operator&(const RoaringBitset& bitset) const {
+    auto result_bitset = std::make_shared<RoaringBitset>(*this);
+    *result_bitset &= bitset;
+    return result_bitset;
+}
+
+std::shared_ptr<RoaringBitset>
+RoaringBitset::operator&(const BitsetView& view) const {
+    auto result_bitset = std::make_shared<RoaringBitset>(*this);
+    *result_bitset &= view;
+    return result_bitset;
+}
+
+RoaringBitset&
+RoaringBitset::operator|=(const RoaringBitset& bitset) {
+    return apply<OrOp>(bitset);
+}
+
+RoaringBitset&
+RoaringBitset::operator|=(const BitsetView& view) {
+    return apply<OrOp>(view);
+}
+
+std::shared_ptr<RoaringBitset>
+RoaringBitset::operator|(const RoaringBitset& bitset) const {
+    auto result_bitset = std::make_shared<RoaringBitset>(*this);
+    *result_bitset |= bitset;
+    return result_bitset;
+}
+
+std::shared_ptr<RoaringBitset>
+RoaringBitset::operator|(const BitsetView& view) const {
+    auto result_bitset = std::make_shared<RoaringBitset>(*this);
+    *result_bitset |= view;
+    return result_bitset;
+}
+
+RoaringBitset&
+RoaringBitset::operator^=(const RoaringBitset& bitset) {
+    return apply<XorOp>(bitset);
+}
+
+RoaringBitset&
+RoaringBitset::operator^=(const BitsetView& view) {
+    return apply<XorOp>(view);
+}
+
+std::shared_ptr<RoaringBitset>
+RoaringBitset::operator^(const RoaringBitset& bitset) const {
+    auto result_bitset = std::make_shared<RoaringBitset>(*this);
+    *result_bitset ^= bitset;
+    return result_bitset;
+}
+
+std::shared_ptr<RoaringBitset>
+RoaringBitset::operator^(const BitsetView& view) const {
+    auto result_bitset = std::make_shared<RoaringBitset>(*this);
+    *result_bitset ^= view;
+    return result_bitset;
+}
+
+RoaringBitset&
+RoaringBitset::operator-=(const RoaringBitset& bitset) {
+    return apply<AndNotOp>(bitset);
+}
+
+RoaringBitset&
+RoaringBitset::operator-=(const BitsetView& view) {
+    return apply<AndNotOp>(view);
+}
+
+std::shared_ptr<RoaringBitset>
+RoaringBitset::operator-(const RoaringBitset& bitset) const {
+    auto result_bitset = std::make_shared<RoaringBitset>(*this);
+    *result_bitset -= bitset;
+    return result_bitset;
+}
+
+std::shared_ptr<RoaringBitset>
+RoaringBitset::operator-(const BitsetView& view) const {
+    auto result_bitset = std::make_shared<RoaringBitset>(*this);
+    *result_bitset -= view;
+    return result_bitset;
+}
+
+bool
+RoaringBitset::test(id_type_t id) const {
+    assert(id >= 0 && uint64_t(id) < (uint64_t(1) << 32));
+    uint16_t key = uint16_t(id >> 16);
+    auto it = std::lower_bound(keys_.begin(), keys_.end(), key);
+    if (it == keys_.end() || *it != key) {
+        return false;
+    }
+    return contains(containers_[it - keys_.begin()], uint16_t(id));
+}
+
+void
+RoaringBitset::set(id_type_t id) {
+    assert(id >= 0 && uint64_t(id) < (uint64_t(1) << 32));
+    uint16_t key = uint16_t(id >> 16);
+    uint16_t v = uint16_t(id);
+    auto it = std::lower_bound(keys_.begin(), keys_.end(), key);
+    size_t idx = it - keys_.begin();
+    if (it == keys_.end() || *it != key) {
+        keys_.insert(it, key);
+        containers_.insert(containers_.begin() + idx, Container());
+    }
+    auto& c = containers_[idx];
+    if (c.type == Container::RUN) {
+        if (contains(c, v)) {
+            return;
+        }
+        uint64_t words[CHUNK_WORDS];
+        to_words(c, words);
+        words[v >> 6] |= uint64_t(1) << (v & 0x3f);
+        c = from_words(words);
+        return;
+    }
+    if (c.type == Container::BITMAP) {
+        uint64_t& word = c.words[v >> 6];
+        uint64_t mask = uint64_t(1) << (v & 0x3f);
+        c.cardinality += !(word & mask);
+        word |= mask;
+        return;
+    }
+    auto pos = std::lower_bound(c.values.begin(), c.values.end(), v);
+    if (pos != c.values.end() && *pos == v) {
+        return;
+    }
+    if (c.values.size() < ARRAY_MAX) {
+        c.values.insert(pos, v);
+        c.cardinality++;
+        return;
+    }
+    Container bitmap;
+    bitmap.type = Container::BITMAP;
+    bitmap.words.assign(CHUNK_WORDS, 0);
+    to_words(c, bitmap.words.data());
+    bitmap.words[v >> 6] |= uint64_t(1) << (v & 0x3f);
+    bitmap.cardinality = c.cardinality + 1;
+    c = std::move(bitmap);
+}
+
+void
+RoaringBitset::clear(id_type_t id) {
+    assert(id >= 0 && uint64_t(id) < (uint64_t(1) << 32));
+    uint16_t key = uint16_t(id >> 16);
+    uint16_t v = uint16_t(id);
+    auto it = std::lower_bound(keys_.begin(), keys_.end(), key);
+    if (it == keys_.end() || *it != key) {
+        return;
+    }
+    size_t idx = it - keys_.begin();
+    auto& c = containers_[idx];
+    if (!contains(c, v)) {
+        return;
+    }
+    if (c.type == Container::ARRAY) {
+        c.values.erase(std::lower_bound(c.values.begin(), c.values.end(), v));
+        c.cardinality--;
+    } else if (c.type == Container::BITMAP && c.cardinality - 1 > ARRAY_MAX) {
+        c.words[v >> 6] &= ~(uint64_t(1) << (v & 0x3f));
+        c.cardinality--;
+    } else {
+        uint64_t words[CHUNK_WORDS];
+        to_words(c, words);
+        words[v >> 6] &= ~(uint64_t(1) << (v & 0x3f));
+        c = from_words(words);
+    }
+    if (c.cardinality == 0) {
+        keys_.erase(it);
+        containers_.erase(containers_.begin() + idx);
+    }
+}
+
+size_t
+RoaringBitset::count() const {
+    size_t ret = 0;
+    for (auto& c : containers_) {
+        ret += c.cardinality;
+    }
+    return ret;
+}
+
+size_t
+RoaringBitset::memory_size() const {
+    size_t ret = keys_.size() * sizeof(uint16_t) + containers_.size() * sizeof(Container);
+    for (auto& c : containers_) {
+        ret += c.values.size() * sizeof(uint16_t) + c.words.size() * sizeof(uint64_t);
+    }
+    return ret;
+}
+
+void
+RoaringBitset::optimize() {
+    uint64_t words[CHUNK_WORDS];
+    for (auto& c : containers_) {
+        to_words(c, words);
+        c = from_words(words);
+    }
+}
+
+void
+RoaringBitset::materialize(uint8_t* blocks, size_t size) const {
+    memset(blocks, 0, (size + 7) / 8);
+    apply_into<OrOp>(blocks, size);
+}
+
+void
+RoaringBitset::and_into(uint8_t* blocks, size_t size) const {
+    apply_into<AndOp>(blocks, size);
+}
+
+void
+RoaringBitset::or_into(uint8_t* blocks, size_t size) const {
+    apply_into<OrOp>(blocks, size);
+}
+
+void
+RoaringBitset::andnot_into(uint8_t* blocks, size_t size) const {
+    apply_into<AndNotOp>(blocks, size);
+}
+
+void
+RoaringBitset::xor_into(uint8_t* blocks, size_t size) const {
+    apply_into<XorOp>(blocks, size);
+}
+
+size_t
+RoaringBitset::serialized_size() const {
+    size_t n = keys_.size();
+    bool has_run = false;
+    size_t ret = 0;
+    for (auto& c : containers_) {
+        if (c.type == Container::RUN) {
+            has_run = true;
+            ret += 2 + c.values.size() * sizeof(uint16_t);
+        } else if (c.type == Container::ARRAY) {
+            ret += c.values.size() * sizeof(uint16_t);
+        } else {
+            ret += CHUNK_BYTES;
+        }
+    }
+    // cookie, key/cardinality pairs, then the run flags or the size
+    ret += 4 + 4 * n + (has_run ? (n + 7) / 8 : 4);
+    if (!has_run || n >= NO_OFFSET_THRESHOLD) {
+        ret += 4 * n;
+    }
+    return ret;
+}
+
+void
+RoaringBitset::serialize(uint8_t* buf) const {
+    size_t n = keys_.size();
+    bool has_run = std::any_of(containers_.begin(), containers_.end(),
+                               [](const Container& c) { return c.type == Container::RUN; });
+    uint8_t* p = buf;
+    if (has_run) {
+        put32(p, SERIAL_COOKIE | (uint32_t(n - 1) << 16));
+        memset(p, 0, (n + 7) / 8);
+        for (size_t i = 0; i < n; i++) {
+            if (containers_[i].type == Container::RUN) {
+                p[i >> 3] |= uint8_t(1) << (i & 0x7);
+            }
+        }
+        p += (n + 7) / 8;
+    } else {
+        put32(p, SERIAL_COOKIE_NO_RUNCONTAINER);
+        put32(p, uint32_t(n));
+    }
+    for (size_t i = 0; i < n; i++) {
+        put16(p, keys_[i]);
+        put16(p, uint16_t(containers_[i].cardinality - 1));
+    }
+    if (!has_run || n >= NO_OFFSET_THRESHOLD) {
+        uint32_t offset = uint32_t(p - buf + 4 * n);
+        for (auto& c : containers_) {
+            put32(p, offset);
+            if (c.type == Container::RUN) {
+                offset += 2 + c.values.size() * sizeof(uint16_t);
+            } else if (c.type == Container::ARRAY) {
+                offset += c.values.size() * sizeof(uint16_t);
+            } else {
+                offset += CHUNK_BYTES;
+            }
+        }
+    }
+    for (auto& c : containers_) {
+        if (c.type == Container::RUN) {
+            put16(p, uint16_t(c.values.size() / 2));
+        }
+        if (c.type == Container::BITMAP) {
+            memcpy(p, c.words.data(), CHUNK_BYTES);
+            p += CHUNK_BYTES;
+        } else {
+            memcpy(p, c.values.data(), c.values.size() * sizeof(uint16_t));
+            p += c.values.size() * sizeof(uint16_t);
+        }
+    }
+}
+
+std::vector<uint8_t>
+RoaringBitset::serialize() const {
+    std::vector<uint8_t> buf(serialized_size());
+    serialize(buf.data());
+    return buf;
+}
+
+bool
+RoaringBitset::deserialize(const uint8_t* buf, size_t len) {
+    keys_.clear();
+    containers_.clear();
+
+    const uint8_t* p = buf;
+    const uint8_t* end = buf + len;
+    auto fail = [this]() {
+        keys_.clear();
+        containers_.clear();
+        return false;
+    };
+
+    if (end - p < 4) {
+        return fail();
+    }
+    uint32_t cookie = get32(p);
+    p += 4;
+    size_t n = 0;
+    const uint8_t* run_flags = nullptr;
+    if ((cookie & 0xFFFF) == SERIAL_COOKIE) {
+        n = (cookie >> 16) + 1;
+        if (size_t(end - p) < (n + 7) / 8) {
+            return fail();
+        }
+        run_flags = p;
+        p += (n + 7) / 8;
+    } else if (cookie == SERIAL_COOKIE_NO_RUNCONTAINER) {
+        if (end - p < 4) {
+            return fail();
+        }
+        n = get32(p);
+        p += 4;
+    } else {
+        return fail();
+    }
+    if (n > (1 << 16) || size_t(end - p) < 4 * n) {
+        return fail();
+    }
+
+    const uint8_t* header = p;
+    p += 4 * n;
+    if (!run_flags || n >= NO_OFFSET_THRESHOLD) {
+        if (size_t(end - p) < 4 * n) {
+            return fail();
+        }
+        p += 4 * n;
+    }
+
+    keys_.resize(n);
+    containers_.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        uint16_t key = get16(header + 4 * i);
+        size_t card = size_t(get16(header + 4 * i + 2)) + 1;
+        if (i > 0 && key <= keys_[i - 1]) {
+            return fail();
+        }
+        keys_[i] = key;
+        auto& c = containers_[i];
+        c.cardinality = uint32_t(card);
+        bool is_run = run_flags && ((run_flags[i >> 3] >> (i & 0x7)) & 0x1);
+        if (is_run) {
+            if (end - p < 2) {
+                return fail();
+            }
+            size_t runs = get16(p);
+            p += 2;
+            if (size_t(end - p) < 4 * runs) {
+                return fail();
+            }
+            c.type = Container::RUN;
+            c.values.resize(runs * 2);
+            memcpy(c.values.data(), p, 4 * runs);
+            p += 4 * runs;
+            size_t total = 0;
+            for (size_t r = 0; r < runs; r++) {
+                if (size_t(c.values[2 * r]) + c.values[2 * r + 1] >= CHUNK_BITS ||
+                    (r > 0 && c.values[2 * r] <= size_t(c.values[2 * r - 2]) + c.values[2 * r - 1] + 1)) {
+                    return fail();
+                }
+                total += size_t(c.values[2 * r + 1]) + 1;
+            }
+            if (total != card) {
+                return fail();
+            }
+        } else if (card <= ARRAY_MAX) {
+            if (size_t(end - p) < 2 * card) {
+                return fail();
+            }
+            c.type = Container::ARRAY;
+            c.values.resize(card);
+            memcpy(c.values.data(), p, 2 * card);
+            p += 2 * card;
+            for (size_t k = 1; k < card; k++) {
+                if (c.values[k] <= c.values[k - 1]) {
+                    return fail();
+                }
+            }
+        } else {
+            if (size_t(end - p) < CHUNK_BYTES) {
+                return fail();
+            }
+            c.type = Container::BITMAP;
+            c.words.resize(CHUNK_WORDS);
+            memcpy(c.words.data(), p, CHUNK_BYTES);
+            p += CHUNK_BYTES;
+            if (kernels::popcount(reinterpret_cast<const uint8_t*>(c.words.data()), CHUNK_BITS) != card) {
+                return fail();
+            }
+        }
+    }
+    return true;
+}
+
+bool
+operator==(const RoaringBitset& lhs, const RoaringBitset& rhs) {
+    if (std::addressof(lhs) == std::addressof(rhs)) {
+        return true;
+    }
+    if (lhs.keys_ != rhs.keys_) {
+        return false;
+    }
+    uint64_t lhs_words[CHUNK_WORDS], rhs_words[CHUNK_WORDS];
+    for (size_t i = 0; i < lhs.containers_.size(); i++) {
+        auto& l = lhs.containers_[i];
+        auto& r = rhs.containers_[i];
+        if (l.cardinality != r.cardinality) {
+            return false;
+        }
+        if (l.type == r.type && l.type != RoaringBitset::Container::BITMAP) {
+            if (l.values != r.values) {
+                return false;
+            }
+            continue;
+        }
+        to_words(l, lhs_words);
+        to_words(r, rhs_words);
+        if (memcmp(lhs_words, rhs_words, CHUNK_BYTES) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+operator!=(const RoaringBitset& lhs, const RoaringBitset& rhs) {
+    return !(lhs == rhs);
+}
+
+}  // namespace faiss
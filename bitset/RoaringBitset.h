@@ -0,0 +1,226 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "BitsetView.h"
+
+namespace faiss {
+
+// Compressed bitset in the Roaring layout: ids are split into 64K chunks by
+// their high 16 bits, and each non-empty chunk is stored in whichever of
+// three containers is smallest:
+//   - array:  sorted low 16 bits, for chunks with at most 4096 bits set
+//   - bitmap: 1024 words, for dense chunks
+//   - run:    (start, length - 1) pairs, for long stretches of 1s
+// Ids are limited to 32 bits, as in the portable Roaring format, which
+// serialize()/deserialize() read and write.
+//
+// Binary operators accept another RoaringBitset or a flat BitsetView (and
+// so any ConcurrentBitset). and_into/or_into/andnot_into/xor_into apply
+// this bitset to a flat buffer in place, and materialize() fills a flat
+// buffer for call sites that only take a BitsetView.
+class RoaringBitset {
+ public:
+    using id_type_t = int64_t;
+
+    RoaringBitset() = default;
+
+    // compress the first size() bits of a flat bitset
+    explicit RoaringBitset(const BitsetView& view);
+
+    RoaringBitset&
+    operator&=(const RoaringBitset& bitset);
+
+    RoaringBitset&
+    operator&=(const BitsetView& view);
+
+    std::shared_ptr<RoaringBitset>
+    operator&(const RoaringBitset& bitset) const;
+
+    std::shared_ptr<RoaringBitset>
+    operator&(const BitsetView& view) const;
+
+    RoaringBitset&
+    operator|=(const RoaringBitset& bitset);
+
+    RoaringBitset&
+    operator|=(const BitsetView& view);
+
+    std::shared_ptr<RoaringBitset>
+    operator|(const RoaringBitset& bitset) const;
+
+    std::shared_ptr<RoaringBitset>
+    operator|(const BitsetView& view) const;
+
+    RoaringBitset&
+    operator^=(const RoaringBitset& bitset);
+
+    RoaringBitset&
+    operator^=(const BitsetView& view);
+
+    std::shared_ptr<RoaringBitset>
+    operator^(const RoaringBitset& bitset) const;
+
+    std::shared_ptr<RoaringBitset>
+    operator^(const BitsetView& view) const;
+
+    // andnot: keep the bits that are not set in the operand
+    RoaringBitset&
+    operator-=(const RoaringBitset& bitset);
+
+    RoaringBitset&
+    operator-=(const BitsetView& view);
+
+    std::shared_ptr<RoaringBitset>
+    operator-(const RoaringBitset& bitset) const;
+
+    std::shared_ptr<RoaringBitset>
+    operator-(const BitsetView& view) const;
+
+    bool
+    test(id_type_t id) const;
+
+    void
+    set(id_type_t id);
+
+    void
+    clear(id_type_t id);
+
+    bool
+    empty() const {
+        return keys_.empty();
+    }
+
+    size_t
+    count() const;
+
+    // bytes held by the containers
+    size_t
+    memory_size() const;
+
+    // re-pick the smallest container for every chunk; set/clear only
+    // switch between array and bitmap, bulk operations always re-pick
+    void
+    optimize();
+
+    // call func(id) for every 1-bit, in increasing order
+    template <typename Func>
+    void
+    for_each(Func func) const;
+
+    // write this bitset into blocks as a flat bitset of size bits
+    void
+    materialize(uint8_t* blocks, size_t size) const;
+
+    // blocks op= this, over the first size bits of a flat bitset
+    void
+    and_into(uint8_t* blocks, size_t size) const;
+
+    void
+    or_into(uint8_t* blocks, size_t size) const;
+
+    void
+    andnot_into(uint8_t* blocks, size_t size) const;
+
+    void
+    xor_into(uint8_t* blocks, size_t size) const;
+
+    // portable Roaring serialization format
+    size_t
+    serialized_size() const;
+
+    void
+    serialize(uint8_t* buf) const;
+
+    std::vector<uint8_t>
+    serialize() const;
+
+    // return false, leaving this bitset empty, if buf is not a valid
+    // serialized bitset of at most len bytes
+    bool
+    deserialize(const uint8_t* buf, size_t len);
+
+    friend bool
+    operator==(const RoaringBitset& lhs, const RoaringBitset& rhs);
+
+ public:
+    struct Container {
+        enum Type : uint8_t { ARRAY, BITMAP, RUN };
+
+        Type type = ARRAY;
+        uint32_t cardinality = 0;
+        // ARRAY: sorted values; RUN: (start, length - 1) pairs
+        std::vector<uint16_t> values;
+        // BITMAP: 1024 words
+        std::vector<uint64_t> words;
+    };
+
+ private:
+    template <typename Op>
+    RoaringBitset&
+    apply(const RoaringBitset& bitset);
+
+    template <typename Op>
+    RoaringBitset&
+    apply(const BitsetView& view);
+
+    template <typename Op>
+    void
+    apply_into(uint8_t* blocks, size_t size) const;
+
+ private:
+    std::vector<uint16_t> keys_;  // sorted high 16 bits of the ids
+    std::vector<Container> containers_;
+};
+
+bool
+operator==(const RoaringBitset& lhs, const RoaringBitset& rhs);
+bool
+operator!=(const RoaringBitset& lhs, const RoaringBitset& rhs);
+
+using RoaringBitsetPtr = std::shared_ptr<RoaringBitset>;
+
+template <typename Func>
+void
+RoaringBitset::for_each(Func func) const {
+    for (size_t i = 0; i < keys_.size(); i++) {
+        uint32_t base = uint32_t(keys_[i]) << 16;
+        auto& c = containers_[i];
+        if (c.type == Container::ARRAY) {
+            for (auto v : c.values) {
+                func(id_type_t(base | v));
+            }
+        } else if (c.type == Container::BITMAP) {
+            for (size_t w = 0; w < c.words.size(); w++) {
+                uint64_t word = c.words[w];
+                while (word) {
+                    func(id_type_t(base | (w << 6) | __builtin_ctzll(word)));
+                    word &= word - 1;
+                }
+            }
+        } else {
+            for (size_t r = 0; r < c.values.size(); r += 2) {
+                uint32_t start = c.values[r];
+                uint32_t end = start + c.values[r + 1];
+                for (uint32_t v = start; v <= end; v++) {
+                    func(id_type_t(base | v));
+                }
+            }
+        }
+    }
+}
+
+}  // namespace faiss
@@ -0,0 +1,555 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+#include "BitsetKernels.h"
+#include "ScanKernels.h"
+
+namespace faiss {
+
+namespace {
+
+// A predicate is one or more comparisons against constants, combined with
+// AND (between) or OR (in).
+template <typename T>
+struct Term {
+    CompareOp op;
+    T value;
+};
+
+template <typename W>
+inline W
+merge_bits(W old_bits, W new_bits, ScanMerge merge) {
+    switch (merge) {
+        case ScanMerge::AND:
+            return old_bits & new_bits;
+        case ScanMerge::OR:
+            return old_bits | new_bits;
+        default:
+            return new_bits;
+    }
+}
+
+template <typename T, typename Compare>
+inline uint64_t
+collect(const T* p, size_t len, T value, Compare compare) {
+    uint64_t mask = 0;
+    for (size_t j = 0; j < len; j++) {
+        mask |= uint64_t(compare(p[j], value)) << j;
+    }
+    return mask;
+}
+
+// mask of the first len (at most 64) rows of p
+template <typename T>
+inline uint64_t
+compare_scalar(const T* p, size_t len, CompareOp op, T value) {
+    switch (op) {
+        case CompareOp::EQ:
+            return collect(p, len, value, std::equal_to<T>());
+        case CompareOp::NE:
+            return collect(p, len, value, std::not_equal_to<T>());
+        case CompareOp::LT:
+            return collect(p, len, value, std::less<T>());
+        case CompareOp::LE:
+            return collect(p, len, value, std::less_equal<T>());
+        case CompareOp::GT:
+            return collect(p, len, value, std::greater<T>());
+        default:
+            return collect(p, len, value, std::greater_equal<T>());
+    }
+}
+
+template <typename T>
+uint64_t
+predicate_scalar(const T* p, size_t len, const Term<T>* terms, size_t n_terms, bool all) {
+    uint64_t mask = all ? ~uint64_t(0) : 0;
+    for (size_t t = 0; t < n_terms; t++) {
+        uint64_t m = compare_scalar(p, len, terms[t].op, terms[t].value);
+        mask = all ? mask & m : mask | m;
+    }
+    return mask;
+}
+
+// rows [begin, n), begin a multiple of 64
+template <typename T>
+void
+scan_scalar(const T* column, size_t begin, size_t n, const Term<T>* terms, size_t n_terms, bool all, uint8_t* dst,
+            ScanMerge merge) {
+    size_t n64 = n / 64;
+    for (size_t i = begin / 64; i < n64; i++) {
+        uint64_t mask = predicate_scalar(column + i * 64, 64, terms, n_terms, all);
+        kernels::store_u64(dst + i * 8, merge_bits(kernels::load_u64(dst + i * 8), mask, merge));
+    }
+
+    size_t len = n - n64 * 64;
+    if (len == 0) {
+        return;
+    }
+    uint64_t mask = predicate_scalar(column + n64 * 64, len, terms, n_terms, all);
+    uint8_t* out = dst + n64 * 8;
+    for (size_t b = 0; b * 8 < len; b++) {
+        uint8_t bits = uint8_t(mask >> (b * 8));
+        // bits past n keep their value
+        uint8_t keep = len - b * 8 >= 8 ? 0 : uint8_t(0xff << (len - b * 8));
+        out[b] = (out[b] & keep) | (merge_bits<uint8_t>(out[b], bits, merge) & ~keep);
+    }
+}
+
+#if defined(__x86_64__)
+
+// Per-type lane helpers: compare() returns one bit per lane of the vector
+// loaded from p. The AVX2 integer helpers only see EQ, LT and GT; the
+// other operators are their complements, taken on the 64-bit mask.
+
+template <typename T>
+struct Avx2Lanes;
+
+template <>
+struct Avx2Lanes<int8_t> {
+    static constexpr size_t lanes = 32;
+
+    BITSET_TARGET_AVX2 static __m256i
+    set1(int8_t value) {
+        return _mm256_set1_epi8(value);
+    }
+
+    BITSET_TARGET_AVX2 static uint64_t
+    compare(const int8_t* p, __m256i b, CompareOp op) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i m = op == CompareOp::EQ ? _mm256_cmpeq_epi8(a, b)
+                                        : (op == CompareOp::LT ? _mm256_cmpgt_epi8(b, a) : _mm256_cmpgt_epi8(a, b));
+        return uint32_t(_mm256_movemask_epi8(m));
+    }
+};
+
+template <>
+struct Avx2Lanes<int16_t> {
+    static constexpr size_t lanes = 16;
+
+    BITSET_TARGET_AVX2 static __m256i
+    set1(int16_t value) {
+        return _mm256_set1_epi16(value);
+    }
+
+    BITSET_TARGET_AVX2 static uint64_t
+    compare(const int16_t* p, __m256i b, CompareOp op) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i m = op == CompareOp::EQ ? _mm256_cmpeq_epi16(a, b)
+                                        : (op == CompareOp::LT ? _mm256_cmpgt_epi16(b, a) : _mm256_cmpgt_epi16(a, b));
+        // narrow the 16-bit lanes to bytes, then undo the per-128-bit interleave of packs
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(m, _mm256_setzero_si256()), 0xd8);
+        return uint32_t(_mm256_movemask_epi8(packed)) & 0xffff;
+    }
+};
+
+template <>
+struct Avx2Lanes<int32_t> {
+    static constexpr size_t lanes = 8;
+
+    BITSET_TARGET_AVX2 static __m256i
+    set1(int32_t value) {
+        return _mm256_set1_epi32(value);
+    }
+
+    BITSET_TARGET_AVX2 static uint64_t
+    compare(const int32_t* p, __m256i b, CompareOp op) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i m = op == CompareOp::EQ ? _mm256_cmpeq_epi32(a, b)
+                                        : (op == CompareOp::LT ? _mm256_cmpgt_epi32(b, a) : _mm256_cmpgt_epi32(a, b));
+        return uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+    }
+};
+
+template <>
+struct Avx2Lanes<int64_t> {
+    static constexpr size_t lanes = 4;
+
+    BITSET_TARGET_AVX2 static __m256i
+    set1(int64_t value) {
+        return _mm256_set1_epi64x(value);
+    }
+
+    BITSET_TARGET_AVX2 static uint64_t
+    compare(const int64_t* p, __m256i b, CompareOp op) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i m = op == CompareOp::EQ ? _mm256_cmpeq_epi64(a, b)
+                                        : (op == CompareOp::LT ? _mm256_cmpgt_epi64(b, a) : _mm256_cmpgt_epi64(a, b));
+        return uint32_t(_mm256_movemask_pd(_mm256_castsi256_pd(m)));
+    }
+};
+
+template <>
+struct Avx2Lanes<float> {
+    static constexpr size_t lanes = 8;
+
+    BITSET_TARGET_AVX2 static __m256
+    set1(float value) {
+        return _mm256_set1_ps(value);
+    }
+
+    BITSET_TARGET_AVX2 static uint64_t
+    compare(const float* p, __m256 b, CompareOp op) {
+        __m256 a = _mm256_loadu_ps(p);
+        switch (op) {
+            case CompareOp::EQ:
+                return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_EQ_OQ)));
+            case CompareOp::NE:
+                return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_NEQ_UQ)));
+            case CompareOp::LT:
+                return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ)));
+            case CompareOp::LE:
+                return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ)));
+            case CompareOp::GT:
+                return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ)));
+            default:
+                return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GE_OQ)));
+        }
+    }
+};
+
+template <>
+struct Avx2Lanes<double> {
+    static constexpr size_t lanes = 4;
+
+    BITSET_TARGET_AVX2 static __m256d
+    set1(double value) {
+        return _mm256_set1_pd(value);
+    }
+
+    BITSET_TARGET_AVX2 static uint64_t
+    compare(const double* p, __m256d b, CompareOp op) {
+        __m256d a = _mm256_loadu_pd(p);
+        switch (op) {
+            case CompareOp::EQ:
+                return uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_EQ_OQ)));
+            case CompareOp::NE:
+                return uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_NEQ_UQ)));
+            case CompareOp::LT:
+                return uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ)));
+            case CompareOp::LE:
+                return uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LE_OQ)));
+            case CompareOp::GT:
+                return uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GT_OQ)));
+            default:
+                return uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GE_OQ)));
+        }
+    }
+};
+
+template <typename T>
+BITSET_TARGET_AVX2 inline uint64_t
+compare64_avx2(const T* p, CompareOp op, T value) {
+    using Lanes = Avx2Lanes<T>;
+    bool invert = false;
+    if constexpr (std::is_integral<T>::value) {
+        invert = op == CompareOp::NE || op == CompareOp::LE || op == CompareOp::GE;
+        op = op == CompareOp::NE ? CompareOp::EQ
+                                 : (op == CompareOp::LE ? CompareOp::GT : (op == CompareOp::GE ? CompareOp::LT : op));
+    }
+    auto b = Lanes::set1(value);
+    uint64_t mask = 0;
+    for (size_t k = 0; k < 64; k += Lanes::lanes) {
+        mask |= Lanes::compare(p + k, b, op) << k;
+    }
+    return invert ? ~mask : mask;
+}
+
+// returns the number of rows written, a multiple of 64
+template <typename T>
+BITSET_TARGET_AVX2 size_t
+scan_avx2(const T* column, size_t n, const Term<T>* terms, size_t n_terms, bool all, uint8_t* dst, ScanMerge merge) {
+    size_t n64 = n / 64;
+    for (size_t i = 0; i < n64; i++) {
+        uint64_t mask = all ? ~uint64_t(0) : 0;
+        for (size_t t = 0; t < n_terms; t++) {
+            uint64_t m = compare64_avx2(column + i * 64, terms[t].op, terms[t].value);
+            mask = all ? mask & m : mask | m;
+        }
+        kernels::store_u64(dst + i * 8, merge_bits(kernels::load_u64(dst + i * 8), mask, merge));
+    }
+    return n64 * 64;
+}
+
+template <typename T>
+struct Avx512Lanes;
+
+template <>
+struct Avx512Lanes<int8_t> {
+    static constexpr size_t lanes = 64;
+
+    BITSET_TARGET_AVX512 static __m512i
+    set1(int8_t value) {
+        return _mm512_set1_epi8(value);
+    }
+
+    BITSET_TARGET_AVX512 static uint64_t
+    compare(const int8_t* p, __m512i b, CompareOp op) {
+        __m512i a = _mm512_loadu_si512(p);
+        switch (op) {
+            case CompareOp::EQ:
+                return _mm512_cmpeq_epi8_mask(a, b);
+            case CompareOp::NE:
+                return _mm512_cmpneq_epi8_mask(a, b);
+            case CompareOp::LT:
+                return _mm512_cmplt_epi8_mask(a, b);
+            case CompareOp::LE:
+                return _mm512_cmple_epi8_mask(a, b);
+            case CompareOp::GT:
+                return _mm512_cmpgt_epi8_mask(a, b);
+            default:
+                return _mm512_cmpge_epi8_mask(a, b);
+        }
+    }
+};
+
+template <>
+struct Avx512Lanes<int16_t> {
+    static constexpr size_t lanes = 32;
+
+    BITSET_TARGET_AVX512 static __m512i
+    set1(int16_t value) {
+        return _mm512_set1_epi16(value);
+    }
+
+    BITSET_TARGET_AVX512 static uint64_t
+    compare(const int16_t* p, __m512i b, CompareOp op) {
+        __m512i a = _mm512_loadu_si512(p);
+        switch (op) {
+            case CompareOp::EQ:
+                return _mm512_cmpeq_epi16_mask(a, b);
+            case CompareOp::NE:
+                return _mm512_cmpneq_epi16_mask(a, b);
+            case CompareOp::LT:
+                return _mm512_cmplt_epi16_mask(a, b);
+            case CompareOp::LE:
+                return _mm512_cmple_epi16_mask(a, b);
+            case CompareOp::GT:
+                return _mm512_cmpgt_epi16_mask(a, b);
+            default:
+                return _mm512_cmpge_epi16_mask(a, b);
+        }
+    }
+};
+
+template <>
+struct Avx512Lanes<int32_t> {
+    static constexpr size_t lanes = 16;
+
+    BITSET_TARGET_AVX512 static __m512i
+    set1(int32_t value) {
+        return _mm512_set1_epi32(value);
+    }
+
+    BITSET_TARGET_AVX512 static uint64_t
+    compare(const int32_t* p, __m512i b, CompareOp op) {
+        __m512i a = _mm512_loadu_si512(p);
+        switch (op) {
+            case CompareOp::EQ:
+                return _mm512_cmpeq_epi32_mask(a, b);
+            case CompareOp::NE:
+                return _mm512_cmpneq_epi32_mask(a, b);
+            case CompareOp::LT:
+                return _mm512_cmplt_epi32_mask(a, b);
+            case CompareOp::LE:
+                return _mm512_cmple_epi32_mask(a, b);
+            case CompareOp::GT:
+                return _mm512_cmpgt_epi32_mask(a, b);
+            default:
+                return _mm512_cmpge_epi32_mask(a, b);
+        }
+    }
+};
+
+template <>
+struct Avx512Lanes<int64_t> {
+    static constexpr size_t lanes = 8;
+
+    BITSET_TARGET_AVX512 static __m512i
+    set1(int64_t value) {
+        return _mm512_set1_epi64(value);
+    }
+
+    BITSET_TARGET_AVX512 static uint64_t
+    compare(const int64_t* p, __m512i b, CompareOp op) {
+        __m512i a = _mm512_loadu_si512(p);
+        switch (op) {
+            case CompareOp::EQ:
+                return _mm512_cmpeq_epi64_mask(a, b);
+            case CompareOp::NE:
+                return _mm512_cmpneq_epi64_mask(a, b);
+            case CompareOp::LT:
+                return _mm512_cmplt_epi64_mask(a, b);
+            case CompareOp::LE:
+                return _mm512_cmple_epi64_mask(a, b);
+            case CompareOp::GT:
+                return _mm512_cmpgt_epi64_mask(a, b);
+            default:
+                return _mm512_cmpge_epi64_mask(a, b);
+        }
+    }
+};
+
+template <>
+struct Avx512Lanes<float> {
+    static constexpr size_t lanes = 16;
+
+    BITSET_TARGET_AVX512 static __m512
+    set1(float value) {
+        return _mm512_set1_ps(value);
+    }
+
+    BITSET_TARGET_AVX512 static uint64_t
+    compare(const float* p, __m512 b, CompareOp op) {
+        __m512 a = _mm512_loadu_ps(p);
+        switch (op) {
+            case CompareOp::EQ:
+                return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ);
+            case CompareOp::NE:
+                return _mm512_cmp_ps_mask(a, b, _CMP_NEQ_UQ);
+            case CompareOp::LT:
+                return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ);
+            case CompareOp::LE:
+                return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ);
+            case CompareOp::GT:
+                return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ);
+            default:
+                return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ);
+        }
+    }
+};
+
+template <>
+struct Avx512Lanes<double> {
+    static constexpr size_t lanes = 8;
+
+    BITSET_TARGET_AVX512 static __m512d
+    set1(double value) {
+        return _mm512_set1_pd(value);
+    }
+
+    BITSET_TARGET_AVX512 static uint64_t
+    compare(const double* p, __m512d b, CompareOp op) {
+        __m512d a = _mm512_loadu_pd(p);
+        switch (op) {
+            case CompareOp::EQ:
+                return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ);
+            case CompareOp::NE:
+                return _mm512_cmp_pd_mask(a, b, _CMP_NEQ_UQ);
+            case CompareOp::LT:
+                return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ);
+            case CompareOp::LE:
+                return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ);
+            case CompareOp::GT:
+                return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ);
+            default:
+                return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ);
+        }
+    }
+};
+
+template <typename T>
+BITSET_TARGET_AVX512 inline uint64_t
+compare64_avx512(const T* p, CompareOp op, T value) {
+    using Lanes = Avx512Lanes<T>;
+    auto b = Lanes::set1(value);
+    uint64_t mask = 0;
+    for (size_t k = 0; k < 64; k += Lanes::lanes) {
+        mask |= Lanes::compare(p + k, b, op) << k;
+    }
+    return mask;
+}
+
+template <typename T>
+BITSET_TARGET_AVX512 size_t
+scan_avx512(const T* column, size_t n, const Term<T>* terms, size_t n_terms, bool all, uint8_t* dst,
+            ScanMerge merge) {
+    size_t n64 = n / 64;
+    for (size_t i = 0; i < n64; i++) {
+        uint64_t mask = all ? ~uint64_t(0) : 0;
+        for (size_t t = 0; t < n_terms; t++) {
+            uint64_t m = compare64_avx512(column + i * 64, terms[t].op, terms[t].value);
+            mask = all ? mask & m : mask | m;
+        }
+        kernels::store_u64(dst + i * 8, merge_bits(kernels::load_u64(dst + i * 8), mask, merge));
+    }
+    return n64 * 64;
+}
+
+#endif
+
+// all: the terms are AND-ed, otherwise OR-ed
+template <typename T>
+void
+scan(const T* column, size_t n, const std::vector<Term<T>>& terms, bool all, uint8_t* dst, ScanMerge merge,
+     SimdLevel level) {
+    size_t done = 0;
+#if defined(__x86_64__)
+    if (level == SimdLevel::AVX512) {
+        done = scan_avx512(column, n, terms.data(), terms.size(), all, dst, merge);
+    } else if (level == SimdLevel::AVX2) {
+        done = scan_avx2(column, n, terms.data(), terms.size(), all, dst, merge);
+    }
+#endif
+    scan_scalar(column, done, n, terms.data(), terms.size(), all, dst, merge);
+}
+
+}  // namespace
+
+template <typename T>
+void
+scan_compare(const T* column, size_t n, CompareOp op, T value, uint8_t* dst, ScanMerge merge, SimdLevel level) {
+    scan(column, n, std::vector<Term<T>>{{op, value}}, true, dst, merge, level);
+}
+
+template <typename T>
+void
+scan_between(const T* column, size_t n, T lower, T upper, uint8_t* dst, ScanMerge merge, bool lower_inclusive,
+             bool upper_inclusive, SimdLevel level) {
+    std::vector<Term<T>> terms{{lower_inclusive ? CompareOp::GE : CompareOp::GT, lower},
+                               {upper_inclusive ? CompareOp::LE : CompareOp::LT, upper}};
+    scan(column, n, terms, true, dst, merge, level);
+}
+
+template <typename T>
+void
+scan_in(const T* column, size_t n, const T* values, size_t n_values, uint8_t* dst, ScanMerge merge,
+        SimdLevel level) {
+    std::vector<Term<T>> terms;
+    terms.reserve(n_values);
+    for (size_t i = 0; i < n_values; i++) {
+        terms.push_back({CompareOp::EQ, values[i]});
+    }
+    scan(column, n, terms, false, dst, merge, level);
+}
+
+#define INSTANTIATE_SCAN(T)                                                                                    \
+    template void scan_compare<T>(const T*, size_t, CompareOp, T, uint8_t*, ScanMerge, SimdLevel);           \
+    template void scan_between<T>(const T*, size_t, T, T, uint8_t*, ScanMerge, bool, bool, SimdLevel);       \
+    template void scan_in<T>(const T*, size_t, const T*, size_t, uint8_t*, ScanMerge, SimdLevel);
+
+INSTANTIATE_SCAN(int8_t)
+INSTANTIATE_SCAN(int16_t)
+INSTANTIATE_SCAN(int32_t)
+INSTANTIATE_SCAN(int64_t)
+INSTANTIATE_SCAN(float)
+INSTANTIATE_SCAN(double)
+
+#undef INSTANTIATE_SCAN
+
+}  // namespace faiss
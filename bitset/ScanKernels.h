@@ -0,0 +1,68 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Simd.h"
+
+namespace faiss {
+
+// Predicate scans over a column of n values: bit i of dst is set when
+// column[i] matches. Each block of 64 rows is compared into one 64-bit
+// mask, which is stored straight into dst (usually a bitset's
+// mutable_data()). With merge AND/OR the mask is combined with the bits
+// already in dst, so multi-column filters can be accumulated in place.
+// Bits of dst past n are left untouched.
+//
+// Writing through the raw buffer bypasses count tracking; call
+// enable_count_tracking() again on the target bitset if it was on.
+//
+// Comparisons follow the C++ operators, so NaN only matches NE.
+// Instantiated for int8_t, int16_t, int32_t, int64_t, float and double.
+
+enum class CompareOp {
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE,
+};
+
+enum class ScanMerge {
+    ASSIGN,  // dst = mask
+    AND,     // dst &= mask
+    OR,      // dst |= mask
+};
+
+// column[i] op value
+template <typename T>
+void
+scan_compare(const T* column, size_t n, CompareOp op, T value, uint8_t* dst, ScanMerge merge = ScanMerge::ASSIGN,
+             SimdLevel level = simd_level());
+
+// lower <= column[i] <= upper, each bound optionally exclusive
+template <typename T>
+void
+scan_between(const T* column, size_t n, T lower, T upper, uint8_t* dst, ScanMerge merge = ScanMerge::ASSIGN,
+             bool lower_inclusive = true, bool upper_inclusive = true, SimdLevel level = simd_level());
+
+// column[i] equals one of values; every block is compared against each
+// value in turn, so this is meant for short lists
+template <typename T>
+void
+scan_in(const T* column, size_t n, const T* values, size_t n_values, uint8_t* dst,
+        ScanMerge merge = ScanMerge::ASSIGN, SimdLevel level = simd_level());
+
+}  // namespace faiss
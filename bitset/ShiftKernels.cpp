@@ -0,0 +1,199 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+#include "BitsetKernels.h"
+#include "ShiftKernels.h"
+
+namespace faiss {
+namespace kernels {
+
+namespace {
+
+// word w of a buffer of nbits bits; bits past nbits read as 0
+inline uint64_t
+load_word(const uint8_t* data, size_t nbits, size_t w) {
+    if (w * 64 >= nbits) {
+        return 0;
+    }
+    uint64_t word = 0;
+    size_t remain = nbits - w * 64;
+    if (remain >= 64) {
+        memcpy(&word, data + w * 8, 8);
+        return word;
+    }
+    memcpy(&word, data + w * 8, (remain + 7) / 8);
+    return word & ((uint64_t(1) << remain) - 1);
+}
+
+// write word w of a buffer of nbits bits, clearing bits past nbits
+inline void
+store_word(uint8_t* data, size_t nbits, size_t w, uint64_t word) {
+    size_t remain = nbits - w * 64;
+    if (remain >= 64) {
+        memcpy(data + w * 8, &word, 8);
+        return;
+    }
+    word &= (uint64_t(1) << remain) - 1;
+    memcpy(data + w * 8, &word, (remain + 7) / 8);
+}
+
+// lo's bits from r on, topped up with hi's low bits
+inline uint64_t
+funnel_down(uint64_t lo, uint64_t hi, size_t r) {
+    return r ? (lo >> r) | (hi << (64 - r)) : lo;
+}
+
+// hi's bits moved up by r, filled from below with lo's high bits
+inline uint64_t
+funnel_up(uint64_t lo, uint64_t hi, size_t r) {
+    return r ? (hi << r) | (lo >> (64 - r)) : hi;
+}
+
+// Vector bodies over whole words only, dst[i] from src[i + q] and
+// src[i + q + 1] (down) or src[i - q] and src[i - q - 1] (up). A shift by
+// 64 yields 0 in the vector shifts, so r == 0 needs no special case.
+// Return where the scalar loop has to pick up.
+
+#if defined(__x86_64__)
+
+BITSET_TARGET_AVX512 size_t
+shift_down_avx512(uint64_t* dst, const uint64_t* src, size_t q, size_t r, size_t begin, size_t end) {
+    __m128i right = _mm_cvtsi64_si128(int64_t(r));
+    __m128i left = _mm_cvtsi64_si128(int64_t(64 - r));
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m512i lo = _mm512_loadu_si512(src + i + q);
+        __m512i hi = _mm512_loadu_si512(src + i + q + 1);
+        _mm512_storeu_si512(dst + i, _mm512_or_si512(_mm512_srl_epi64(lo, right), _mm512_sll_epi64(hi, left)));
+    }
+    return i;
+}
+
+BITSET_TARGET_AVX2 size_t
+shift_down_avx2(uint64_t* dst, const uint64_t* src, size_t q, size_t r, size_t begin, size_t end) {
+    __m128i right = _mm_cvtsi64_si128(int64_t(r));
+    __m128i left = _mm_cvtsi64_si128(int64_t(64 - r));
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + q));
+        __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + q + 1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            _mm256_or_si256(_mm256_srl_epi64(lo, right), _mm256_sll_epi64(hi, left)));
+    }
+    return i;
+}
+
+// walks down from end, so dst may alias src
+BITSET_TARGET_AVX512 size_t
+shift_up_avx512(uint64_t* dst, const uint64_t* src, size_t q, size_t r, size_t begin, size_t end) {
+    __m128i left = _mm_cvtsi64_si128(int64_t(r));
+    __m128i right = _mm_cvtsi64_si128(int64_t(64 - r));
+    size_t i = end;
+    for (; i >= begin + 8; i -= 8) {
+        __m512i hi = _mm512_loadu_si512(src + i - 8 - q);
+        __m512i lo = _mm512_loadu_si512(src + i - 8 - q - 1);
+        _mm512_storeu_si512(dst + i - 8, _mm512_or_si512(_mm512_sll_epi64(hi, left), _mm512_srl_epi64(lo, right)));
+    }
+    return i;
+}
+
+BITSET_TARGET_AVX2 size_t
+shift_up_avx2(uint64_t* dst, const uint64_t* src, size_t q, size_t r, size_t begin, size_t end) {
+    __m128i left = _mm_cvtsi64_si128(int64_t(r));
+    __m128i right = _mm_cvtsi64_si128(int64_t(64 - r));
+    size_t i = end;
+    for (; i >= begin + 4; i -= 4) {
+        __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i - 4 - q));
+        __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i - 4 - q - 1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i - 4),
+                            _mm256_or_si256(_mm256_sll_epi64(hi, left), _mm256_srl_epi64(lo, right)));
+    }
+    return i;
+}
+
+#endif
+
+}  // namespace
+
+void
+shift_down(uint8_t* dst, const uint8_t* src, size_t src_bits, size_t offset, size_t nbits, SimdLevel level) {
+    size_t q = offset / 64;
+    size_t r = offset % 64;
+    size_t n_words = (nbits + 63) / 64;
+
+    // words whose two source words are both whole, and which are whole
+    // themselves, need no bounds handling
+    size_t src_full = src_bits / 64;
+    size_t fast_end = std::min(nbits / 64, src_full > q + 1 ? src_full - q - 1 : 0);
+
+    size_t i = 0;
+#if defined(__x86_64__)
+    auto dst_64 = reinterpret_cast<uint64_t*>(dst);
+    auto src_64 = reinterpret_cast<const uint64_t*>(src);
+    if (level == SimdLevel::AVX512) {
+        i = shift_down_avx512(dst_64, src_64, q, r, 0, fast_end);
+    } else if (level == SimdLevel::AVX2) {
+        i = shift_down_avx2(dst_64, src_64, q, r, 0, fast_end);
+    }
+#endif
+    for (; i < fast_end; i++) {
+        store_u64(dst + i * 8, funnel_down(load_u64(src + (i + q) * 8), load_u64(src + (i + q + 1) * 8), r));
+    }
+    for (; i < n_words; i++) {
+        store_word(dst, nbits, i,
+                   funnel_down(load_word(src, src_bits, i + q), load_word(src, src_bits, i + q + 1), r));
+    }
+}
+
+void
+shift_up(uint8_t* dst, const uint8_t* src, size_t offset, size_t nbits, SimdLevel level) {
+    size_t q = offset / 64;
+    size_t r = offset % 64;
+    size_t n_words = (nbits + 63) / 64;
+    size_t full = nbits / 64;
+
+    // highest first, so that nothing is read after being overwritten
+    size_t i = n_words;
+    if (i > full) {
+        i--;
+        uint64_t hi = i >= q ? load_word(src, nbits, i - q) : 0;
+        uint64_t lo = i >= q + 1 ? load_word(src, nbits, i - q - 1) : 0;
+        store_word(dst, nbits, i, funnel_up(lo, hi, r));
+    }
+
+    // whole words with both source words in range
+    size_t fast_begin = std::min(q + 1, full);
+#if defined(__x86_64__)
+    auto dst_64 = reinterpret_cast<uint64_t*>(dst);
+    auto src_64 = reinterpret_cast<const uint64_t*>(src);
+    if (level == SimdLevel::AVX512) {
+        i = shift_up_avx512(dst_64, src_64, q, r, fast_begin, i);
+    } else if (level == SimdLevel::AVX2) {
+        i = shift_up_avx2(dst_64, src_64, q, r, fast_begin, i);
+    }
+#endif
+    for (; i > fast_begin; i--) {
+        store_u64(dst + (i - 1) * 8, funnel_up(load_u64(src + (i - q - 2) * 8), load_u64(src + (i - q - 1) * 8), r));
+    }
+    for (; i > 0; i--) {
+        store_u64(dst + (i - 1) * 8, i - 1 == q ? load_u64(src) << r : 0);
+    }
+}
+
+}  // namespace kernels
+}  // namespace faiss
@@ -0,0 +1,38 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Simd.h"
+
+namespace faiss {
+namespace kernels {
+
+// Bit moves at any offset, word by word: each output word is funnel-shifted
+// out of the two input words it straddles. Bits of dst past nbits in its
+// last byte are cleared; bytes past it are not touched. dst may alias src.
+
+// dst bit i = src bit (offset + i) for i < nbits; src bits at or past
+// src_bits read as 0
+void
+shift_down(uint8_t* dst, const uint8_t* src, size_t src_bits, size_t offset, size_t nbits,
+           SimdLevel level = simd_level());
+
+// dst bit i = src bit (i - offset) for offset <= i < nbits, 0 below offset;
+// src holds nbits bits
+void
+shift_up(uint8_t* dst, const uint8_t* src, size_t offset, size_t nbits, SimdLevel level = simd_level());
+
+}  // namespace kernels
+}  // namespace faiss
@@ -0,0 +1,33 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+// target attributes for the kernels of each level
+#define BITSET_TARGET_AVX2 __attribute__((target("avx2")))
+#define BITSET_TARGET_AVX512 __attribute__((target("avx512f,avx512vl,avx512bw,avx512dq,bmi2")))
+
+namespace faiss {
+
+// Instruction sets the hand-written kernels are compiled for. The library
+// is built without -march flags; each kernel carries its own target
+// attribute and is picked at run time from simd_level().
+enum class SimdLevel {
+    NONE,
+    AVX2,
+    AVX512,  // F + VL + BW + DQ, and BMI2 which every AVX-512 CPU has
+};
+
+// best level supported by the running CPU, detected once
+SimdLevel
+simd_level();
+
+}  // namespace faiss
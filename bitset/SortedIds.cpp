@@ -0,0 +1,162 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#include <algorithm>
+#include <cassert>
+
+#include "BitsetKernels.h"
+#include "SortedIds.h"
+
+namespace faiss {
+
+namespace {
+
+constexpr size_t PREFETCH_DISTANCE = 16;
+// prefetch only when ids are on average a cache line or more apart; for
+// denser lists the next bytes are already in cache
+constexpr int64_t PREFETCH_MIN_GAP = 512;
+// ids probed before picking the output form
+constexpr size_t SAMPLE_IDS = 1024;
+
+inline bool
+dense_enough(size_t estimate, size_t size) {
+    return estimate * 64 > size;
+}
+
+// Probe ids [begin, end) and hand each one to emit(id, match), match being
+// whether its bit (bit offset + id of blocks) equals Want, so callers can
+// compact without branching; returns the number of matches.
+template <bool Want, bool Prefetch, typename Emit>
+inline size_t
+probe_ids(const uint8_t* blocks, size_t offset, const int64_t* ids, size_t begin, size_t end, size_t n, Emit emit) {
+    size_t matches = 0;
+    for (size_t i = begin; i < end; i++) {
+        if (Prefetch && i + PREFETCH_DISTANCE < n) {
+            __builtin_prefetch(blocks + ((offset + ids[i + PREFETCH_DISTANCE]) >> 3));
+        }
+        int64_t id = ids[i];
+        assert(id >= 0);
+        size_t pos = offset + id;
+        bool match = ((blocks[pos >> 3] >> (pos & 0x7)) & 0x1) == Want;
+        emit(id, match);
+        matches += match;
+    }
+    return matches;
+}
+
+template <bool Want, typename Emit>
+inline size_t
+probe(const uint8_t* blocks, size_t offset, const int64_t* ids, size_t begin, size_t end, size_t n, Emit emit) {
+    bool prefetch = n && (ids[n - 1] - ids[0]) / int64_t(n) >= PREFETCH_MIN_GAP;
+    return prefetch ? probe_ids<Want, true>(blocks, offset, ids, begin, end, n, emit)
+                    : probe_ids<Want, false>(blocks, offset, ids, begin, end, n, emit);
+}
+
+template <bool Want>
+size_t
+select_sorted(const BitsetView& view, const int64_t* ids, size_t n, IdSet& out) {
+    // a bit of a complemented view equals Want where the stored bit does not
+    if (view.complemented()) {
+        return select_sorted<!Want>(~view, ids, n, out);
+    }
+    // a subview starting inside a byte is probed in place
+    const uint8_t* blocks = view.blocks();
+    size_t offset = view.offset();
+    out.bitset.reset();
+    out.ids.resize(n);
+    int64_t* dst = out.ids.data();
+    size_t k = 0;
+    auto compact = [&](int64_t id, bool match) {
+        dst[k] = id;
+        k += match;
+    };
+
+    size_t sample = std::min(n, SAMPLE_IDS);
+    probe<Want>(blocks, offset, ids, 0, sample, n, compact);
+    if (sample == 0 || !dense_enough(k * n / sample, view.size())) {
+        probe<Want>(blocks, offset, ids, sample, n, n, compact);
+        out.ids.resize(k);
+        return k;
+    }
+
+    out.bitset = std::make_shared<ConcurrentBitset2>(view.size());
+    uint8_t* bits = out.bitset->mutable_data();
+    for (size_t i = 0; i < k; i++) {
+        bits[dst[i] >> 3] |= uint8_t(1) << (dst[i] & 0x7);
+    }
+    k += probe<Want>(blocks, offset, ids, sample, n, n, [&](int64_t id, bool match) {
+        bits[id >> 3] |= uint8_t(match) << (id & 0x7);
+    });
+    out.ids.clear();
+    return k;
+}
+
+}  // namespace
+
+size_t
+intersect_sorted(const BitsetView& view, const int64_t* ids, size_t n, IdSet& out) {
+    return select_sorted<true>(view, ids, n, out);
+}
+
+size_t
+difference_sorted(const BitsetView& view, const int64_t* ids, size_t n, IdSet& out) {
+    return select_sorted<false>(view, ids, n, out);
+}
+
+size_t
+union_sorted(const BitsetView& bits_view, const int64_t* ids, size_t n, IdSet& out) {
+    // the whole view is read either way, so a subview or a complemented
+    // view is lined up first
+    std::vector<uint8_t> scratch;
+    auto view = bits_view.lined_up(scratch);
+    size_t size = view.size();
+    size_t n_view = kernels::popcount(view.data(), size);
+    out.ids.clear();
+    out.bitset.reset();
+
+    if (dense_enough(n_view + n, size)) {
+        out.bitset = std::make_shared<ConcurrentBitset2>(size, view.data());
+        uint8_t* bits = out.bitset->mutable_data();
+        for (size_t i = 0; i < n; i++) {
+            bits[ids[i] >> 3] |= uint8_t(1) << (ids[i] & 0x7);
+        }
+        return out.bitset->count();
+    }
+
+    // merge the set bits of the view, in order, with the list
+    out.ids.reserve(n_view + n);
+    const uint8_t* blocks = view.data();
+    size_t n64 = size >> 6;
+    size_t i = 0;
+    auto emit = [&](int64_t id) {
+        for (; i < n && ids[i] < id; i++) {
+            out.ids.push_back(ids[i]);
+        }
+        if (i < n && ids[i] == id) {
+            i++;
+        }
+        out.ids.push_back(id);
+    };
+    for (size_t w = 0; w < n64; w++) {
+        for (uint64_t word = kernels::load_u64(blocks + w * 8); word; word &= word - 1) {
+            emit(int64_t((w << 6) | __builtin_ctzll(word)));
+        }
+    }
+    for (size_t id = n64 << 6; id < size; id++) {
+        if (view.test(id)) {
+            emit(int64_t(id));
+        }
+    }
+    out.ids.insert(out.ids.end(), ids + i, ids + n);
+    return out.ids.size();
+}
+
+}  // namespace faiss
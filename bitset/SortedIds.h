@@ -0,0 +1,59 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Bitset2.h"
+#include "BitsetView.h"
+
+namespace faiss {
+
+// Result of combining a bitset with a sorted id list: either the sorted
+// ids, or a bitset of the view's size when the result is dense enough that
+// the bitset is smaller (more than one id per 64 bits).
+struct IdSet {
+    std::vector<int64_t> ids;
+    ConcurrentBitset2Ptr bitset;  // set when the result is a bitset
+
+    inline bool
+    dense() const {
+        return bitset != nullptr;
+    }
+
+    inline size_t
+    count() const {
+        return bitset ? bitset->count() : ids.size();
+    }
+};
+
+// Set operations between a bitset and a sorted, duplicate-free list of
+// ids in [0, view.size()), without expanding the list into a bitset. The
+// list is probed a byte of the bitset per id, prefetched a few ids ahead;
+// the output form is picked from the hit rate of the first ids. Each
+// returns the number of ids in out.
+
+// ids whose bit is set in view
+size_t
+intersect_sorted(const BitsetView& view, const int64_t* ids, size_t n, IdSet& out);
+
+// ids whose bit is not set in view
+size_t
+difference_sorted(const BitsetView& view, const int64_t* ids, size_t n, IdSet& out);
+
+// ids plus every bit set in view
+size_t
+union_sorted(const BitsetView& view, const int64_t* ids, size_t n, IdSet& out);
+
+}  // namespace faiss
@@ -0,0 +1,199 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include <unistd.h>
+
+#include <atomic>
+#include <type_traits>
+
+#include "StreamKernels.h"
+
+namespace faiss {
+namespace kernels {
+
+namespace {
+
+// how far ahead of the loads lhs and rhs are prefetched
+constexpr size_t PREFETCH_BYTES = 1024;
+
+size_t
+default_stream_threshold() {
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (llc > 0) {
+        return size_t(llc);
+    }
+#endif
+    return size_t(32) << 20;
+}
+
+std::atomic<size_t>&
+threshold() {
+    static std::atomic<size_t> value{default_stream_threshold()};
+    return value;
+}
+
+// Vector bodies over [begin, end), with dst + begin on a 64-byte boundary.
+// Return where the scalar loop has to pick up.
+
+#if defined(__x86_64__)
+
+template <typename Op>
+BITSET_TARGET_AVX512 inline __m512i
+apply_avx512(__m512i lhs, __m512i rhs) {
+    if constexpr (std::is_same<Op, AndOp>::value) {
+        return _mm512_and_si512(lhs, rhs);
+    } else if constexpr (std::is_same<Op, OrOp>::value) {
+        return _mm512_or_si512(lhs, rhs);
+    } else if constexpr (std::is_same<Op, XorOp>::value) {
+        return _mm512_xor_si512(lhs, rhs);
+    } else {
+        return _mm512_andnot_si512(rhs, lhs);
+    }
+}
+
+template <typename Op>
+BITSET_TARGET_AVX2 inline __m256i
+apply_avx2(__m256i lhs, __m256i rhs) {
+    if constexpr (std::is_same<Op, AndOp>::value) {
+        return _mm256_and_si256(lhs, rhs);
+    } else if constexpr (std::is_same<Op, OrOp>::value) {
+        return _mm256_or_si256(lhs, rhs);
+    } else if constexpr (std::is_same<Op, XorOp>::value) {
+        return _mm256_xor_si256(lhs, rhs);
+    } else {
+        return _mm256_andnot_si256(rhs, lhs);
+    }
+}
+
+template <typename Op, bool Count>
+BITSET_TARGET_AVX512 size_t
+stream_avx512(uint8_t* dst, const uint8_t* lhs, const uint8_t* rhs, size_t begin, size_t end, size_t& count) {
+    size_t i = begin;
+    for (; i + 64 <= end; i += 64) {
+        _mm_prefetch(reinterpret_cast<const char*>(lhs + i + PREFETCH_BYTES), _MM_HINT_T0);
+        _mm_prefetch(reinterpret_cast<const char*>(rhs + i + PREFETCH_BYTES), _MM_HINT_T0);
+        __m512i word = apply_avx512<Op>(_mm512_loadu_si512(lhs + i), _mm512_loadu_si512(rhs + i));
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + i), word);
+        if constexpr (Count) {
+            alignas(64) uint64_t lanes[8];
+            _mm512_store_si512(lanes, word);
+            for (auto lane : lanes) {
+                count += __builtin_popcountll(lane);
+            }
+        }
+    }
+    return i;
+}
+
+template <typename Op, bool Count>
+BITSET_TARGET_AVX2 size_t
+stream_avx2(uint8_t* dst, const uint8_t* lhs, const uint8_t* rhs, size_t begin, size_t end, size_t& count) {
+    size_t i = begin;
+    for (; i + 32 <= end; i += 32) {
+        if ((i & 63) == 0) {
+            _mm_prefetch(reinterpret_cast<const char*>(lhs + i + PREFETCH_BYTES), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(rhs + i + PREFETCH_BYTES), _MM_HINT_T0);
+        }
+        __m256i word = apply_avx2<Op>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i)),
+                                      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + i)));
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i), word);
+        if constexpr (Count) {
+            alignas(32) uint64_t lanes[4];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), word);
+            for (auto lane : lanes) {
+                count += __builtin_popcountll(lane);
+            }
+        }
+    }
+    return i;
+}
+
+template <typename Op, bool Count>
+size_t
+stream_sse2(uint8_t* dst, const uint8_t* lhs, const uint8_t* rhs, size_t begin, size_t end, size_t& count) {
+    Op op;
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        if ((i & 63) == 0) {
+            _mm_prefetch(reinterpret_cast<const char*>(lhs + i + PREFETCH_BYTES), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(rhs + i + PREFETCH_BYTES), _MM_HINT_T0);
+        }
+        uint64_t word = op(load_u64(lhs + i), load_u64(rhs + i));
+        _mm_stream_si64(reinterpret_cast<long long*>(dst + i), static_cast<long long>(word));
+        if constexpr (Count) {
+            count += __builtin_popcountll(word);
+        }
+    }
+    return i;
+}
+
+#endif
+
+}  // namespace
+
+size_t
+stream_threshold() {
+    return threshold().load(std::memory_order_relaxed);
+}
+
+void
+set_stream_threshold(size_t bytes) {
+    threshold().store(bytes, std::memory_order_relaxed);
+}
+
+template <typename Op, bool Count>
+size_t
+binary_op_stream(uint8_t* dst, const uint8_t* lhs, const uint8_t* rhs, size_t n8, SimdLevel level) {
+#if defined(__x86_64__)
+    // regular stores up to the first cache line of dst, then whole lines
+    // streamed, then the rest regular again
+    size_t head = std::min(n8, size_t(-reinterpret_cast<uintptr_t>(dst) & 63));
+    size_t ret = binary_op<Op, Count>(dst, lhs, rhs, head);
+    size_t i = head;
+    if (level == SimdLevel::AVX512) {
+        i = stream_avx512<Op, Count>(dst, lhs, rhs, i, n8, ret);
+    } else if (level == SimdLevel::AVX2) {
+        i = stream_avx2<Op, Count>(dst, lhs, rhs, i, n8, ret);
+    } else {
+        i = stream_sse2<Op, Count>(dst, lhs, rhs, i, n8, ret);
+    }
+    // streaming stores are weakly ordered; publish them before returning
+    _mm_sfence();
+    return ret + binary_op<Op, Count>(dst + i, lhs + i, rhs + i, n8 - i);
+#else
+    (void)level;
+    return binary_op<Op, Count>(dst, lhs, rhs, n8);
+#endif
+}
+
+template size_t
+binary_op_stream<AndOp, false>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+template size_t
+binary_op_stream<AndOp, true>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+template size_t
+binary_op_stream<OrOp, false>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+template size_t
+binary_op_stream<OrOp, true>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+template size_t
+binary_op_stream<XorOp, false>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+template size_t
+binary_op_stream<XorOp, true>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+template size_t
+binary_op_stream<AndNotOp, false>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+template size_t
+binary_op_stream<AndNotOp, true>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+
+}  // namespace kernels
+}  // namespace faiss
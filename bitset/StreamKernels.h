@@ -0,0 +1,85 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "BitsetKernels.h"
+#include "Simd.h"
+
+namespace faiss {
+namespace kernels {
+
+// Results of at least this many bytes are written with non-temporal
+// stores, which go around the cache instead of evicting the operands a
+// following stage is about to read. Defaults to the size of the last-level
+// cache (32 MB if it cannot be told); 0 streams every result, SIZE_MAX none.
+size_t
+stream_threshold();
+
+void
+set_stream_threshold(size_t bytes);
+
+// binary_op with non-temporal stores, prefetching lhs and rhs ahead of the
+// loads; dst must not overlap lhs or rhs. Without AVX2, 64-bit streaming
+// stores are used.
+template <typename Op, bool Count = false>
+size_t
+binary_op_stream(uint8_t* dst, const uint8_t* lhs, const uint8_t* rhs, size_t n8, SimdLevel level = simd_level());
+
+extern template size_t
+binary_op_stream<AndOp, false>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+extern template size_t
+binary_op_stream<AndOp, true>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+extern template size_t
+binary_op_stream<OrOp, false>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+extern template size_t
+binary_op_stream<OrOp, true>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+extern template size_t
+binary_op_stream<XorOp, false>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+extern template size_t
+binary_op_stream<XorOp, true>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+extern template size_t
+binary_op_stream<AndNotOp, false>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+extern template size_t
+binary_op_stream<AndNotOp, true>(uint8_t*, const uint8_t*, const uint8_t*, size_t, SimdLevel);
+
+// the operators binary_op_stream is built for
+template <typename Op>
+struct streamable : std::false_type {};
+template <>
+struct streamable<AndOp> : std::true_type {};
+template <>
+struct streamable<OrOp> : std::true_type {};
+template <>
+struct streamable<XorOp> : std::true_type {};
+template <>
+struct streamable<AndNotOp> : std::true_type {};
+
+// binary_op for a separate destination: streamed from stream_threshold()
+// on, regular stores below it, when dst is lhs or rhs, or for an operator
+// binary_op_stream is not built for
+template <typename Op, bool Count = false>
+inline size_t
+binary_op_into(uint8_t* dst, const uint8_t* lhs, const uint8_t* rhs, size_t n8) {
+    if constexpr (streamable<Op>::value) {
+        if (n8 >= stream_threshold() && dst != lhs && dst != rhs) {
+            return binary_op_stream<Op, Count>(dst, lhs, rhs, n8);
+        }
+    }
+    return binary_op<Op, Count>(dst, lhs, rhs, n8);
+}
+
+}  // namespace kernels
+}  // namespace faiss
@@ -25,16 +25,46 @@
 #include <boost/dynamic_bitset.hpp>
 
 #include "BitsetView.h"
+#include "CompositeBitsetView.h"
+#include "BasicBitset.h"
+#include "FixedBitset.h"
+#include "RoaringBitset.h"
+#include "CandidateFilter.h"
+#include "ScanKernels.h"
+#include "BitSlicedIndex.h"
+#include "BitmapIndex.h"
+#include "BitsetReduce.h"
+#include "SortedIds.h"
+#include "Compaction.h"
+#include "Numa.h"
+#include "AlignedAllocator.h"
+#include "RelationKernels.h"
+#include "BitsetDelta.h"
+#include "WriteCombiner.h"
 #include "Bitset2.h"
 #include "Bitset.h"
 
 namespace bitsets {
 
+template <typename WordT, typename ConcurrencyPolicy, typename Allocator = faiss::AlignedAllocator<WordT>>
+using BasicBitset = faiss::BasicBitset<WordT, ConcurrencyPolicy, Allocator>;
+template <size_t N>
+using FixedBitset = faiss::FixedBitset<N>;
+using AtomicPolicy = faiss::AtomicPolicy;
+using NonAtomicPolicy = faiss::NonAtomicPolicy;
+
 using ConcurrentBitset = faiss::ConcurrentBitset;
 using ConcurrentBitset2 = faiss::ConcurrentBitset2;
 using ConcurrentBitsetPtr = faiss::ConcurrentBitsetPtr;
 using ConcurrentBitset2Ptr = faiss::ConcurrentBitset2Ptr;
 
+// shared bitset with 64-bit atomic words, for a WriteCombiner to flush into
+using ConcurrentBitset64 = BasicBitset<uint64_t, AtomicPolicy>;
+using ConcurrentBitset64Ptr = std::shared_ptr<ConcurrentBitset64>;
+
+template <typename Bitset>
+using WriteCombiner = faiss::WriteCombiner<Bitset>;
+
 // NOTE: dependent type
 // used at meta-template programming
 template <class...>
@@ -46,7 +76,63 @@ constexpr std::false_type always_false{};
 template <typename T>
 using aligned_vector = std::vector<T, boost::alignment::aligned_allocator<T, 64>>;
 
+// non-atomic 64-bit words on 64-byte aligned storage, for query-time scratch
+using ScratchBitset = BasicBitset<uint64_t, NonAtomicPolicy, boost::alignment::aligned_allocator<uint64_t, 64>>;
+using ScratchBitsetPtr = std::shared_ptr<ScratchBitset>;
+
+using HugePages = faiss::HugePages;
+template <typename T>
+using AlignedAllocator = faiss::AlignedAllocator<T>;
+
+using NumaPlacement = faiss::NumaPlacement;
+using faiss::numa_node_count;
+template <typename T>
+using NumaAllocator = faiss::NumaAllocator<T>;
+
+// shared bitset on pages placed by a NumaAllocator; construct with
+// NumaConcurrentBitset(size, NumaAllocator<uint8_t>(placement))
+using NumaConcurrentBitset = BasicBitset<uint8_t, AtomicPolicy, NumaAllocator<uint8_t>>;
+using NumaConcurrentBitsetPtr = std::shared_ptr<NumaConcurrentBitset>;
+
 using BitsetView = faiss::BitsetView;
+using BitsetRelation = faiss::BitsetRelation;
+using CountEstimate = faiss::CountEstimate;
+using faiss::estimate_count_and;
+using CompositeBitsetView = faiss::CompositeBitsetView;
+
+using RoaringBitset = faiss::RoaringBitset;
+using RoaringBitsetPtr = faiss::RoaringBitsetPtr;
+
+using SimdLevel = faiss::SimdLevel;
+using faiss::simd_level;
+using faiss::filter_candidates;
+
+using CompareOp = faiss::CompareOp;
+using ScanMerge = faiss::ScanMerge;
+using faiss::scan_compare;
+using faiss::scan_between;
+using faiss::scan_in;
+
+using BitSlicedIndex = faiss::BitSlicedIndex;
+using BitmapIndex = faiss::BitmapIndex;
+
+using faiss::union_many;
+using faiss::intersect_many;
+using faiss::threshold;
+
+using IdSet = faiss::IdSet;
+using faiss::intersect_sorted;
+using faiss::difference_sorted;
+using faiss::union_sorted;
+
+using CompactionRemap = faiss::CompactionRemap;
+using faiss::compaction_remap;
+
+using BitsetDelta = faiss::BitsetDelta;
+using faiss::diff;
+using faiss::apply_delta;
+
+using Hash128 = faiss::Hash128;
 
 using BitsetType = boost::dynamic_bitset<>;
 using BitsetTypeOpt = std::optional<BitsetType>;
@@ -0,0 +1,196 @@
+// Copyright (C) 2019-2020 Zilliz. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+// with the License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software distributed under the License
+// is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
+// or implied. See the License for the specific language governing permissions and limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace faiss {
+
+// Write-combining front end for many threads setting bits of one shared
+// bitset. set() only records (word, mask) in a buffer of the calling
+// thread, ORing into the entry of the same word if it is pending, so a
+// burst of sets into a hot region costs no shared cache-line traffic. A
+// buffer goes to the bitset with one set_mask() (one fetch_or) per word
+// when it fills up, on flush() from its thread, or on sync() from any
+// thread.
+//
+// Until then the sets are not visible in the bitset: a reader that must see
+// every set() made so far calls sync() first (the flush-on-read barrier).
+// sync() and the destructor flush the buffers of all threads. A buffer is
+// only locked by its own thread, except during sync(), so the lock stays
+// in that thread's cache.
+//
+// No set() or flush() may run on a combiner once it is being destroyed.
+// Its buffers are freed with it, and each thread's entry for it is erased
+// then too, so threads that go through many short-lived combiners do not
+// accumulate entries.
+//
+// Use a bitset with 64-bit atomic words (ConcurrentBitset64) so that one
+// flushed entry covers 64 rows; with ConcurrentBitset it covers 8.
+template <typename Bitset>
+class WriteCombiner {
+ public:
+    using id_type_t = typename Bitset::id_type_t;
+    using word_type = typename Bitset::word_type;
+
+    // capacity: pending words per thread before it flushes
+    explicit WriteCombiner(Bitset& bitset, size_t capacity = 64)
+    : bitset_(bitset), capacity_(capacity), id_(next_id().fetch_add(1)) {
+    }
+
+    WriteCombiner(const WriteCombiner&) = delete;
+
+    WriteCombiner&
+    operator=(const WriteCombiner&) = delete;
+
+    ~WriteCombiner() {
+        sync();
+        for (auto& buffer : buffers_) {
+            std::lock_guard<std::mutex> lock(buffer->owner->mutex);
+            buffer->owner->buffers.erase(id_);
+        }
+    }
+
+    void
+    set(id_type_t id) {
+        size_t index = size_t(id) / Bitset::word_bits;
+        auto mask = word_type(word_type(1) << (size_t(id) % Bitset::word_bits));
+        auto& buffer = local_buffer();
+        std::lock_guard<Buffer> lock(buffer);
+        // recent rows come last; look for their word from the back
+        for (size_t i = buffer.pending.size(); i-- > 0;) {
+            if (buffer.pending[i].first == index) {
+                buffer.pending[i].second |= mask;
+                return;
+            }
+        }
+        if (buffer.pending.size() == capacity_) {
+            flush(buffer);
+        }
+        buffer.pending.emplace_back(index, mask);
+    }
+
+    // publish the calling thread's pending sets
+    void
+    flush() {
+        auto& buffer = local_buffer();
+        std::lock_guard<Buffer> lock(buffer);
+        flush(buffer);
+    }
+
+    // publish the pending sets of every thread; afterwards the bitset holds
+    // every set() that returned before sync() was called
+    void
+    sync() {
+        std::lock_guard<std::mutex> registry_lock(registry_mutex_);
+        for (auto& buffer : buffers_) {
+            std::lock_guard<Buffer> lock(*buffer);
+            flush(*buffer);
+        }
+    }
+
+    inline Bitset&
+    bitset() {
+        return bitset_;
+    }
+
+ private:
+    // The lock is a flag: taken by its own thread on every set() and
+    // almost never contended, so it costs one exchange on a line that
+    // thread owns. Buffers are line aligned so two threads' never share.
+    struct LocalBuffers;
+
+    struct alignas(64) Buffer {
+        std::atomic_flag busy = ATOMIC_FLAG_INIT;
+        std::vector<std::pair<size_t, word_type>> pending;
+        // the map of the thread that registered this buffer
+        std::shared_ptr<LocalBuffers> owner;
+
+        inline void
+        lock() {
+            while (busy.test_and_set(std::memory_order_acquire)) {
+            }
+        }
+
+        inline void
+        unlock() {
+            busy.clear(std::memory_order_release);
+        }
+    };
+
+    static std::atomic<uint64_t>&
+    next_id() {
+        static std::atomic<uint64_t> id{0};
+        return id;
+    }
+
+    // A thread's buffers by combiner id. Each buffer the thread registers
+    // shares ownership of the map, so the combiner's destructor can erase
+    // its entry whether or not the thread is still running; the map itself
+    // goes with the thread or with the last such buffer.
+    struct LocalBuffers {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Buffer*> buffers;
+    };
+
+    // The calling thread's buffer, registered on first use. Threads find
+    // it by combiner id rather than address, so that a combiner created
+    // where a destroyed one lived does not pick up its stale entries; ids
+    // are never reused, so the one-entry cache in last cannot match a
+    // destroyed combiner either. The buffer is owned by buffers_ and lives
+    // as long as the combiner.
+    Buffer&
+    local_buffer() {
+        thread_local auto local = std::make_shared<LocalBuffers>();
+        thread_local std::pair<uint64_t, Buffer*> last{UINT64_MAX, nullptr};
+        if (last.first == id_) {
+            return *last.second;
+        }
+        std::lock_guard<std::mutex> local_lock(local->mutex);
+        auto& slot = local->buffers[id_];
+        if (!slot) {
+            auto buffer = std::make_unique<Buffer>();
+            buffer->pending.reserve(capacity_);
+            buffer->owner = local;
+            slot = buffer.get();
+            std::lock_guard<std::mutex> lock(registry_mutex_);
+            buffers_.push_back(std::move(buffer));
+        }
+        last = {id_, slot};
+        return *slot;
+    }
+
+    // buffer is locked
+    void
+    flush(Buffer& buffer) {
+        for (auto& update : buffer.pending) {
+            bitset_.set_mask(update.first, update.second);
+        }
+        buffer.pending.clear();
+    }
+
+ private:
+    Bitset& bitset_;
+    size_t capacity_;
+    uint64_t id_;
+    std::mutex registry_mutex_;
+    std::vector<std::unique_ptr<Buffer>> buffers_;
+};
+
+}  // namespace faiss
@@ -9,6 +9,7 @@
 // is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express
 // or implied. See the License for the specific language governing permissions and limitations under the License
 
+#include <algorithm>
 #include <cstdint>
 #include <string>
 #include <iostream>
@@ -18,6 +19,8 @@
 #include <iomanip>
 #include <random>
 #include <cmath>
+#include <thread>
+#include <numeric>
 #include "boost_ext/dynamic_bitset_ext.hpp"
 #include "bitset/Types.h"
 #include "Timer.h"
@@ -26,6 +29,8 @@ using MapType = std::map<std::string, std::function<bool()>>;
 
 using ConcurrentBitset2 = bitsets::ConcurrentBitset2;
 using ConcurrentBitset = bitsets::ConcurrentBitset;
+using ScratchBitset = bitsets::ScratchBitset;
+using RoaringBitset = bitsets::RoaringBitset;
 using BitsetType = bitsets::BitsetType;
 using BitsetView = bitsets::BitsetView;
 
@@ -36,6 +41,8 @@ constexpr int MODE_BOOST_BITSET = 2;
 constexpr int N_BITS = 16;
 constexpr int N = N_BITS / 8;
 
+using FixedBitset = bitsets::FixedBitset<N_BITS>;
+
 const uint8_t BITS_SRC[8] = {
 	0b11011001, 
 	0b10010001, 
@@ -63,6 +70,33 @@ bool check_bitset_or_assign();
 bool check_bitset_and();
 bool check_bitset_and_assign();
 bool check_bitset_flip();
+bool check_bitset_scratch();
+bool check_bitset_fixed();
+bool check_bitset_count();
+bool check_bitset_roaring();
+bool check_bitset_roaring_chunks();
+bool check_bitset_xor();
+bool check_bitset_andnot();
+bool check_bitset_filter();
+bool check_bitset_scan();
+bool check_bitset_bsi();
+bool check_bitset_bitmap_index();
+bool check_bitset_reduce();
+bool check_bitset_threshold();
+bool check_bitset_sorted_ids();
+bool check_bitset_compaction();
+bool check_bitset_shift();
+bool check_bitset_subview();
+bool check_bitset_composite();
+bool check_bitset_numa();
+bool check_bitset_aligned();
+bool check_bitset_stream();
+bool check_bitset_write_combiner();
+bool check_bitset_complement();
+bool check_bitset_relations();
+bool check_bitset_estimate();
+bool check_bitset_delta();
+bool check_bitset_hash();
 
 void prepare_dataset(){
 	DatasetL.resize(N);
@@ -226,6 +260,1700 @@ bool check_bitset_flip(){
 	return flag1 && flag2;
 }
 
+bool check_bitset_scratch(){
+	auto cl = ScratchBitset(N_BITS, DatasetL.data());
+	auto cr = ScratchBitset(N_BITS, DatasetR.data());
+	cl.set(0);
+	cl.clear(N_BITS - 1);
+	auto c_and = cl&cr;
+	cl |= cr;
+
+	auto viewL = BitsetView(DatasetL.data(), N_BITS);
+ 	auto x = view_to_string(viewL);
+  	auto bl = BitsetType(x);
+
+	auto viewR = BitsetView(DatasetR.data(), N_BITS);
+ 	auto y = view_to_string(viewR);
+  	auto br = BitsetType(y);
+
+	bl.set(0);
+	bl.reset(N_BITS - 1);
+	auto b_and = bl&br;
+	bl |= br;
+
+	auto flag1 = BitsetView((uint8_t*)boost_ext::get_data(b_and), N_BITS) == BitsetView(c_and);
+	auto flag2 = BitsetView((uint8_t*)boost_ext::get_data(bl), N_BITS) == BitsetView(cl);
+	return flag1 && flag2 && cl.count() == bl.count();
+}
+
+bool check_bitset_fixed(){
+	constexpr auto fixed = [] {
+		FixedBitset l, r;
+		l.set(1);
+		l.set(3);
+		r.set(3);
+		r.negate();
+		return l & r;
+	}();
+	static_assert(fixed.count() == 1 && fixed.test(1), "FixedBitset must be usable in constant expressions");
+	constexpr auto fixed_xor = [] {
+		FixedBitset l, r, d;
+		l.set(1);
+		l.set(3);
+		r.set(3);
+		r.set(5);
+		l.andnot_into(r, d);
+		d ^= l ^ r;
+		return d - r;
+	}();
+	static_assert(fixed_xor.count() == 0, "xor and andnot must be usable in constant expressions");
+
+	auto cl = FixedBitset(DatasetL.data());
+	auto viewR = BitsetView(DatasetR.data(), N_BITS);
+	auto c_and = cl & viewR;
+	cl |= FixedBitset(viewR);
+	cl.negate();
+
+	auto viewL = BitsetView(DatasetL.data(), N_BITS);
+ 	auto x = view_to_string(viewL);
+  	auto bl = BitsetType(x);
+ 	auto y = view_to_string(viewR);
+  	auto br = BitsetType(y);
+
+	auto b_and = bl&br;
+	bl |= br;
+	bl.flip();
+
+	auto flag1 = BitsetView((uint8_t*)boost_ext::get_data(b_and), N_BITS) == BitsetView(c_and);
+	auto flag2 = BitsetView((uint8_t*)boost_ext::get_data(bl), N_BITS) == BitsetView(cl);
+
+	// xor and andnot, against another FixedBitset and a view
+	auto fl = FixedBitset(DatasetL.data());
+	auto fr = FixedBitset(viewR);
+	auto b_xor = BitsetType(x) ^ br;
+	auto b_andnot = BitsetType(x) - br;
+	auto same = [](const BitsetType& b, const FixedBitset& f) {
+		return BitsetView((uint8_t*)boost_ext::get_data(b), N_BITS) == BitsetView(f);
+	};
+	auto f_assign = fl;
+	f_assign ^= viewR;
+	auto f_andnot = fl;
+	f_andnot.andnot(fr);
+	auto f_into = FixedBitset();
+	fl.andnot_into(viewR, f_into);
+	auto f_self = fl;
+	f_self.andnot_into(fr, f_self);
+	auto flag_ops = same(b_xor, fl ^ fr) && same(b_xor, fl ^ viewR) && same(b_xor, f_assign) &&
+					same(b_andnot, fl - fr) && same(b_andnot, fl - viewR) && same(b_andnot, f_andnot) &&
+					same(b_andnot, f_into) && same(b_andnot, f_self);
+
+	// N % 8 != 0: the bits of the last byte past N are not taken
+	const uint8_t ones[] = {0xff, 0xff};
+	auto partial = bitsets::FixedBitset<10>(ones);
+	auto full = bitsets::FixedBitset<10>();
+	full.negate();
+	auto flag3 = partial.count() == 10 && partial == full && (partial ^ full).count() == 0 &&
+				 (full - bitsets::FixedBitset<10>()).count() == 10;
+	return flag1 && flag2 && flag_ops && flag3 && cl.count() == bl.count();
+}
+
+bool check_bitset_count(){
+	auto cl1 = ConcurrentBitset(N_BITS, DatasetL.data());
+	auto cr1 = ConcurrentBitset(N_BITS, DatasetR.data());
+	cl1.enable_count_tracking();
+	cl1.set(0);
+	cl1.set(0);
+	cl1.clear(1);
+	cl1 |= cr1;
+	cl1.negate();
+	auto c_1 = cl1&cr1;
+
+	auto cl2 = ConcurrentBitset2(N_BITS, DatasetL.data());
+	auto cr2 = ConcurrentBitset2(N_BITS, DatasetR.data());
+	cl2.enable_count_tracking();
+	cl2.set(0);
+	cl2.clear(1);
+	cl2.clear(1);
+	cl2 |= cr2;
+	cl2.negate();
+	auto c_2 = cl2&cr2;
+
+	auto viewL = BitsetView(DatasetL.data(), N_BITS);
+ 	auto x = view_to_string(viewL);
+  	auto bl = BitsetType(x);
+
+	auto viewR = BitsetView(DatasetR.data(), N_BITS);
+ 	auto y = view_to_string(viewR);
+  	auto br = BitsetType(y);
+
+	bl.set(0);
+	bl.reset(1);
+	bl |= br;
+	bl.flip();
+	auto b_1 = bl&br;
+
+	auto flag1 = cl1.tracks_count() && cl1.count() == bl.count() && c_1->count() == b_1.count();
+	auto flag2 = cl2.tracks_count() && cl2.count() == bl.count() && c_2->count() == b_1.count();
+	return flag1 && flag2;
+}
+
+bool check_bitset_roaring(){
+	auto viewL = BitsetView(DatasetL.data(), N_BITS);
+	auto viewR = BitsetView(DatasetR.data(), N_BITS);
+	auto rl = RoaringBitset(viewL);
+	auto rr = RoaringBitset(viewR);
+	auto r_and = rl & rr;
+	auto r_or = rl | viewR;
+	rl ^= rr;
+
+	auto buf = rl.serialize();
+	auto loaded = RoaringBitset();
+	auto flag0 = loaded.deserialize(buf.data(), buf.size()) && loaded == rl;
+
+ 	auto x = view_to_string(viewL);
+  	auto bl = BitsetType(x);
+ 	auto y = view_to_string(viewR);
+  	auto br = BitsetType(y);
+
+	auto check = [](const BitsetType& b, const RoaringBitset& r) {
+		std::vector<uint8_t> blocks(N);
+		r.materialize(blocks.data(), N_BITS);
+		return BitsetView((uint8_t*)boost_ext::get_data(b), N_BITS) == BitsetView(blocks.data(), N_BITS);
+	};
+	// from a complemented view, and one starting inside a byte
+	auto r_not = RoaringBitset(~viewL);
+	auto r_sub = RoaringBitset(viewL.subview(3, N_BITS - 3));
+	std::vector<uint8_t> blocks(N);
+	r_not.materialize(blocks.data(), N_BITS);
+	bool flag1 = BitsetView(blocks.data(), N_BITS) == ~viewL;
+	std::fill(blocks.begin(), blocks.end(), 0);
+	r_sub.materialize(blocks.data(), N_BITS - 3);
+	flag1 = flag1 && BitsetView(blocks.data(), N_BITS - 3) == viewL.subview(3, N_BITS - 3);
+	return flag0 && flag1 && check(bl & br, *r_and) && check(bl | br, *r_or) && check(bl ^ br, loaded);
+}
+
+// Every container kind over several 64K chunks, against a boost reference:
+// chunk 0 dense (bitmap), 1 a long run, 2 sparse (array), 3 empty and 4 a
+// partial last chunk.
+bool check_bitset_roaring_chunks() {
+	constexpr size_t chunk = 65536;
+	constexpr size_t size = 4 * chunk + 123;
+	std::mt19937 gen(53);
+	auto fill = [&](BitsetType& b, size_t begin, size_t end, size_t mode) {
+		for (size_t i = begin; i < std::min(end, size); i++) {
+			bool bit = mode == 0 ? gen() % 2 == 0
+					 : mode == 1 ? (i - begin >= 100 && i - begin < 60000)
+					 : mode == 2 ? gen() % 97 == 0 : false;
+			b[i] = bit;
+		}
+	};
+	auto bl = BitsetType(size);
+	auto br = BitsetType(size);
+	const size_t modes_l[] = {0, 1, 2, 3, 0};
+	const size_t modes_r[] = {2, 0, 1, 3, 2};
+	for (size_t k = 0; k < 5; k++) {
+		fill(bl, k * chunk, (k + 1) * chunk, modes_l[k]);
+		fill(br, k * chunk, (k + 1) * chunk, modes_r[k]);
+	}
+	bl.set(size - 1);
+
+	auto view_of = [](const BitsetType& b) {
+		return BitsetView((const uint8_t*)boost_ext::get_data(b), b.size());
+	};
+	std::vector<uint8_t> blocks((size + 7) / 8);
+	auto same = [&](const RoaringBitset& r, const BitsetType& b) {
+		std::fill(blocks.begin(), blocks.end(), 0xff);
+		r.materialize(blocks.data(), size);
+		return BitsetView(blocks.data(), size) == view_of(b) && r.count() == b.count();
+	};
+
+	auto rl = RoaringBitset(view_of(bl));
+	auto rr = RoaringBitset(view_of(br));
+	// one bitmap of 8KB; the run and the arrays take far less
+	bool ret = same(rl, bl) && same(rr, br) && rl.memory_size() >= 8192 && rl.memory_size() < 2 * 8192;
+	std::vector<int64_t> ids, expect;
+	rl.for_each([&](int64_t id) { ids.push_back(id); });
+	for (auto i = bl.find_first(); i != BitsetType::npos; i = bl.find_next(i)) {
+		expect.push_back(int64_t(i));
+	}
+	ret = ret && ids == expect;
+
+	// against another RoaringBitset and against a flat ConcurrentBitset2
+	auto cr = ConcurrentBitset2(size, (const uint8_t*)boost_ext::get_data(br));
+	ret = ret && same(*(rl & rr), bl & br) && same(*(rl | rr), bl | br) && same(*(rl ^ rr), bl ^ br) &&
+		  same(*(rl - rr), bl - br);
+	ret = ret && same(*(rl & BitsetView(cr)), bl & br) && same(*(rl | BitsetView(cr)), bl | br) &&
+		  same(*(rl ^ BitsetView(cr)), bl ^ br) && same(*(rl - BitsetView(cr)), bl - br);
+	auto r_assign = rl;
+	r_assign &= rr;
+	r_assign |= BitsetView(cr);
+	r_assign ^= rl;
+	r_assign -= rr;
+	ret = ret && same(r_assign, (((bl & br) | br) ^ bl) - br);
+
+	// applied in place to a flat bitset
+	auto check_into = [&](auto apply, const BitsetType& expected) {
+		auto flat = ConcurrentBitset2(size, (const uint8_t*)boost_ext::get_data(br));
+		apply(flat.mutable_data());
+		return BitsetView(flat) == view_of(expected);
+	};
+	ret = ret && check_into([&](uint8_t* b) { rl.and_into(b, size); }, br & bl);
+	ret = ret && check_into([&](uint8_t* b) { rl.or_into(b, size); }, br | bl);
+	ret = ret && check_into([&](uint8_t* b) { rl.andnot_into(b, size); }, br - bl);
+	ret = ret && check_into([&](uint8_t* b) { rl.xor_into(b, size); }, br ^ bl);
+
+	// set past ARRAY_MAX in the sparse chunk turns it into a bitmap, and
+	// clearing those bits again back into an array; then a hole in the run
+	// and a bit just past its end
+	auto grown = rl;
+	auto b_grown = bl;
+	size_t before = grown.memory_size();
+	for (size_t i = 2 * chunk; i < 2 * chunk + 6000; i++) {
+		grown.set(i);
+		b_grown.set(i);
+	}
+	ret = ret && same(grown, b_grown) && grown.memory_size() > before + 4096;
+	for (size_t i = 2 * chunk; i < 2 * chunk + 6000; i++) {
+		grown.clear(i);
+		b_grown.reset(i);
+	}
+	grown.clear(chunk + 1000);
+	b_grown.reset(chunk + 1000);
+	grown.set(chunk + 60000);
+	b_grown.set(chunk + 60000);
+	ret = ret && same(grown, b_grown) && grown.memory_size() < before + 8192;
+	grown.optimize();
+	ret = ret && same(grown, b_grown);
+
+	// round trip, then truncated and inconsistent buffers
+	auto buf = rl.serialize();
+	auto loaded = RoaringBitset();
+	ret = ret && loaded.deserialize(buf.data(), buf.size()) && loaded == rl && same(loaded, bl);
+	for (size_t len = 0; len < buf.size(); len++) {
+		auto cut = std::vector<uint8_t>(buf.begin(), buf.begin() + len);
+		ret = ret && !loaded.deserialize(cut.data(), cut.size()) && loaded.empty();
+	}
+	// with run containers: cookie, one byte of run flags, then (key,
+	// cardinality - 1) per container
+	auto corrupt = [&](size_t at, uint8_t value) {
+		auto bad = buf;
+		bad[at] = value;
+		return !loaded.deserialize(bad.data(), bad.size()) && loaded.empty();
+	};
+	ret = ret && corrupt(0, buf[0] ^ 0x01);          // cookie
+	ret = ret && corrupt(9, buf[5]);                 // second key equal to the first
+	ret = ret && corrupt(7, uint8_t(buf[7] + 1));    // bitmap cardinality off by one
+	return ret;
+}
+
+bool check_bitset_xor(){
+	auto cl1 = ConcurrentBitset(N_BITS, DatasetL.data());
+	auto cr1 = ConcurrentBitset(N_BITS, DatasetR.data());
+	auto c_1 = cl1^cr1;
+	auto cl2 = ConcurrentBitset2(N_BITS, DatasetL.data());
+	auto cr2 = ConcurrentBitset2(N_BITS, DatasetR.data());
+	cl2 ^= BitsetView(cr2);
+
+	auto viewL = BitsetView(DatasetL.data(), N_BITS);
+  	auto x = view_to_string(viewL);
+  	auto bl = BitsetType(x);
+
+	auto viewR = BitsetView(DatasetR.data(), N_BITS);
+ 	auto y = view_to_string(viewR);
+  	auto br = BitsetType(y);
+
+	std::vector<uint8_t> dst(N);
+	viewL.xor_into(viewR, dst.data());
+
+	auto b_1 = bl^br;
+	auto flag1 = check_boost_concurrent(b_1, *c_1);
+	auto flag2 = check_boost_concurrent2(b_1, cl2);
+	auto flag3 = BitsetView((uint8_t*)boost_ext::get_data(b_1), N_BITS) == BitsetView(dst.data(), N_BITS);
+	return flag1 && flag2 && flag3;
+}
+
+bool check_bitset_andnot(){
+	auto cl1 = ConcurrentBitset(N_BITS, DatasetL.data());
+	auto cr1 = ConcurrentBitset(N_BITS, DatasetR.data());
+	auto c_1 = ConcurrentBitset(N_BITS);
+	cl1.andnot_into(cr1, c_1);
+	cl1 -= cr1;
+	auto cl2 = ConcurrentBitset2(N_BITS, DatasetL.data());
+	auto cr2 = ConcurrentBitset2(N_BITS, DatasetR.data());
+	auto c_2 = cl2 - BitsetView(cr2);
+
+	auto viewL = BitsetView(DatasetL.data(), N_BITS);
+  	auto x = view_to_string(viewL);
+  	auto bl = BitsetType(x);
+
+	auto viewR = BitsetView(DatasetR.data(), N_BITS);
+ 	auto y = view_to_string(viewR);
+  	auto br = BitsetType(y);
+
+	std::vector<uint8_t> dst(N);
+	viewL.andnot_into(viewR, dst.data());
+
+	auto b_1 = bl - br;
+	auto flag1 = check_boost_concurrent(b_1, cl1) && check_boost_concurrent(b_1, c_1);
+	auto flag2 = check_boost_concurrent2(b_1, *c_2);
+	auto flag3 = BitsetView((uint8_t*)boost_ext::get_data(b_1), N_BITS) == BitsetView(dst.data(), N_BITS);
+	return flag1 && flag2 && flag3;
+}
+
+bool check_bitset_filter(){
+	auto viewL = BitsetView(DatasetL.data(), N_BITS);
+	std::vector<int64_t> ids;
+	std::vector<float> distances;
+	for (int j = -1; j < N_BITS + 2; j++) {
+		ids.push_back(j);
+		distances.push_back(float(j));
+	}
+
+	bool ret = true;
+	// the dataset, a subview of it starting inside a byte, and its complement
+	for (auto view : {viewL, viewL.subview(5, N_BITS - 5), ~viewL}) {
+		std::vector<int64_t> expect;
+		for (auto id : ids) {
+			if (id >= int64_t(view.size()) || (id >= 0 && !view.test(id))) {
+				expect.push_back(id);
+			}
+		}
+		for (auto level : {bitsets::SimdLevel::NONE, bitsets::SimdLevel::AVX2, bitsets::SimdLevel::AVX512}) {
+			if (level > bitsets::simd_level()) {
+				continue;
+			}
+			auto i = ids;
+			auto d = distances;
+			auto n = bitsets::filter_candidates(view, i.data(), d.data(), i.size(), level);
+			i.resize(n);
+			d.resize(n);
+			ret = ret && i == expect && std::equal(i.begin(), i.end(), d.begin(), [](int64_t id, float dist) {
+				return float(id) == dist;
+			});
+		}
+	}
+
+	// large enough for the gather kernels, plain and complemented ("NOT IN")
+	constexpr size_t size = 1003;
+	std::mt19937 gen(59);
+	auto bitset = ConcurrentBitset2(size);
+	for (size_t i = 0; i < size; i++) {
+		if (gen() % 3 == 0) {
+			bitset.set(i);
+		}
+	}
+	std::vector<int64_t> candidates;
+	for (int k = 0; k < 4000; k++) {
+		candidates.push_back(int64_t(gen() % (size + 40)) - 5);
+	}
+	for (auto view : {BitsetView(bitset), ~BitsetView(bitset)}) {
+		std::vector<int64_t> expect;
+		for (auto id : candidates) {
+			if (id >= int64_t(size) || (id >= 0 && !view.test(id))) {
+				expect.push_back(id);
+			}
+		}
+		for (auto level : {bitsets::SimdLevel::NONE, bitsets::SimdLevel::AVX2, bitsets::SimdLevel::AVX512}) {
+			if (level > bitsets::simd_level()) {
+				continue;
+			}
+			auto i = candidates;
+			std::vector<float> d(i.begin(), i.end());
+			i.resize(bitsets::filter_candidates(view, i.data(), d.data(), i.size(), level));
+			ret = ret && i == expect;
+		}
+	}
+	return ret;
+}
+
+// every scan kernel against a row-by-row reference, over a column long
+// enough for full 64-row blocks and a tail
+template <typename T>
+bool check_scan_column() {
+	constexpr size_t n = 200;
+	std::mt19937 gen(7);
+	std::uniform_int_distribution<int> value_dist(-4, 4);
+	std::vector<T> column(n);
+	for (auto& v : column) {
+		v = T(value_dist(gen));
+	}
+	std::vector<uint8_t> init((n + 1 + 7) / 8);
+	for (auto& b : init) {
+		b = uint8_t(gen());
+	}
+	const T in_list[] = {T(-3), T(0), T(2)};
+
+	auto reference = [&](size_t i, int pred) {
+		T v = column[i];
+		switch (pred) {
+			case 0: return v < T(1);
+			case 1: return v != T(0);
+			case 2: return v >= T(-2) && v <= T(2);
+			case 3: return v > T(-2) && v < T(2);
+			default: return v == T(-3) || v == T(0) || v == T(2);
+		}
+	};
+
+	bool ret = true;
+	for (auto level : {bitsets::SimdLevel::NONE, bitsets::SimdLevel::AVX2, bitsets::SimdLevel::AVX512}) {
+		if (level > bitsets::simd_level()) {
+			continue;
+		}
+		for (auto merge : {bitsets::ScanMerge::ASSIGN, bitsets::ScanMerge::AND, bitsets::ScanMerge::OR}) {
+			for (int pred = 0; pred < 5; pred++) {
+				// one bit past n, which the kernels must leave alone
+				auto bitset = ConcurrentBitset2(n + 1, init.data());
+				auto before = ConcurrentBitset2(n + 1, init.data());
+				auto dst = bitset.mutable_data();
+				switch (pred) {
+					case 0: bitsets::scan_compare(column.data(), n, bitsets::CompareOp::LT, T(1), dst, merge, level); break;
+					case 1: bitsets::scan_compare(column.data(), n, bitsets::CompareOp::NE, T(0), dst, merge, level); break;
+					case 2: bitsets::scan_between(column.data(), n, T(-2), T(2), dst, merge, true, true, level); break;
+					case 3: bitsets::scan_between(column.data(), n, T(-2), T(2), dst, merge, false, false, level); break;
+					default: bitsets::scan_in(column.data(), n, in_list, 3, dst, merge, level); break;
+				}
+				for (size_t i = 0; i < n; i++) {
+					bool old_bit = before.test(i);
+					bool expect = merge == bitsets::ScanMerge::AND ? old_bit && reference(i, pred)
+						: merge == bitsets::ScanMerge::OR ? old_bit || reference(i, pred) : reference(i, pred);
+					ret = ret && bitset.test(i) == expect;
+				}
+				ret = ret && bitset.test(n) == before.test(n);
+			}
+		}
+	}
+	return ret;
+}
+
+bool check_bitset_scan() {
+	return check_scan_column<int8_t>() && check_scan_column<int16_t>() && check_scan_column<int32_t>() &&
+		check_scan_column<int64_t>() && check_scan_column<float>() && check_scan_column<double>();
+}
+
+bool check_bitset_bsi() {
+	std::mt19937 gen(11);
+	std::uniform_int_distribution<int64_t> value_dist(-50, 300);
+	std::vector<int64_t> values(150);
+	for (auto& v : values) {
+		v = value_dist(gen);
+	}
+	// appended in two batches, the second one growing the slices
+	auto index = bitsets::BitSlicedIndex(-50);
+	index.append(values.data(), 100);
+	for (size_t i = 100; i < values.size(); i++) {
+		index.append(values[i]);
+	}
+
+	bool ret = index.size() == values.size() && index.bit_width() == 9 && index.memory_size() > 0;
+	for (size_t i = 0; i < values.size(); i++) {
+		ret = ret && index.get(i) == values[i];
+	}
+
+	const std::pair<bitsets::CompareOp, std::function<bool(int64_t, int64_t)>> ops[] = {
+		{bitsets::CompareOp::EQ, std::equal_to<int64_t>()},
+		{bitsets::CompareOp::NE, std::not_equal_to<int64_t>()},
+		{bitsets::CompareOp::LT, std::less<int64_t>()},
+		{bitsets::CompareOp::LE, std::less_equal<int64_t>()},
+		{bitsets::CompareOp::GT, std::greater<int64_t>()},
+		{bitsets::CompareOp::GE, std::greater_equal<int64_t>()},
+	};
+	for (int64_t c : {int64_t(-100), int64_t(-50), values[3], int64_t(0), int64_t(100), int64_t(461), int64_t(1000)}) {
+		for (auto& op : ops) {
+			auto result = index.compare(op.first, c);
+			for (size_t i = 0; i < values.size(); i++) {
+				ret = ret && result->test(i) == op.second(values[i], c);
+			}
+		}
+		auto range = index.between(c, c + 120);
+		for (size_t i = 0; i < values.size(); i++) {
+			ret = ret && range->test(i) == (values[i] >= c && values[i] <= c + 120);
+		}
+	}
+
+	auto filter = ConcurrentBitset2(values.size());
+	int64_t expect_sum = 0;
+	std::vector<int64_t> selected;
+	for (size_t i = 0; i < values.size(); i += 3) {
+		filter.set(i);
+		expect_sum += values[i];
+		selected.push_back(values[i]);
+	}
+	ret = ret && index.sum(BitsetView(filter)) == expect_sum;
+
+	// the complement selects the other rows; 150 rows end inside a byte, so
+	// the bits past size must not count
+	int64_t total = std::accumulate(values.begin(), values.end(), int64_t(0));
+	ret = ret && index.sum(~BitsetView(filter)) == total - expect_sum;
+	auto rest = index.top_k(values.size(), ~BitsetView(filter));
+	ret = ret && rest->count() == values.size() - selected.size() && !rest->test(0) && rest->test(1);
+
+	std::sort(selected.rbegin(), selected.rend());
+	for (size_t k : {size_t(0), size_t(1), size_t(10), selected.size(), selected.size() + 5}) {
+		auto top = index.top_k(k, BitsetView(filter));
+		size_t n = std::min(k, selected.size());
+		ret = ret && top->count() == n;
+		for (size_t i = 0; i < values.size(); i++) {
+			if (top->test(i)) {
+				ret = ret && filter.test(i) && (n == 0 || values[i] >= selected[n - 1]);
+			}
+		}
+	}
+	return ret;
+}
+
+bool check_bitset_bitmap_index() {
+	// a few frequent values (flat bitmaps) and a long tail (compressed)
+	std::mt19937 gen(13);
+	std::uniform_int_distribution<int64_t> head_dist(0, 3);
+	std::uniform_int_distribution<int64_t> tail_dist(100, 1000);
+	std::vector<int64_t> values(5000);
+	for (auto& v : values) {
+		v = gen() % 2 ? head_dist(gen) : tail_dist(gen);
+	}
+	auto index = bitsets::BitmapIndex();
+	index.append(values.data(), 3000);
+	for (size_t i = 3000; i < values.size(); i++) {
+		index.append(values[i]);
+	}
+
+	auto deleted = ConcurrentBitset2(values.size());
+	for (size_t i = 0; i < values.size(); i += 7) {
+		deleted.set(i);
+	}
+	const int64_t in_list[] = {1, 3, 150, 151, 999, 5000};
+
+	auto check_index = [&](const bitsets::BitmapIndex& idx) {
+		bool ret = idx.size() == values.size() && idx.flat_count() > 0 && idx.flat_count() < idx.cardinality();
+		auto all = ConcurrentBitset2(values.size());
+		auto live = ConcurrentBitset2(values.size());
+		idx.in(in_list, 6, all);
+		idx.in(in_list, 6, BitsetView(deleted), live);
+		for (size_t i = 0; i < values.size(); i++) {
+			bool hit = std::find(std::begin(in_list), std::end(in_list), values[i]) != std::end(in_list);
+			ret = ret && all.test(i) == hit && live.test(i) == (hit && !deleted.test(i));
+		}
+		ret = ret && idx.count(1) == size_t(std::count(values.begin(), values.end(), 1)) && idx.count(5000) == 0;
+
+		// in() writes dst's blocks directly; tracked state is rebuilt
+		auto tracked = ConcurrentBitset2(values.size());
+		tracked.enable_count_tracking();
+		tracked.enable_fingerprint();
+		idx.in(in_list, 6, BitsetView(deleted), tracked);
+		ret = ret && BitsetView(tracked) == BitsetView(live) && tracked.count() == BitsetView(live).count() &&
+			  tracked.fingerprint() == BitsetView(live).fingerprint();
+		return ret;
+	};
+
+	bool ret = check_index(index);
+	auto buf = index.serialize();
+	auto loaded = bitsets::BitmapIndex();
+	ret = ret && loaded.load(buf.data(), buf.size()) && check_index(loaded);
+	ret = ret && !loaded.load(buf.data(), buf.size() - 1) && loaded.size() == 0;
+	return ret;
+}
+
+bool check_bitset_reduce() {
+	// long enough for several tiles and a byte tail; dense operands so the
+	// intersection survives a few of them before tiles drop out
+	constexpr size_t size = 3 * 4096 * 8 + 13;
+	std::mt19937 gen(17);
+	std::bernoulli_distribution bit_dist(0.9);
+	std::vector<ConcurrentBitset2> bitsets;
+	std::vector<BitsetView> views;
+	for (int k = 0; k < 40; k++) {
+		bitsets.emplace_back(size);
+		for (size_t i = 0; i < size; i++) {
+			if (bit_dist(gen)) {
+				bitsets.back().set(i);
+			}
+		}
+	}
+	for (auto& bitset : bitsets) {
+		views.emplace_back(bitset);
+	}
+
+	bool ret = true;
+	for (size_t n : {0, 1, 2, 40}) {
+		auto expect_or = ConcurrentBitset2(size);
+		auto expect_and = ConcurrentBitset2(size, uint8_t(0xff));
+		for (size_t k = 0; k < n; k++) {
+			expect_or |= bitsets[k];
+			expect_and &= bitsets[k];
+		}
+		for (bool parallel : {false, true}) {
+			auto dst = ConcurrentBitset2(size);
+			bitsets::union_many(views.data(), n, dst.mutable_data(), size, parallel);
+			ret = ret && BitsetView(dst) == BitsetView(expect_or);
+			bitsets::intersect_many(views.data(), n, dst.mutable_data(), size, parallel);
+			ret = ret && BitsetView(dst) == BitsetView(expect_and);
+			// bits past size stay clear, also when n == 0 fills with 1s
+			ret = ret && (dst.data()[dst.byte_size() - 1] >> (size % 8)) == 0;
+		}
+	}
+
+	// operands starting inside a byte, each at its own offset, every other
+	// one complemented
+	constexpr size_t sub_size = size - 8;
+	std::vector<BitsetView> subviews;
+	for (size_t k = 0; k < 4; k++) {
+		auto sub = views[k].subview(k + 1, sub_size);
+		subviews.push_back(k % 2 ? ~sub : sub);
+	}
+	auto dst_or = ConcurrentBitset2(sub_size);
+	auto dst_and = ConcurrentBitset2(sub_size);
+	auto dst_maj = ConcurrentBitset2(sub_size);
+	auto dst_two = ConcurrentBitset2(sub_size);
+	bitsets::union_many(subviews.data(), 4, dst_or.mutable_data(), sub_size);
+	bitsets::intersect_many(subviews.data(), 4, dst_and.mutable_data(), sub_size);
+	bitsets::threshold(subviews.data(), 3, 2, dst_maj.mutable_data(), sub_size);
+	bitsets::threshold(subviews.data(), 4, 2, dst_two.mutable_data(), sub_size);
+	for (size_t i = 0; i < sub_size; i++) {
+		size_t hits = 0, hits3 = 0;
+		for (size_t k = 0; k < 4; k++) {
+			bool bit = bitsets[k].test(i + k + 1) != (k % 2 == 1);
+			hits += bit;
+			hits3 += k < 3 && bit;
+		}
+		ret = ret && dst_or.test(i) == (hits >= 1) && dst_and.test(i) == (hits == 4) &&
+		      dst_maj.test(i) == (hits3 >= 2) && dst_two.test(i) == (hits >= 2);
+	}
+
+	// a complemented operand reads as its negation, with the bits past size
+	// still clear
+	auto sparse = ConcurrentBitset2(size);
+	auto empty = ConcurrentBitset2(size);
+	sparse.set(5);
+	BitsetView operands[] = {BitsetView(sparse), ~BitsetView(empty)};
+	auto dst = ConcurrentBitset2(size);
+	bitsets::union_many(operands, 2, dst.mutable_data(), size);
+	ret = ret && dst.count() == size && (dst.data()[dst.byte_size() - 1] >> (size % 8)) == 0;
+	bitsets::intersect_many(operands, 2, dst.mutable_data(), size);
+	ret = ret && dst.count() == 1 && dst.test(5);
+	return ret;
+}
+
+bool check_bitset_threshold() {
+	// a few full 4096-bit blocks and a partial one
+	constexpr size_t size = 3 * 4096 + 100;
+	std::mt19937 gen(19);
+	std::bernoulli_distribution bit_dist(0.4);
+	std::vector<ConcurrentBitset2> bitsets;
+	std::vector<BitsetView> views;
+	for (int k = 0; k < 13; k++) {
+		bitsets.emplace_back(size);
+		for (size_t i = 0; i < size; i++) {
+			if (bit_dist(gen)) {
+				bitsets.back().set(i);
+			}
+		}
+	}
+	for (auto& bitset : bitsets) {
+		views.emplace_back(bitset);
+	}
+
+	bool ret = true;
+	for (size_t n : {1, 3, 4, 8, 13}) {
+		for (size_t t = 0; t <= n + 1; t++) {
+			auto dst = ConcurrentBitset2(size);
+			bitsets::threshold(views.data(), n, t, dst.mutable_data(), size);
+			ret = ret && (dst.data()[dst.byte_size() - 1] >> (size % 8)) == 0;
+			for (size_t i = 0; i < size; i++) {
+				size_t hits = 0;
+				for (size_t k = 0; k < n; k++) {
+					hits += bitsets[k].test(i);
+				}
+				ret = ret && dst.test(i) == (hits >= t);
+			}
+		}
+	}
+	return ret;
+}
+
+bool check_bitset_sorted_ids() {
+	constexpr size_t size = 100000 + 3;
+	std::mt19937 gen(23);
+	bool ret = true;
+	// sparse and dense lists against sparse and dense bitsets, so both
+	// output forms come up
+	for (double view_density : {0.001, 0.5}) {
+		for (double list_density : {0.0001, 0.3}) {
+			std::bernoulli_distribution view_dist(view_density);
+			std::bernoulli_distribution list_dist(list_density);
+			// the view is a subview starting inside a byte of padded
+			auto bitset = ConcurrentBitset2(size);
+			auto padded = ConcurrentBitset2(size + 3);
+			std::vector<int64_t> ids;
+			for (size_t i = 0; i < size; i++) {
+				if (view_dist(gen)) {
+					bitset.set(i);
+					padded.set(i + 3);
+				}
+				if (list_dist(gen)) {
+					ids.push_back(i);
+				}
+			}
+			auto view = BitsetView(padded).subview(3, size);
+
+			std::vector<int64_t> expect_and, expect_diff, expect_or;
+			for (auto id : ids) {
+				(bitset.test(id) ? expect_and : expect_diff).push_back(id);
+			}
+			for (size_t i = 0; i < size; i++) {
+				if (bitset.test(i) || std::binary_search(ids.begin(), ids.end(), int64_t(i))) {
+					expect_or.push_back(i);
+				}
+			}
+
+			auto same = [](const bitsets::IdSet& out, size_t n, const std::vector<int64_t>& expect) {
+				if (n != expect.size() || out.count() != expect.size()) {
+					return false;
+				}
+				if (!out.dense()) {
+					return out.ids == expect;
+				}
+				for (auto id : expect) {
+					if (!out.bitset->test(id)) {
+						return false;
+					}
+				}
+				return true;
+			};
+			bitsets::IdSet out;
+			ret = ret && same(out, bitsets::intersect_sorted(view, ids.data(), ids.size(), out), expect_and);
+			ret = ret && same(out, bitsets::difference_sorted(view, ids.data(), ids.size(), out), expect_diff);
+			ret = ret && same(out, bitsets::union_sorted(view, ids.data(), ids.size(), out), expect_or);
+
+			// against the complement, intersection and difference swap
+			std::vector<int64_t> expect_or_not;
+			for (size_t i = 0; i < size; i++) {
+				if (!bitset.test(i) || std::binary_search(ids.begin(), ids.end(), int64_t(i))) {
+					expect_or_not.push_back(i);
+				}
+			}
+			ret = ret && same(out, bitsets::intersect_sorted(~view, ids.data(), ids.size(), out), expect_diff);
+			ret = ret && same(out, bitsets::difference_sorted(~view, ids.data(), ids.size(), out), expect_and);
+			ret = ret && same(out, bitsets::union_sorted(~view, ids.data(), ids.size(), out), expect_or_not);
+		}
+	}
+	return ret;
+}
+
+bool check_bitset_compaction() {
+	// more than one chunk, not a multiple of 64
+	constexpr size_t size = 3 * 65536 + 100;
+	std::mt19937 gen(29);
+	std::bernoulli_distribution dist(0.3);
+	auto deleted = ConcurrentBitset2(size);
+	auto filter = ConcurrentBitset2(size);
+	for (size_t i = 0; i < size; i++) {
+		if (dist(gen)) {
+			deleted.set(i);
+		}
+		if (dist(gen)) {
+			filter.set(i);
+		}
+	}
+
+	std::vector<int64_t> expect_remap(size, -1), expect_survivors;
+	for (size_t i = 0; i < size; i++) {
+		if (!deleted.test(i)) {
+			expect_remap[i] = expect_survivors.size();
+			expect_survivors.push_back(i);
+		}
+	}
+
+	bool ret = true;
+	for (auto level : {bitsets::SimdLevel::NONE, bitsets::SimdLevel::AVX2, bitsets::SimdLevel::AVX512}) {
+		if (level > bitsets::simd_level()) {
+			continue;
+		}
+		for (bool parallel : {false, true}) {
+			bitsets::CompactionRemap out;
+			auto n = bitsets::compaction_remap(BitsetView(deleted), out, BitsetView(), parallel, level);
+			ret = ret && n == expect_survivors.size() && out.remap == expect_remap &&
+				  out.survivors == expect_survivors && out.filter == nullptr;
+
+			n = bitsets::compaction_remap(BitsetView(deleted), out, BitsetView(filter), parallel, level);
+			ret = ret && n == expect_survivors.size() && out.remap == expect_remap &&
+				  out.survivors == expect_survivors && out.filter && out.filter->size() == n;
+			for (size_t i = 0; ret && i < n; i++) {
+				ret = out.filter->test(i) == filter.test(expect_survivors[i]);
+			}
+
+			// under the complement of deleted, the deleted rows survive
+			n = bitsets::compaction_remap(~BitsetView(deleted), out, BitsetView(), parallel, level);
+			ret = ret && n == size - expect_survivors.size() && out.survivors.size() == n;
+			for (size_t i = 0; ret && i < size; i++) {
+				ret = (out.remap[i] >= 0) == deleted.test(i);
+			}
+		}
+	}
+	return ret;
+}
+
+bool check_bitset_shift() {
+	constexpr size_t size = 5000 + 3;
+	std::mt19937 gen(31);
+	std::bernoulli_distribution dist(0.5);
+	auto bitset = ConcurrentBitset2(size);
+	for (size_t i = 0; i < size; i++) {
+		if (dist(gen)) {
+			bitset.set(i);
+		}
+	}
+	auto view = BitsetView(bitset);
+	auto x = view_to_string(view);
+	auto b = BitsetType(x);
+
+	bool ret = true;
+	for (size_t n : {0, 1, 7, 63, 64, 65, 200, 1037, 4999, 5003, 6000}) {
+		auto left = ConcurrentBitset2(size, bitset.data());
+		left.enable_count_tracking();
+		left <<= n;
+		ret = ret && check_boost_concurrent2(b << n, left) && left.count() == (b << n).count();
+		ret = ret && check_boost_concurrent2(b << n, *(bitset << n));
+
+		auto right = ConcurrentBitset(size, bitset.data());
+		right >>= n;
+		ret = ret && check_boost_concurrent(b >> n, right);
+		ret = ret && check_boost_concurrent2(b >> n, *(bitset >> n));
+
+		// in place through a view, and from a view into a buffer
+		auto copy = ConcurrentBitset2(size, bitset.data());
+		auto copy_view = BitsetView(copy);
+		copy_view >>= n;
+		ret = ret && check_boost_concurrent2(b >> n, copy);
+		view.shift_left_into(n, copy.mutable_data());
+		ret = ret && check_boost_concurrent2(b << n, copy);
+
+		// kernels at every level
+		for (auto level : {bitsets::SimdLevel::NONE, bitsets::SimdLevel::AVX2, bitsets::SimdLevel::AVX512}) {
+			if (level > bitsets::simd_level()) {
+				continue;
+			}
+			faiss::kernels::shift_up(copy.mutable_data(), bitset.data(), n, size, level);
+			ret = ret && check_boost_concurrent2(b << n, copy);
+			faiss::kernels::shift_down(copy.mutable_data(), bitset.data(), size, n, size, level);
+			ret = ret && check_boost_concurrent2(b >> n, copy);
+		}
+	}
+
+	for (size_t offset : {0, 5, 64, 1000, 4990}) {
+		for (size_t length : {1, 64, 130, 3000}) {
+			auto part = bitset.extract(offset, length);
+			ret = ret && part->size() == length;
+			for (size_t i = 0; ret && i < length; i++) {
+				ret = part->test(i) == (offset + i < size && bitset.test(offset + i));
+			}
+		}
+	}
+	return ret;
+}
+
+bool check_bitset_subview() {
+	constexpr size_t size = 10000;
+	std::mt19937 gen(37);
+	std::bernoulli_distribution dist(0.5);
+	auto bitset = ConcurrentBitset2(size);
+	auto other = ConcurrentBitset2(size);
+	for (size_t i = 0; i < size; i++) {
+		if (dist(gen)) {
+			bitset.set(i);
+		}
+		if (dist(gen)) {
+			other.set(i);
+		}
+	}
+
+	// each subview against a copy of its bits
+	auto copy_of = [](const BitsetView& view) {
+		auto ret = ConcurrentBitset2(view.size());
+		for (size_t i = 0; i < view.size(); i++) {
+			if (view.test(i)) {
+				ret.set(i);
+			}
+		}
+		return ret;
+	};
+
+	// bits past size() are not compared: ops with a subview ending inside a
+	// byte may leave the bits after it there
+	auto same = [](const ConcurrentBitset2& lhs, const ConcurrentBitset2& rhs) {
+		return BitsetView(lhs) == BitsetView(rhs);
+	};
+
+	bool ret = true;
+	for (size_t offset : {0, 3, 64, 1003}) {
+		for (size_t length : {0, 1, 5, 130, 1000, 8000}) {
+			auto sub = BitsetView(bitset).subview(offset, length);
+			auto other_sub = BitsetView(other).subview(size - length - 1, length);
+			auto expect = copy_of(sub);
+			auto expect_other = copy_of(other_sub);
+			for (size_t i = 0; ret && i < length; i++) {
+				ret = sub.test(i) == bitset.test(offset + i);
+			}
+			ret = ret && sub.count() == expect.count() && sub == BitsetView(expect);
+
+			std::vector<int64_t> ids;
+			sub.for_each([&](int64_t id) { ids.push_back(id); });
+			ret = ret && ids.size() == expect.count();
+			for (auto id : ids) {
+				ret = ret && expect.test(id);
+			}
+
+			// aligned bitset op misaligned view
+			auto l = ConcurrentBitset2(length, expect_other.data());
+			l.enable_count_tracking();
+			l &= sub;
+			ret = ret && same(l, *(expect_other & expect)) && l.count() == (expect_other & expect)->count();
+			ret = ret && same(*(expect_other | sub), *(expect_other | expect));
+			ret = ret && same(*(expect_other ^ sub), *(expect_other ^ expect));
+			ret = ret && same(*(expect_other - sub), *(expect_other - expect));
+
+			// misaligned view op misaligned view, into a buffer and in place
+			auto dst = ConcurrentBitset2(length);
+			sub.xor_into(other_sub, dst.mutable_data());
+			ret = ret && same(dst, *(expect ^ expect_other));
+			sub.andnot_into(other_sub, dst.mutable_data());
+			ret = ret && same(dst, *(expect - expect_other));
+
+			auto target = ConcurrentBitset2(size, bitset.data());
+			auto target_sub = BitsetView(target).subview(offset, length);
+			target_sub -= other_sub;
+			auto expect_target = copy_of(BitsetView(target).subview(offset, length));
+			ret = ret && same(expect_target, *(expect - expect_other));
+			// and against a byte-aligned one, which must not touch the
+			// bits after the target either
+			auto aligned_sub = BitsetView(other).subview(64, length);
+			target_sub ^= aligned_sub;
+			ret = ret && same(copy_of(target_sub), *(expect_target ^ copy_of(aligned_sub)));
+			for (size_t i = 0; ret && i < size; i++) {
+				ret = i >= offset && i < offset + length ? true : target.test(i) == bitset.test(i);
+			}
+
+			// shifts and extraction
+			target = ConcurrentBitset2(size, bitset.data());
+			target_sub = BitsetView(target).subview(offset, length);
+			target_sub <<= 7;
+			ret = ret && same(copy_of(target_sub), *(expect << 7));
+			target_sub >>= 70;
+			ret = ret && same(copy_of(target_sub), *(*(expect << 7) >> 70));
+			for (size_t i = 0; ret && i < size; i++) {
+				ret = i >= offset && i < offset + length ? true : target.test(i) == bitset.test(i);
+			}
+			sub.shift_left_into(9, dst.mutable_data());
+			ret = ret && same(dst, *(expect << 9));
+			sub.shift_right_into(9, dst.mutable_data());
+			ret = ret && same(dst, *(expect >> 9));
+
+			auto fixed = bitsets::FixedBitset<256>(sub);
+			for (size_t i = 0; ret && i < 256; i++) {
+				ret = fixed.test(i) == (i < length && expect.test(i));
+			}
+		}
+	}
+	return ret;
+}
+
+bool check_bitset_composite() {
+	std::mt19937 gen(41);
+	std::bernoulli_distribution dist(0.5);
+	std::vector<size_t> sizes = {1000, 77, 5003, 64};
+	std::vector<int64_t> bases = {0, 1000, 2000, 7003};  // a gap after the second segment
+	auto random_segments = [&]() {
+		std::vector<ConcurrentBitset> ret;
+		for (auto size : sizes) {
+			ret.emplace_back(size);
+			for (size_t i = 0; i < size; i++) {
+				if (dist(gen)) {
+					ret.back().set(i);
+				}
+			}
+		}
+		return ret;
+	};
+	auto lhs = random_segments();
+	auto rhs = random_segments();
+	auto compose = [&](const std::vector<ConcurrentBitset>& segments) {
+		bitsets::CompositeBitsetView ret;
+		for (size_t i = 0; i < segments.size(); i++) {
+			ret.append(BitsetView(segments[i]), bases[i]);
+		}
+		return ret;
+	};
+	auto lhs_view = compose(lhs);
+	auto rhs_view = compose(rhs);
+
+	// brute force over the global id space
+	auto expect_test = [&](const std::vector<ConcurrentBitset>& segments, int64_t id) {
+		for (size_t i = 0; i < segments.size(); i++) {
+			if (id >= bases[i] && id < bases[i] + int64_t(sizes[i])) {
+				return segments[i].test(id - bases[i]);
+			}
+		}
+		return false;
+	};
+
+	bool ret = lhs_view.size() == 7003 + 64 && lhs_view.segment_count() == 4 && lhs_view.same_layout(rhs_view);
+	size_t expect_count = 0;
+	std::vector<int64_t> expect_ids;
+	for (int64_t id = 0; id < int64_t(lhs_view.size()) + 10; id++) {
+		bool bit = expect_test(lhs, id);
+		ret = ret && lhs_view.test(id) == bit;
+		if (bit) {
+			expect_count++;
+			expect_ids.push_back(id);
+		}
+	}
+	std::vector<int64_t> ids;
+	lhs_view.for_each([&](int64_t id) { ids.push_back(id); });
+	ret = ret && lhs_view.count() == expect_count && ids == expect_ids;
+
+	// segment-wise ops write through to the segments
+	std::vector<ConcurrentBitset> expect;
+	for (size_t i = 0; i < lhs.size(); i++) {
+		expect.emplace_back(sizes[i], lhs[i].data());
+		expect.back() ^= rhs[i];
+		expect.back() |= rhs[i];
+		expect.back() -= rhs[i];
+	}
+	lhs_view ^= rhs_view;
+	lhs_view |= rhs_view;
+	lhs_view -= rhs_view;
+	for (size_t i = 0; i < lhs.size(); i++) {
+		ret = ret && BitsetView(lhs[i]) == BitsetView(expect[i]);
+	}
+	lhs_view &= rhs_view;
+	ret = ret && lhs_view.count() == 0;
+
+	auto other_layout = bitsets::CompositeBitsetView({BitsetView(lhs[0]), BitsetView(lhs[1])});
+	ret = ret && !other_layout.same_layout(lhs_view) && other_layout.base(1) == 1000;
+	return ret;
+}
+
+bool check_bitset_numa() {
+	// large enough for first_touch to go parallel
+	constexpr size_t size = 3 * 8 * 1024 * 1024 + 5;
+	auto reference = ConcurrentBitset(size);
+	for (size_t i = 0; i < size; i += 997) {
+		reference.set(i);
+	}
+
+	bool ret = bitsets::numa_node_count() >= 1;
+	for (auto placement : {bitsets::NumaPlacement::FIRST_TOUCH, bitsets::NumaPlacement::INTERLEAVE,
+						   bitsets::NumaPlacement::LOCAL, bitsets::NumaPlacement::PARTITIONED}) {
+		auto alloc = bitsets::NumaAllocator<uint8_t>(placement);
+		auto ones = bitsets::NumaConcurrentBitset(size, alloc, 0xff);
+		ret = ret && ones.count() == size;
+
+		auto bitset = bitsets::NumaConcurrentBitset(size, alloc);
+		ret = ret && bitset.count() == 0;
+		for (size_t i = 0; i < size; i += 997) {
+			bitset.set(i);
+		}
+		ret = ret && BitsetView(bitset) == BitsetView(reference);
+		ones -= BitsetView(bitset);
+		ret = ret && ones.count() == size - reference.count() && !ones.test(997) && ones.test(998);
+
+		// out-of-place results keep the placement
+		auto result = ones & BitsetView(bitset);
+		ret = ret && result->get_allocator().placement() == placement && result->count() == 0;
+		ret = ret && (ones >> 1)->get_allocator().placement() == placement;
+	}
+	return ret;
+}
+
+bool check_bitset_aligned() {
+	bool ret = true;
+	for (size_t size : {1, 61, 512, 4099, 3 * 8 * 1024 * 1024 + 5}) {
+		auto reference = ConcurrentBitset(size);
+		for (size_t i = 0; i < size; i += 7) {
+			reference.set(i);
+		}
+		for (auto huge_pages : {bitsets::HugePages::NONE, bitsets::HugePages::TRANSPARENT,
+								bitsets::HugePages::EXPLICIT}) {
+			auto bitset = ConcurrentBitset(size, bitsets::AlignedAllocator<uint8_t>(huge_pages), 0xff);
+			ret = ret && reinterpret_cast<uintptr_t>(bitset.data()) % 64 == 0 && bitset.count() == size;
+
+			// padding past the last byte reads as zero
+			size_t padded = (bitset.byte_size() + 63) / 64 * 64;
+			for (size_t i = bitset.byte_size(); i < padded; i++) {
+				ret = ret && bitset.data()[i] == 0;
+			}
+
+			// out-of-place results stay on the same pages
+			ret = ret && (bitset & reference)->get_allocator().huge_pages() == huge_pages;
+			ret = ret && bitset.extract(1, size - 1)->get_allocator().huge_pages() == huge_pages;
+
+			bitset &= reference;
+			ret = ret && bitset == reference;
+			auto moved = std::move(bitset);
+			ret = ret && moved == reference;
+
+			// with 64-bit words, the bytes of the last word past byte_size()
+			// stay 0 as well
+			auto wide = bitsets::ConcurrentBitset64(size, bitsets::AlignedAllocator<uint64_t>(huge_pages), 0xff);
+			ret = ret && wide.count() == size;
+			for (size_t i = wide.byte_size(); i < (size + 63) / 64 * 8; i++) {
+				ret = ret && wide.data()[i] == 0;
+			}
+		}
+
+		auto scratch = bitsets::ConcurrentBitset2(size);
+		ret = ret && reinterpret_cast<uintptr_t>(scratch.data()) % 64 == 0;
+	}
+	return ret;
+}
+
+template <typename Op>
+bool check_stream_op(const std::vector<uint8_t>& lhs, const std::vector<uint8_t>& rhs) {
+	namespace kernels = faiss::kernels;
+	bool ret = true;
+	std::vector<uint8_t> expected(lhs.size());
+	std::vector<uint8_t> actual(lhs.size() + 64);
+	for (auto level : {bitsets::SimdLevel::NONE, bitsets::SimdLevel::AVX2, bitsets::SimdLevel::AVX512}) {
+		// dst on and off a cache line, and lengths leaving a ragged tail
+		for (size_t shift : {0, 3}) {
+			for (size_t n8 : {size_t(0), size_t(5), size_t(200), lhs.size() - 7}) {
+				auto n = kernels::binary_op<Op, true>(expected.data(), lhs.data(), rhs.data(), n8);
+				auto dst = actual.data() + (64 - reinterpret_cast<uintptr_t>(actual.data()) % 64) % 64 + shift;
+				auto m = kernels::binary_op_stream<Op, true>(dst, lhs.data(), rhs.data(), n8, level);
+				ret = ret && n == m && std::equal(expected.begin(), expected.begin() + n8, dst);
+				memset(dst, 0, n8);
+				kernels::binary_op_stream<Op>(dst, lhs.data(), rhs.data(), n8, level);
+				ret = ret && std::equal(expected.begin(), expected.begin() + n8, dst);
+			}
+		}
+	}
+	return ret;
+}
+
+bool check_bitset_stream() {
+	std::mt19937 gen(7);
+	std::vector<uint8_t> lhs(10000);
+	std::vector<uint8_t> rhs(10000);
+	for (size_t i = 0; i < lhs.size(); i++) {
+		lhs[i] = gen();
+		rhs[i] = gen();
+	}
+	bool ret = check_stream_op<faiss::kernels::AndOp>(lhs, rhs) && check_stream_op<faiss::kernels::OrOp>(lhs, rhs) &&
+			   check_stream_op<faiss::kernels::XorOp>(lhs, rhs) && check_stream_op<faiss::kernels::AndNotOp>(lhs, rhs);
+
+	// the same results through the bitset operators, streamed or not
+	auto threshold = faiss::kernels::stream_threshold();
+	constexpr size_t size = 8 * 10000 - 3;
+	auto a = ConcurrentBitset(size, lhs.data());
+	auto b = ConcurrentBitset(size, rhs.data());
+	faiss::kernels::set_stream_threshold(SIZE_MAX);
+	auto cached_and = a & b;
+	auto cached_andnot = ConcurrentBitset(size);
+	a.andnot_into(BitsetView(b), cached_andnot);
+	faiss::kernels::set_stream_threshold(0);
+	auto streamed_and = a & b;
+	auto streamed_andnot = ConcurrentBitset(size);
+	streamed_andnot.enable_count_tracking();
+	a.andnot_into(BitsetView(b), streamed_andnot);
+	auto view_xor = std::vector<uint8_t>(a.byte_size());
+	BitsetView(a).xor_into(BitsetView(b), view_xor.data());
+	faiss::kernels::set_stream_threshold(threshold);
+
+	ret = ret && *streamed_and == *cached_and && streamed_andnot == cached_andnot &&
+		  streamed_andnot.count() == cached_andnot.count() && BitsetView(view_xor.data(), size) == BitsetView(*(a ^ b));
+	return ret;
+}
+
+bool check_bitset_write_combiner() {
+	constexpr size_t size = 100003;
+	constexpr size_t n_threads = 8;
+	auto reference = ConcurrentBitset(size);
+	for (size_t i = 0; i < size; i++) {
+		if (i % 3 == 0 || i % 7 == 0) {
+			reference.set(i);
+		}
+	}
+
+	auto bitset = bitsets::ConcurrentBitset64(size);
+	bitset.enable_count_tracking();
+	auto narrow = ConcurrentBitset(size);
+	bool ret = true;
+	{
+		bitsets::WriteCombiner<bitsets::ConcurrentBitset64> combiner(bitset, 16);
+		bitsets::WriteCombiner<ConcurrentBitset> narrow_combiner(narrow);
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < n_threads; t++) {
+			threads.emplace_back([&, t]() {
+				// threads overlap on the same rows, in the same hot region
+				for (size_t i = 0; i < size; i++) {
+					if ((i % 3 == 0 && i % n_threads == t) || (i % 7 == 0 && (i / 7) % 2 == t % 2)) {
+						combiner.set(i);
+						narrow_combiner.set(i);
+					}
+				}
+				narrow_combiner.flush();
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		combiner.sync();
+		ret = BitsetView(bitset) == BitsetView(reference) && bitset.count() == reference.count();
+
+		// a set made after a sync shows after the next one
+		combiner.set(1);
+		ret = ret && !bitset.test(1);
+		combiner.sync();
+		ret = ret && bitset.test(1) && bitset.count() == reference.count() + 1;
+	}
+	// narrow_combiner flushed its buffers on the threads
+	ret = ret && BitsetView(narrow) == BitsetView(reference);
+
+	// short-lived combiners, one after another on the same threads
+	auto churn = bitsets::ConcurrentBitset64(size);
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < n_threads; t++) {
+		threads.emplace_back([&, t]() {
+			for (size_t i = t; i < 1000; i += n_threads) {
+				bitsets::WriteCombiner<bitsets::ConcurrentBitset64> combiner(churn, 4);
+				combiner.set(i);
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	return ret && churn.count() == 1000;
+}
+
+bool check_bitset_complement() {
+	std::mt19937 gen(41);
+	std::bernoulli_distribution dist(0.3);
+	bool ret = true;
+	for (size_t size : {64, 1003, 4099}) {
+		auto a = ConcurrentBitset2(size);
+		auto b = ConcurrentBitset2(size);
+		for (size_t i = 0; i < size; i++) {
+			if (dist(gen)) {
+				a.set(i);
+			}
+			if (dist(gen)) {
+				b.set(i);
+			}
+		}
+		// ~b the slow way, with its tail bits cleared
+		auto not_b = ConcurrentBitset2(size);
+		for (size_t i = 0; i < size; i++) {
+			if (!b.test(i)) {
+				not_b.set(i);
+			}
+		}
+		auto view_a = BitsetView(a);
+		auto view_b = BitsetView(b);
+		auto view_not_b = BitsetView(not_b);
+
+		ret = ret && (~view_b).complemented() && !(~~view_b).complemented() && ~view_b == view_not_b &&
+			  view_not_b == ~view_b && ~view_b != view_b && (~view_b).count() == not_b.count() &&
+			  (~view_b).test(size - 1) == not_b.test(size - 1);
+		size_t n = 0;
+		(~view_b).for_each([&](int64_t i) { ret = ret && not_b.test(i); n++; });
+		ret = ret && n == not_b.count();
+
+		// BasicBitset ops with a complemented view; results keep their tails
+		// clear, so whole bytes compare equal
+		ret = ret && *(a & ~view_b) == *(a & view_not_b) && *(a | ~view_b) == *(a | view_not_b) &&
+			  *(a ^ ~view_b) == *(a ^ view_not_b) && *(a - ~view_b) == *(a - view_not_b);
+		auto tracked = a;
+		tracked.enable_count_tracking();
+		tracked |= ~view_b;
+		ret = ret && tracked.count() == (a | view_not_b)->count() && tracked == *(a | view_not_b);
+
+		// view ops: complemented on either side, written through or into dst
+		std::vector<uint8_t> buffer(a.data(), a.data() + a.byte_size());
+		std::vector<uint8_t> dst(a.byte_size());
+		BitsetView(buffer.data(), size) &= ~view_b;
+		ret = ret && BitsetView(buffer.data(), size) == BitsetView(*(a - view_b));
+		buffer.assign(a.data(), a.data() + a.byte_size());
+		auto not_x = ~BitsetView(buffer.data(), size);
+		not_x |= view_b;  // x = ~(~a | b) = a & ~b
+		ret = ret && BitsetView(buffer.data(), size) == BitsetView(*(a - view_b));
+		(~view_a).andnot_into(~view_b, dst.data());  // ~a & b
+		ret = ret && BitsetView(dst.data(), size) == BitsetView(*(b - view_a));
+		view_a.xor_into(~view_b, dst.data());
+		ret = ret && BitsetView(dst.data(), size) == BitsetView(*(a ^ view_not_b));
+
+		// subviews off a byte boundary keep the flag
+		for (size_t offset : {3, 13}) {
+			size_t len = size - offset - 5;
+			auto sub = (~view_b).subview(offset, len);
+			ret = ret && sub.complemented() && sub == view_not_b.subview(offset, len) &&
+				  sub.count() == view_not_b.subview(offset, len).count();
+			std::vector<uint8_t> expected(std::max<size_t>(len / 8 + 1, 13));
+			std::vector<uint8_t> actual(expected.size());
+			view_not_b.extract_into(offset, len, expected.data());
+			(~view_b).extract_into(offset, len, actual.data());
+			ret = ret && expected == actual;
+			(~view_b).extract_into(size - 40, 100, actual.data());
+			view_not_b.extract_into(size - 40, 100, expected.data());
+			ret = ret && std::equal(expected.begin(), expected.begin() + 13, actual.begin());
+		}
+
+		// shifts, into dst and written through
+		std::vector<uint8_t> expected(a.byte_size());
+		(~view_b).shift_left_into(5, dst.data());
+		view_not_b.shift_left_into(5, expected.data());
+		ret = ret && BitsetView(dst.data(), size) == BitsetView(expected.data(), size);
+		(~view_b).shift_right_into(70, dst.data());
+		view_not_b.shift_right_into(70, expected.data());
+		ret = ret && BitsetView(dst.data(), size) == BitsetView(expected.data(), size);
+		buffer.assign(b.data(), b.data() + b.byte_size());
+		auto shifted = ~BitsetView(buffer.data(), size);
+		shifted <<= 9;
+		ret = ret && shifted == BitsetView(*(not_b << 9));
+		shifted >>= 20;
+		ret = ret && shifted == BitsetView(*(*(not_b << 9) >> 20));
+
+		ret = ret && FixedBitset(~view_b) == FixedBitset(view_not_b);
+	}
+	return ret;
+}
+
+bool check_bitset_relations() {
+	using Relation = bitsets::BitsetRelation;
+	// the relation by brute force
+	auto expected = [](const BitsetView& lhs, const BitsetView& rhs) {
+		bool only_l = false;
+		bool only_r = false;
+		bool both = false;
+		for (size_t i = 0; i < lhs.size(); i++) {
+			only_l = only_l || (lhs.test(i) && !rhs.test(i));
+			only_r = only_r || (rhs.test(i) && !lhs.test(i));
+			both = both || (lhs.test(i) && rhs.test(i));
+		}
+		return !only_l ? (only_r ? Relation::SUBSET : Relation::EQUAL)
+					   : !only_r ? Relation::SUPERSET : both ? Relation::OVERLAP : Relation::DISJOINT;
+	};
+	auto agrees = [&](const BitsetView& lhs, const BitsetView& rhs) {
+		auto relation = expected(lhs, rhs);
+		bool subset = relation == Relation::EQUAL || relation == Relation::SUBSET;
+		bool disjoint = lhs.count() == 0 || rhs.count() == 0 || relation == Relation::DISJOINT;
+		return lhs.compare(rhs) == relation && lhs.is_subset_of(rhs) == subset && lhs.intersects(rhs) == !disjoint &&
+			   lhs.is_disjoint(rhs) == disjoint;
+	};
+
+	std::mt19937 gen(43);
+	bool ret = true;
+	for (size_t size : {61, 1003, 5000}) {
+		// sparse a; b a superset of a; c disjoint from a
+		auto a = ConcurrentBitset2(size);
+		auto b = ConcurrentBitset2(size);
+		auto c = ConcurrentBitset2(size);
+		for (size_t i = 0; i < size; i++) {
+			auto r = gen() % 16;
+			if (r == 0) {
+				a.set(i);
+				b.set(i);
+			} else if (r == 1) {
+				b.set(i);
+			} else if (r == 2) {
+				c.set(i);
+			}
+		}
+		std::vector<std::pair<ConcurrentBitset2*, ConcurrentBitset2*>> pairs = {{&a, &b}, {&b, &a}, {&a, &a}, {&a, &c},
+																			   {&b, &c}, {&c, &b}};
+		for (auto& pair : pairs) {
+			auto lhs = BitsetView(*pair.first);
+			auto rhs = BitsetView(*pair.second);
+			ret = ret && agrees(lhs, rhs) && agrees(~lhs, rhs) && agrees(lhs, ~rhs) &&
+				  agrees(lhs.subview(3, size - 9), rhs.subview(3, size - 9)) &&
+				  agrees(lhs.subview(5, size - 9), rhs.subview(3, size - 9));
+			for (auto level : {bitsets::SimdLevel::NONE, bitsets::SimdLevel::AVX2, bitsets::SimdLevel::AVX512}) {
+				auto flags = faiss::kernels::relation_flags(lhs.data(), rhs.data(), size, 0x7, level);
+				auto relation = expected(lhs, rhs);
+				ret = ret && (flags & faiss::kernels::ONLY_LHS) ==
+								 (relation == Relation::EQUAL || relation == Relation::SUBSET ? 0 : 1);
+			}
+		}
+
+		// a lone difference in the last bit decides; one past size() does not
+		auto d = a;
+		d.set(size - 1);
+		ret = ret && a.compare(d) == (a.test(size - 1) ? Relation::EQUAL : Relation::SUBSET);
+		auto tail = std::vector<uint8_t>(a.data(), a.data() + a.byte_size() + 1);
+		tail[a.byte_size()] = 0xff;
+		if (size & 0x7) {
+			tail[a.byte_size() - 1] |= uint8_t(0xff << (size & 0x7));
+		}
+		ret = ret && BitsetView(tail.data(), size).compare(BitsetView(a)) == Relation::EQUAL &&
+			  ConcurrentBitset(size, a.data()).is_subset_of(BitsetView(tail.data(), size));
+	}
+	return ret;
+}
+
+bool check_bitset_estimate() {
+	constexpr size_t size = 1 << 20;
+	constexpr double error = 0.05;
+	auto within = [&](const bitsets::CountEstimate& estimate, size_t count) {
+		auto distance = estimate.count > count ? estimate.count - count : count - estimate.count;
+		return estimate.lower <= count && count <= estimate.upper && !estimate.exact && distance <= error * size;
+	};
+	auto and_count = [](const BitsetView& lhs, const BitsetView& rhs) {
+		size_t ret = 0;
+		for (size_t i = 0; i < lhs.size(); i++) {
+			ret += lhs.test(i) && rhs.test(i);
+		}
+		return ret;
+	};
+
+	std::mt19937 gen(44);
+	bool ret = true;
+	// random at several densities, and a dense first quarter
+	for (unsigned density : {1, 10, 50, 100}) {
+		auto a = ConcurrentBitset(size);
+		auto b = ConcurrentBitset(size);
+		for (size_t i = 0; i < size; i++) {
+			if (density == 100 ? i < size / 4 : gen() % 100 < density) {
+				a.set(i);
+			}
+			if (gen() % 2) {
+				b.set(i);
+			}
+		}
+		auto view = BitsetView(a);
+		auto estimate = view.estimate_count(error);
+		auto again = view.estimate_count(error);
+		ret = ret && within(estimate, a.count()) && estimate.count == again.count && estimate.lower == again.lower &&
+			  within((~view).estimate_count(error), size - a.count()) &&
+			  within(view.subview(3, size - 9).estimate_count(error), view.subview(3, size - 9).count()) &&
+			  within(bitsets::estimate_count_and(view, BitsetView(b), error), (a & b)->count());
+		auto lhs = view.subview(5, size - 5);
+		auto rhs = ~BitsetView(b).subview(0, size - 5);
+		ret = ret && within(bitsets::estimate_count_and(lhs, rhs, error), and_count(lhs, rhs));
+	}
+
+	// small bitsets and tracked counts are counted exactly
+	auto small = ConcurrentBitset2(1000);
+	small.set(7);
+	small.set(999);
+	auto estimate = BitsetView(small).estimate_count(error);
+	ret = ret && estimate.exact && estimate.count == 2 && estimate.lower == 2 && estimate.upper == 2;
+	auto tracked = ConcurrentBitset(size);
+	auto dense = ConcurrentBitset(size, uint8_t(0xff));
+	tracked.set(12345);
+	tracked.enable_count_tracking();
+	estimate = tracked.estimate_count(error);
+	ret = ret && estimate.exact && estimate.count == 1;
+	estimate = bitsets::estimate_count_and(dense, tracked, error);
+	ret = ret && estimate.upper == 1 && estimate.count <= 1;
+	return ret;
+}
+
+bool check_bitset_delta() {
+	std::mt19937 gen(45);
+	bool ret = true;
+	for (size_t size : {61, 1000, 100003}) {
+		auto old_bits = ConcurrentBitset2(size);
+		for (size_t i = 0; i < size; i++) {
+			if (gen() % 3 == 0) {
+				old_bits.set(i);
+			}
+		}
+		// unchanged, scattered flips, a rewritten region, half of all bits
+		for (int change = 0; change < 4; change++) {
+			auto new_bits = old_bits;
+			size_t flips = 0;
+			if (change == 1) {
+				for (size_t i = gen() % 97; i < size; i += 1000 + gen() % 97, flips++) {
+					new_bits.set(i);
+					new_bits.clear(size - 1 - i);
+				}
+			} else if (change == 2) {
+				for (size_t i = size / 3; i < size / 2; i++) {
+					new_bits.set(i);
+				}
+			} else if (change == 3) {
+				for (size_t i = 0; i < size; i++) {
+					if (gen() % 2) {
+						new_bits.clear(i);
+					} else {
+						new_bits.set(i);
+					}
+				}
+			}
+			if (change) {
+				new_bits.set(size - 1);
+			}
+
+			auto delta = bitsets::diff(BitsetView(old_bits), BitsetView(new_bits));
+			ret = ret && delta.size() == size && delta.empty() == (old_bits == new_bits);
+			if (change == 1) {
+				ret = ret && delta.byte_size() <= 8 + 5 * (2 * flips + 1);
+			}
+			for (auto level : {bitsets::SimdLevel::NONE, bitsets::SimdLevel::AVX2, bitsets::SimdLevel::AVX512}) {
+				auto other = bitsets::diff(BitsetView(old_bits), BitsetView(new_bits), level);
+				ret = ret && other.byte_size() == delta.byte_size() &&
+					  std::equal(other.data(), other.data() + other.byte_size(), delta.data());
+			}
+
+			// shipped as bytes, applied to both bitset types with tracked counts
+			auto wire = std::vector<uint8_t>(delta.data(), delta.data() + delta.byte_size());
+			bitsets::BitsetDelta received;
+			ret = ret && received.deserialize(wire.data(), wire.size()) && received.size() == size;
+			auto replica = old_bits;
+			auto shared = ConcurrentBitset(size, old_bits.data());
+			shared.enable_count_tracking();
+			ret = ret && replica.apply_delta(received) && shared.apply_delta(received);
+			ret = ret && replica == new_bits && BitsetView(shared) == BitsetView(new_bits) &&
+				  shared.count() == new_bits.count();
+
+			// every truncation either parses or leaves the delta empty,
+			// without reading past its bytes
+			for (size_t len = 0; len < wire.size(); len++) {
+				auto cut = std::vector<uint8_t>(wire.begin(), wire.begin() + len);
+				if (!received.deserialize(cut.data(), cut.size())) {
+					ret = ret && received.empty() && received.size() == 0 && received.byte_size() == 0;
+				}
+			}
+
+			// complemented views and views starting inside a byte
+			replica = old_bits;
+			replica.apply_delta(bitsets::diff(~BitsetView(old_bits), ~BitsetView(new_bits)));
+			ret = ret && replica == new_bits;
+			auto old_part = old_bits.extract(3, size - 3);
+			bitsets::apply_delta(old_part->mutable_data(),
+								 bitsets::diff(BitsetView(old_bits).subview(3, size - 3),
+											   BitsetView(new_bits).subview(3, size - 3)));
+			ret = ret && *old_part == *new_bits.extract(3, size - 3);
+		}
+	}
+
+	// malformed input is refused, and a delta of another size not applied
+	auto parses = [](std::vector<uint8_t> bytes) {
+		bitsets::BitsetDelta delta;
+		return delta.deserialize(bytes.data(), bytes.size());
+	};
+	ret = ret && parses({10}) && parses({10, 0, 3, 9});
+	ret = ret && !parses({}) && !parses({0x80});
+	// a varint past 64 bits
+	ret = ret && !parses({0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02});
+	// a run past the size, a payload cut short, a bit index out of range
+	ret = ret && !parses({64, 1, 2, 0, 0, 0, 0, 0, 0, 0, 0}) && !parses({64, 0, 2, 1, 2, 3});
+	ret = ret && !parses({64, 0, 3, 64}) && !parses({64, 0, 3});
+	// changes to the bits past the size
+	ret = ret && !parses({10, 0, 3, 12}) && !parses({10, 0, 2, 0, 0x04, 0, 0, 0, 0, 0, 0});
+
+	auto small = ConcurrentBitset2(64);
+	auto large = ConcurrentBitset2(1024);
+	large.set(1000);
+	bitsets::BitsetDelta wide;
+	auto wide_bytes = bitsets::diff(BitsetView(ConcurrentBitset2(1024)), BitsetView(large));
+	ret = ret && wide.deserialize(wide_bytes.data(), wide_bytes.byte_size());
+	ret = ret && !small.apply_delta(wide) && small.count() == 0;
+	return ret;
+}
+
+bool check_bitset_hash() {
+	std::mt19937 gen(47);
+	bool ret = true;
+	for (size_t size : {0, 61, 512, 1000, 100003}) {
+		auto a = ConcurrentBitset2(size);
+		for (size_t i = 0; i < size; i++) {
+			if (gen() % 3 == 0) {
+				a.set(i);
+			}
+		}
+		auto view = BitsetView(a);
+		auto hash = a.hash128();
+		auto fingerprint = a.fingerprint();
+		for (auto level : {bitsets::SimdLevel::NONE, bitsets::SimdLevel::AVX2, bitsets::SimdLevel::AVX512}) {
+			ret = ret && faiss::kernels::hash_bits(a.data(), size, level) == hash &&
+				  faiss::kernels::fingerprint_bits(a.data(), size, level) == fingerprint;
+		}
+
+		if (size == 0) {
+			ret = ret && BitsetView(a).hash128() == hash && a.fingerprint() == faiss::kernels::mix64(0);
+			continue;
+		}
+
+		// bits past size() are ignored, the other owning type agrees
+		auto padded = std::vector<uint8_t>(a.data(), a.data() + a.byte_size());
+		padded.push_back(0xff);
+		if (size & 0x7) {
+			padded[a.byte_size() - 1] |= uint8_t(0xff << (size & 0x7));
+		}
+		auto shared = ConcurrentBitset(size, a.data());
+		ret = ret && BitsetView(padded.data(), size).hash128() == hash &&
+			  BitsetView(padded.data(), size).fingerprint() == fingerprint && shared.hash64() == a.hash64() &&
+			  shared.fingerprint() == fingerprint && view.hash128() == hash && view.fingerprint() == fingerprint;
+
+		// views starting inside a byte and complemented views
+		auto part = a.extract(3, size - 3);
+		auto negated = a;
+		negated.negate();
+		ret = ret && view.subview(3, size - 3).hash128() == part->hash128() &&
+			  view.subview(3, size - 3).fingerprint() == part->fingerprint() && (~view).hash128() == negated.hash128() &&
+			  (~view).fingerprint() == negated.fingerprint() && (~view).hash128() != hash;
+
+		// any flipped bit or another size changes both
+		for (size_t i : {size_t(0), size / 2, size - 1}) {
+			auto flipped = a;
+			flipped.test(i) ? flipped.clear(i) : flipped.set(i);
+			ret = ret && flipped.hash128().low != hash.low && flipped.hash128().high != hash.high &&
+				  flipped.fingerprint() != fingerprint;
+		}
+		ret = ret && a.extract(0, size + 1)->hash64() != hash.low && a.extract(0, size + 1)->fingerprint() != fingerprint;
+	}
+
+	// the same two stripes in the other order
+	auto front = ConcurrentBitset2(1024);
+	auto back = ConcurrentBitset2(1024);
+	for (size_t i = 0; i < 512; i += 3) {
+		front.set(i);
+		back.set(i + 512);
+	}
+	for (size_t i = 1; i < 512; i += 5) {
+		front.set(i + 512);
+		back.set(i);
+	}
+	ret = ret && front.hash128() != back.hash128() && front.fingerprint() != back.fingerprint();
+
+	// the tracked fingerprint under set / clear / set_mask and bulk operations
+	auto tracked = bitsets::ConcurrentBitset64(10007);
+	auto other = ConcurrentBitset(10007);
+	tracked.enable_fingerprint();
+	for (int round = 0; round < 4; round++) {
+		for (int k = 0; k < 500; k++) {
+			auto id = gen() % 10007;
+			gen() % 3 ? tracked.set(id) : tracked.clear(id);
+			if (k % 7 == 0 && id < 10007 / 64 * 64) {
+				tracked.set_mask(id / 64, gen() | (uint64_t(gen()) << 32));
+			}
+			other.set(gen() % 10007);
+		}
+		ret = ret && tracked.tracks_fingerprint() && tracked.fingerprint() == BitsetView(tracked).fingerprint();
+		tracked ^= BitsetView(other);
+		ret = ret && tracked.fingerprint() == BitsetView(tracked).fingerprint();
+	}
+	tracked.negate();
+	tracked <<= 77;
+	auto plain = ConcurrentBitset2(10007, tracked.data());
+	plain.enable_fingerprint();
+	plain.set(3);
+	auto copy = plain;
+	ret = ret && tracked.fingerprint() == BitsetView(tracked).fingerprint() && copy.tracks_fingerprint() &&
+		  copy.fingerprint() == BitsetView(plain).fingerprint();
+
+	auto target = ConcurrentBitset(10007, tracked.data());
+	target.set(5);
+	target.clear(6);
+	auto replica = ConcurrentBitset(10007, tracked.data());
+	replica.enable_fingerprint();
+	replica.apply_delta(bitsets::diff(BitsetView(tracked), BitsetView(target)));
+	ret = ret && replica.fingerprint() == target.fingerprint() && replica.fingerprint() == BitsetView(replica).fingerprint();
+
+	auto fixed = bitsets::FixedBitset<300>(BitsetView(target).subview(0, 300));
+	ret = ret && fixed.hash128() == target.extract(0, 300)->hash128();
+	return ret;
+}
+
 bool check_bitset_or_assign() {
 	auto cl1 = ConcurrentBitset(N_BITS, DatasetL.data());
 	auto cr1 = ConcurrentBitset(N_BITS, DatasetR.data());
@@ -276,6 +2004,33 @@ MapType CheckFuncMap = {
 	{ "&", check_bitset_and},
 	{ "&=", check_bitset_and_assign},
 	{ "flip",check_bitset_flip},
+	{ "scratch", check_bitset_scratch},
+	{ "fixed", check_bitset_fixed},
+	{ "count", check_bitset_count},
+	{ "roaring", check_bitset_roaring},
+	{ "roaring chunks", check_bitset_roaring_chunks},
+	{ "^", check_bitset_xor},
+	{ "-", check_bitset_andnot},
+	{ "filter", check_bitset_filter},
+	{ "scan", check_bitset_scan},
+	{ "bsi", check_bitset_bsi},
+	{ "bitmap index", check_bitset_bitmap_index},
+	{ "reduce", check_bitset_reduce},
+	{ "threshold", check_bitset_threshold},
+	{ "sorted ids", check_bitset_sorted_ids},
+	{ "compaction", check_bitset_compaction},
+	{ "shift", check_bitset_shift},
+	{ "subview", check_bitset_subview},
+	{ "composite", check_bitset_composite},
+	{ "numa", check_bitset_numa},
+	{ "aligned", check_bitset_aligned},
+	{ "stream", check_bitset_stream},
+	{ "write_combiner", check_bitset_write_combiner},
+	{ "complement", check_bitset_complement},
+	{ "relations", check_bitset_relations},
+	{ "estimate", check_bitset_estimate},
+	{ "delta", check_bitset_delta},
+	{ "hash", check_bitset_hash},
 };
 
 void check_test(std::string func_name){
@@ -327,6 +2082,33 @@ int main() {
 	"|",
 	"&=",
 	"&",
+	"scratch",
+	"fixed",
+	"count",
+	"roaring",
+	"roaring chunks",
+	"^",
+	"-",
+	"filter",
+	"scan",
+	"bsi",
+	"bitmap index",
+	"reduce",
+	"threshold",
+	"sorted ids",
+	"compaction",
+	"shift",
+	"subview",
+	"composite",
+	"numa",
+	"aligned",
+	"stream",
+	"write_combiner",
+	"complement",
+	"relations",
+	"estimate",
+	"delta",
+	"hash",
   };
 
   for (const auto & func_name : keys){